@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "acl.h"
+#include "../logger/logger.h"
+
+#define ACL_V4 0
+#define ACL_V6 1
+#define ACL_MAX_KEY 16
+#define ACL_LINE_SIZE 512
+#define ACL_TOKEN_DELIMITERS " \t\r\n"
+
+struct acl_rule{
+    enum acl_action action;
+    enum acl_priority priority;
+    uint16_t port_from;
+    uint16_t port_to;
+    char * user;                    // NULL matches any user
+    struct acl_rule * next;         // file order
+};
+
+/* Path-compressed trie node. `prefix' holds the first `len' bits of every
+   key below this node, the remaining bits are zeroed. */
+struct acl_node{
+    uint8_t prefix[ACL_MAX_KEY];
+    uint8_t len;
+    struct acl_node * child[2];
+    struct acl_rule * rules;
+};
+
+struct acl_table{
+    struct acl_node * roots[2];
+    enum acl_action default_action;
+    size_t rule_count;
+};
+
+static const uint8_t key_bits[] = { 32, 128 };
+
+static struct acl_table * table = NULL;
+static char * rules_path = NULL;
+
+/*----------------------
+ |  Bit helpers
+ -----------------------*/
+
+static inline unsigned
+key_bit(const uint8_t * key, unsigned pos){
+    return (key[pos >> 3] >> (7 - (pos & 7))) & 1;
+}
+
+/* Compares the bits [from, to) of both keys */
+static bool
+bits_equal(const uint8_t * a, const uint8_t * b, unsigned from, unsigned to){
+    for(unsigned byte = from >> 3; (byte << 3) < to; byte++){
+        uint8_t mask = 0xFF;
+        if((byte << 3) < from) mask &= 0xFF >> (from - (byte << 3));
+        if(((byte + 1) << 3) > to) mask &= 0xFF << (((byte + 1) << 3) - to);
+        if((a[byte] ^ b[byte]) & mask) return false;
+    }
+    return true;
+}
+
+static unsigned
+common_bits(const uint8_t * a, const uint8_t * b, unsigned max){
+    unsigned i = 0;
+    while(i < max && (i & 7) == 0 && max - i >= 8 && a[i >> 3] == b[i >> 3])
+        i += 8;
+    while(i < max && key_bit(a, i) == key_bit(b, i))
+        i++;
+    return i;
+}
+
+/*----------------------
+ |  Trie
+ -----------------------*/
+
+static struct acl_node *
+new_node(const uint8_t * key, unsigned len){
+    struct acl_node * node = calloc(1, sizeof(struct acl_node));
+    if(node == NULL) return NULL;
+    node->len = len;
+    memcpy(node->prefix, key, (len + 7) >> 3);
+    if(len & 7) node->prefix[len >> 3] &= 0xFF << (8 - (len & 7));
+    return node;
+}
+
+static void
+append_rule(struct acl_node * node, struct acl_rule * rule){
+    struct acl_rule ** last = &node->rules;
+    while(*last != NULL) last = &(*last)->next;
+    *last = rule;
+}
+
+static int
+trie_insert(struct acl_node * root, const uint8_t * key, unsigned len,
+            struct acl_rule * rule){
+    struct acl_node * node = root;
+    while(node->len < len){
+        unsigned bit = key_bit(key, node->len);
+        struct acl_node * child = node->child[bit];
+        if(child == NULL){
+            child = new_node(key, len);
+            if(child == NULL) return -1;
+            node->child[bit] = child;
+            node = child;
+            break;
+        }
+        unsigned max = child->len < len ? child->len : len;
+        unsigned common = common_bits(child->prefix, key, max);
+        if(common == child->len){
+            node = child;
+            continue;
+        }
+        /* The new prefix diverges inside the child's compressed path */
+        struct acl_node * middle = new_node(key, common);
+        if(middle == NULL) return -1;
+        middle->child[key_bit(child->prefix, common)] = child;
+        node->child[bit] = middle;
+        node = middle;
+    }
+    append_rule(node, rule);
+    return 0;
+}
+
+static const struct acl_rule *
+match_rules(const struct acl_rule * rule, uint16_t port, const char * user){
+    const struct acl_rule * generic = NULL;
+    for(; rule != NULL; rule = rule->next){
+        if(port < rule->port_from || port > rule->port_to)
+            continue;
+        if(rule->user == NULL){
+            if(generic == NULL) generic = rule;
+        }
+        else if(user != NULL && strcmp(rule->user, user) == 0){
+            return rule;
+        }
+    }
+    return generic;
+}
+
+static const struct acl_rule *
+trie_lookup(const struct acl_node * node, const uint8_t * key, unsigned bits,
+            uint16_t port, const char * user){
+    const struct acl_rule * best = NULL;
+    unsigned checked = 0;
+    while(node != NULL){
+        if(!bits_equal(node->prefix, key, checked, node->len))
+            break;
+        checked = node->len;
+        if(node->rules != NULL){
+            const struct acl_rule * rule = match_rules(node->rules, port, user);
+            if(rule != NULL) best = rule;
+        }
+        if(node->len == bits)
+            break;
+        node = node->child[key_bit(key, node->len)];
+    }
+    return best;
+}
+
+static void
+free_rules(struct acl_rule * rule){
+    while(rule != NULL){
+        struct acl_rule * next = rule->next;
+        free(rule->user);
+        free(rule);
+        rule = next;
+    }
+}
+
+static void
+free_trie(struct acl_node * node){
+    if(node == NULL) return;
+    free_trie(node->child[0]);
+    free_trie(node->child[1]);
+    free_rules(node->rules);
+    free(node);
+}
+
+static void
+free_table(struct acl_table * t){
+    if(t == NULL) return;
+    free_trie(t->roots[ACL_V4]);
+    free_trie(t->roots[ACL_V6]);
+    free(t);
+}
+
+static struct acl_table *
+new_table(){
+    static const uint8_t empty[ACL_MAX_KEY] = {0};
+    struct acl_table * t = calloc(1, sizeof(struct acl_table));
+    if(t == NULL) return NULL;
+    t->default_action = ACL_ALLOW;
+    t->roots[ACL_V4] = new_node(empty, 0);
+    t->roots[ACL_V6] = new_node(empty, 0);
+    if(t->roots[ACL_V4] == NULL || t->roots[ACL_V6] == NULL){
+        free_table(t);
+        return NULL;
+    }
+    return t;
+}
+
+/*----------------------
+ |  Rule file parsing
+ -----------------------*/
+
+static int
+parse_action(const char * token, enum acl_action * action){
+    if(strcmp(token, "allow") == 0) *action = ACL_ALLOW;
+    else if(strcmp(token, "deny") == 0) *action = ACL_DENY;
+    else return -1;
+    return 0;
+}
+
+static int
+parse_priority(const char * token, enum acl_priority * priority){
+    if(strcmp(token, "interactive") == 0) *priority = ACL_PRIORITY_INTERACTIVE;
+    else if(strcmp(token, "bulk") == 0) *priority = ACL_PRIORITY_BULK;
+    else return -1;
+    return 0;
+}
+
+static int
+parse_number(const char * s, long max, long * out){
+    char * end;
+    long value = strtol(s, &end, 10);
+    if(end == s || *end != '\0' || value < 0 || value > max) return -1;
+    *out = value;
+    return 0;
+}
+
+static int
+parse_ports(char * token, struct acl_rule * rule){
+    rule->port_from = 0;
+    rule->port_to = UINT16_MAX;
+    if(token == NULL || strcmp(token, "*") == 0) return 0;
+
+    long from, to;
+    char * dash = strchr(token, '-');
+    if(dash != NULL) *dash++ = '\0';
+    if(parse_number(token, UINT16_MAX, &from) == -1) return -1;
+    to = from;
+    if(dash != NULL && parse_number(dash, UINT16_MAX, &to) == -1) return -1;
+    if(from > to) return -1;
+    rule->port_from = from;
+    rule->port_to = to;
+    return 0;
+}
+
+/* Parses "<addr>[/<len>]" into `key'. Returns the trie index or -1 */
+static int
+parse_cidr(char * token, uint8_t * key, unsigned * len){
+    long prefix_len = -1;
+    char * slash = strchr(token, '/');
+    if(slash != NULL) *slash++ = '\0';
+
+    int which;
+    memset(key, 0, ACL_MAX_KEY);
+    if(inet_pton(AF_INET, token, key) == 1) which = ACL_V4;
+    else if(inet_pton(AF_INET6, token, key) == 1) which = ACL_V6;
+    else return -1;
+
+    if(slash != NULL && parse_number(slash, key_bits[which], &prefix_len) == -1)
+        return -1;
+    *len = slash == NULL ? key_bits[which] : (unsigned)prefix_len;
+    return which;
+}
+
+static char *
+copy_string(const char * s){
+    size_t len = strlen(s) + 1;
+    char * copy = malloc(len);
+    if(copy != NULL) memcpy(copy, s, len);
+    return copy;
+}
+
+static struct acl_rule *
+copy_rule(const struct acl_rule * rule){
+    struct acl_rule * copy = malloc(sizeof(struct acl_rule));
+    if(copy == NULL) return NULL;
+    *copy = *rule;
+    copy->next = NULL;
+    copy->user = NULL;
+    if(rule->user != NULL && (copy->user = copy_string(rule->user)) == NULL){
+        free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static int
+add_rule(struct acl_table * t, int which, const uint8_t * key, unsigned len,
+         const struct acl_rule * rule){
+    struct acl_rule * copy = copy_rule(rule);
+    if(copy == NULL) return -1;
+    if(trie_insert(t->roots[which], key, len, copy) == -1){
+        free_rules(copy);
+        return -1;
+    }
+    t->rule_count++;
+    return 0;
+}
+
+static int
+parse_line(struct acl_table * t, char * line){
+    char * save = NULL;
+    char * tokens[5] = {0};
+    int n = 0;
+
+    char * comment = strchr(line, '#');
+    if(comment != NULL) *comment = '\0';
+
+    for(char * tok = strtok_r(line, ACL_TOKEN_DELIMITERS, &save); tok != NULL;
+        tok = strtok_r(NULL, ACL_TOKEN_DELIMITERS, &save)){
+        if(n == 5) return -1;
+        tokens[n++] = tok;
+    }
+    if(n == 0) return 0;
+
+    if(strcmp(tokens[0], "default") == 0){
+        return n == 2 ? parse_action(tokens[1], &t->default_action) : -1;
+    }
+
+    struct acl_rule rule = {0};
+    if(n < 2 || parse_action(tokens[0], &rule.action) == -1) return -1;
+    if(parse_ports(tokens[2], &rule) == -1) return -1;
+    if(tokens[3] != NULL && strcmp(tokens[3], "*") != 0) rule.user = tokens[3];
+    /* Only sessions that are let through have a class */
+    if(tokens[4] != NULL && (rule.action != ACL_ALLOW ||
+                             parse_priority(tokens[4], &rule.priority) == -1)) return -1;
+
+    uint8_t key[ACL_MAX_KEY];
+    unsigned len;
+    if(strcmp(tokens[1], "*") == 0){
+        memset(key, 0, sizeof(key));
+        return add_rule(t, ACL_V4, key, 0, &rule) == -1 ||
+               add_rule(t, ACL_V6, key, 0, &rule) == -1 ? -1 : 0;
+    }
+    int which = parse_cidr(tokens[1], key, &len);
+    if(which == -1) return -1;
+    return add_rule(t, which, key, len, &rule);
+}
+
+int
+acl_load(const char * path){
+    FILE * file = fopen(path, "r");
+    if(file == NULL){
+        LogError("Could not open ACL file %s", path);
+        return -1;
+    }
+
+    struct acl_table * t = new_table();
+    if(t == NULL){
+        fclose(file);
+        return -1;
+    }
+
+    char line[ACL_LINE_SIZE];
+    unsigned line_n = 0;
+    while(fgets(line, sizeof(line), file) != NULL){
+        line_n++;
+        if(parse_line(t, line) == -1){
+            LogError("Invalid ACL rule at %s:%u", path, line_n);
+            free_table(t);
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+
+    if(rules_path == NULL || strcmp(rules_path, path) != 0){
+        char * new_path = copy_string(path);
+        if(new_path == NULL){
+            free_table(t);
+            return -1;
+        }
+        free(rules_path);
+        rules_path = new_path;
+    }
+
+    free_table(table);
+    table = t;
+    LogInfo("Loaded %lu ACL rules from %s", (unsigned long)t->rule_count, path);
+    return (int)t->rule_count;
+}
+
+int
+acl_reload(){
+    return rules_path == NULL ? 0 : acl_load(rules_path);
+}
+
+/*----------------------
+ |  Lookup
+ -----------------------*/
+
+/* The rule deciding for the destination, NULL if none does */
+static const struct acl_rule *
+lookup(int family, const uint8_t * addr, uint16_t port, const char * user){
+    if(table == NULL) return NULL;
+
+    static const uint8_t v4_mapped[] = {0,0,0,0,0,0,0,0,0,0,0xFF,0xFF};
+    int which = family == AF_INET ? ACL_V4 : ACL_V6;
+    if(which == ACL_V6 && memcmp(addr, v4_mapped, sizeof(v4_mapped)) == 0){
+        which = ACL_V4;
+        addr += sizeof(v4_mapped);
+    }
+
+    return trie_lookup(table->roots[which], addr, key_bits[which], port, user);
+}
+
+static const struct acl_rule *
+lookup_sockaddr(const struct sockaddr * addr, const char * user){
+    if(addr->sa_family == AF_INET){
+        const struct sockaddr_in * in = (const struct sockaddr_in *)addr;
+        return lookup(AF_INET, (const uint8_t *)&in->sin_addr,
+                      ntohs(in->sin_port), user);
+    }
+    if(addr->sa_family == AF_INET6){
+        const struct sockaddr_in6 * in6 = (const struct sockaddr_in6 *)addr;
+        return lookup(AF_INET6, in6->sin6_addr.s6_addr,
+                      ntohs(in6->sin6_port), user);
+    }
+    return NULL;
+}
+
+enum acl_action
+acl_check(int family, const uint8_t * addr, uint16_t port, const char * user){
+    const struct acl_rule * rule = lookup(family, addr, port, user);
+    if(rule != NULL) return rule->action;
+    return table == NULL ? ACL_ALLOW : table->default_action;
+}
+
+enum acl_action
+acl_check_sockaddr(const struct sockaddr * addr, const char * user){
+    const struct acl_rule * rule = lookup_sockaddr(addr, user);
+    if(rule != NULL) return rule->action;
+    return table == NULL ? ACL_ALLOW : table->default_action;
+}
+
+enum acl_priority
+acl_priority_sockaddr(const struct sockaddr * addr, const char * user){
+    const struct acl_rule * rule = lookup_sockaddr(addr, user);
+    return rule == NULL ? ACL_PRIORITY_BULK : rule->priority;
+}
+
+size_t
+acl_rule_count(){
+    return table == NULL ? 0 : table->rule_count;
+}
+
+void
+acl_free(){
+    free_table(table);
+    table = NULL;
+    free(rules_path);
+    rules_path = NULL;
+}
@@ -0,0 +1,65 @@
+#ifndef ACL_H
+#define ACL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+/*
+            ACL.h
+Destination access control for CONNECT requests.
+
+Rules are stored in two path-compressed binary tries (one for IPv4, one for
+IPv6) keyed by the rule's CIDR prefix. A lookup walks the trie once following
+the bits of the destination address and keeps the deepest node holding a rule
+that matches the port and user. Its cost depends on the address length, not
+on the amount of rules loaded.
+
+Rule file (one rule per line, '#' starts a comment):
+
+    allow|deny <cidr|*> [<port>|<port>-<port>|*] [<user>|*] [interactive|bulk]
+    default allow|deny
+
+On the same prefix, rules for a specific user win over generic ones; between
+rules of the same kind the first one in the file wins. When no rule matches
+the default action (allow unless stated otherwise) is applied.
+
+Allow rules may give the sessions they match a priority class. The rule
+that decides the action decides the class too. Sessions matched by no rule,
+or by a rule without a class, are bulk.
+*/
+
+enum acl_action{
+    ACL_ALLOW,
+    ACL_DENY,
+};
+
+/* Values are selector priorities: interactive sessions are served first */
+enum acl_priority{
+    ACL_PRIORITY_BULK,
+    ACL_PRIORITY_INTERACTIVE,
+};
+
+/* Loads the rules in `path'. On error the previous rules are kept.
+   Returns the amount of rules loaded or -1. */
+int acl_load(const char * path);
+
+/* Loads again the last file given to acl_load. Returns 0 if there is none. */
+int acl_reload();
+
+/* `addr' holds IPv4_BYTES or IPv6_BYTES depending on `family'. `port' is in
+   host byte order. `user' may be NULL for unauthenticated sessions. */
+enum acl_action acl_check(int family, const uint8_t * addr, uint16_t port,
+                          const char * user);
+
+enum acl_action acl_check_sockaddr(const struct sockaddr * addr, const char * user);
+
+/* Priority class of a session to `addr' */
+enum acl_priority acl_priority_sockaddr(const struct sockaddr * addr, const char * user);
+
+size_t acl_rule_count();
+
+void acl_free();
+
+#endif
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "domain_acl.h"
+#include "../logger/logger.h"
+
+#define MAX_DOMAIN_LEN 255
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+struct domain_entry{
+    uint32_t hash;
+    uint32_t offset;            // into names
+    uint8_t len;                // 0 marks an empty slot
+    uint8_t action;
+};
+
+struct domain_table{
+    struct domain_entry * slots;
+    size_t mask;
+    char * names;               // the list file itself, lowercased in place
+    size_t names_size;
+    size_t entries;
+    enum acl_action default_action;
+};
+
+static struct domain_table * table = NULL;
+static char * list_path = NULL;
+static struct domain_acl_stats stats = {0};
+
+static inline uint8_t
+lower(uint8_t c){
+    return (c >= 'A' && c <= 'Z') ? c | 0x20 : c;
+}
+
+static inline uint32_t
+hash_step(uint32_t h, uint8_t c){
+    return (h ^ c) * FNV_PRIME;
+}
+
+/* Hash of `len' bytes read right to left, same order used by the lookup */
+static uint32_t
+suffix_hash(const char * name, size_t len){
+    uint32_t h = FNV_OFFSET;
+    while(len > 0) h = hash_step(h, (uint8_t)name[--len]);
+    return h;
+}
+
+static struct domain_entry *
+find_slot(struct domain_table * t, uint32_t hash, const char * name, size_t len){
+    size_t i = hash & t->mask;
+    while(t->slots[i].len != 0){
+        struct domain_entry * e = &t->slots[i];
+        if(e->hash == hash && e->len == len && memcmp(t->names + e->offset, name, len) == 0)
+            return e;
+        i = (i + 1) & t->mask;
+    }
+    return &t->slots[i];
+}
+
+static void
+free_table(struct domain_table * t){
+    if(t == NULL) return;
+    free(t->slots);
+    free(t->names);
+    free(t);
+}
+
+static char *
+read_file(const char * path, size_t * size){
+    FILE * file = fopen(path, "rb");
+    if(file == NULL) return NULL;
+    char * data = NULL;
+    long len;
+    if(fseek(file, 0, SEEK_END) != 0 || (len = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0)
+        goto finally;
+    data = malloc(len + 1);
+    if(data == NULL) goto finally;
+    if(fread(data, 1, len, file) != (size_t)len){
+        free(data);
+        data = NULL;
+        goto finally;
+    }
+    data[len] = '\0';
+    *size = len;
+finally:
+    fclose(file);
+    return data;
+}
+
+static int
+parse_action(const char * word, size_t len, enum acl_action * action){
+    if(len == 5 && memcmp(word, "allow", 5) == 0) *action = ACL_ALLOW;
+    else if(len == 4 && memcmp(word, "deny", 4) == 0) *action = ACL_DENY;
+    else return -1;
+    return 0;
+}
+
+static const char *
+next_word(const char * p, const char * end, size_t * len){
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    const char * start = p;
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    *len = p - start;
+    return start;
+}
+
+/* Lines are parsed in place: the names stay in the file buffer */
+static int
+parse_line(struct domain_table * t, char * line, char * end){
+    char * comment = memchr(line, '#', end - line);
+    if(comment != NULL) end = comment;
+
+    size_t len, next_len;
+    const char * word = next_word(line, end, &len);
+    if(len == 0) return 0;
+    const char * next = next_word(word + len, end, &next_len);
+
+    enum acl_action action = ACL_DENY;
+    if(next_len != 0){
+        if(len == 7 && memcmp(word, "default", 7) == 0)
+            return parse_action(next, next_len, &t->default_action);
+        if(parse_action(word, len, &action) == -1) return -1;
+        word = next;
+        len = next_len;
+        next_word(next + next_len, end, &next_len);
+        if(next_len != 0) return -1;
+    }
+
+    if(len >= 2 && word[0] == '*' && word[1] == '.'){ word += 2; len -= 2; }
+    else if(len >= 1 && word[0] == '.'){ word++; len--; }
+    if(len >= 1 && word[len - 1] == '.') len--;
+    if(len == 0 || len > MAX_DOMAIN_LEN) return -1;
+
+    char * name = (char *)word;
+    for(size_t i = 0; i < len; i++) name[i] = lower(name[i]);
+
+    uint32_t hash = suffix_hash(name, len);
+    struct domain_entry * slot = find_slot(t, hash, name, len);
+    if(slot->len == 0){
+        slot->hash = hash;
+        slot->offset = name - t->names;
+        slot->len = len;
+        t->entries++;
+    }
+    slot->action = action;
+    return 0;
+}
+
+static long
+elapsed_usec(const struct timespec * from){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - from->tv_sec) * 1000000L + (now.tv_nsec - from->tv_nsec) / 1000;
+}
+
+long
+domain_acl_load(const char * path){
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct domain_table * t = calloc(1, sizeof(struct domain_table));
+    if(t == NULL) return -1;
+    t->default_action = ACL_ALLOW;
+
+    t->names = read_file(path, &t->names_size);
+    if(t->names == NULL || t->names_size > UINT32_MAX){
+        LogError("Could not read domain list %s", path);
+        free_table(t);
+        return -1;
+    }
+
+    /* One line per entry at most: keep the load factor under 1/2 */
+    size_t lines = 1;
+    for(const char * p = t->names; (p = memchr(p, '\n', t->names + t->names_size - p)) != NULL; p++)
+        lines++;
+    size_t capacity = 16;
+    while(capacity < lines * 2) capacity <<= 1;
+    t->slots = calloc(capacity, sizeof(struct domain_entry));
+    if(t->slots == NULL){
+        free_table(t);
+        return -1;
+    }
+    t->mask = capacity - 1;
+
+    char * end = t->names + t->names_size;
+    unsigned line_n = 0;
+    for(char * line = t->names; line < end; ){
+        char * eol = memchr(line, '\n', end - line);
+        if(eol == NULL) eol = end;
+        line_n++;
+        if(parse_line(t, line, eol) == -1){
+            LogError("Invalid domain entry at %s:%u", path, line_n);
+            free_table(t);
+            return -1;
+        }
+        line = eol + 1;
+    }
+
+    if(list_path == NULL || strcmp(list_path, path) != 0){
+        size_t len = strlen(path) + 1;
+        char * new_path = malloc(len);
+        if(new_path == NULL){
+            free_table(t);
+            return -1;
+        }
+        memcpy(new_path, path, len);
+        free(list_path);
+        list_path = new_path;
+    }
+
+    free_table(table);
+    table = t;
+
+    stats.entries = t->entries;
+    stats.memory = sizeof(*t) + t->names_size + capacity * sizeof(struct domain_entry);
+    stats.build_usec = elapsed_usec(&start);
+    LogInfo("Loaded %lu domain entries from %s in %ld usec", (unsigned long)t->entries,
+            path, stats.build_usec);
+    return (long)t->entries;
+}
+
+long
+domain_acl_reload(){
+    return list_path == NULL ? 0 : domain_acl_load(list_path);
+}
+
+enum acl_action
+domain_acl_check(const char * fqdn){
+    if(table == NULL) return ACL_ALLOW;
+
+    size_t len = strlen(fqdn);
+    if(len > 0 && fqdn[len - 1] == '.') len--;
+    if(len == 0 || len > MAX_DOMAIN_LEN) return table->default_action;
+
+    /* Right to left: at every label boundary the hash covers exactly the
+       suffix that starts after it */
+    char name[MAX_DOMAIN_LEN];
+    const struct domain_entry * match = NULL;
+    uint32_t h = FNV_OFFSET;
+    for(size_t i = len; i-- > 0; ){
+        uint8_t c = lower((uint8_t)fqdn[i]);
+        if(c == '.' && i + 1 < len){
+            const struct domain_entry * e = find_slot(table, h, name + i + 1, len - i - 1);
+            if(e->len != 0) match = e;
+        }
+        name[i] = c;
+        h = hash_step(h, c);
+    }
+    const struct domain_entry * e = find_slot(table, h, name, len);
+    if(e->len != 0) match = e;
+
+    return match == NULL ? table->default_action : (enum acl_action)match->action;
+}
+
+struct domain_acl_stats
+domain_acl_get_stats(){
+    return stats;
+}
+
+void
+domain_acl_free(){
+    free_table(table);
+    table = NULL;
+    free(list_path);
+    list_path = NULL;
+}
@@ -0,0 +1,46 @@
+#ifndef DOMAIN_ACL_H
+#define DOMAIN_ACL_H
+
+#include <stddef.h>
+
+#include "acl.h"
+
+/*
+            DOMAIN_ACL.h
+Allow/deny lists for FQDN requests, evaluated before the name is resolved.
+
+Every rule is a domain suffix: "example.com" (or "*.example.com") matches the
+domain itself and all of its subdomains. Suffixes are kept in an open
+addressing hash set. The requested name is lowercased and hashed right to
+left in a single pass, and every label boundary is looked up as it is
+reached, so the most specific suffix wins.
+
+List file (one entry per line, '#' starts a comment):
+
+    [allow|deny] <domain>
+    default allow|deny
+
+A bare domain is a deny entry, so plain blocklists can be used as is.
+*/
+
+struct domain_acl_stats{
+    size_t entries;
+    size_t memory;          // bytes used by the table and the names
+    long build_usec;        // time spent loading the last list
+};
+
+/* Loads the list in `path'. On error the previous list is kept.
+   Returns the amount of entries loaded or -1. */
+long domain_acl_load(const char * path);
+
+/* Loads again the last file given to domain_acl_load. Returns 0 if there is none. */
+long domain_acl_reload();
+
+/* `fqdn' is a NUL terminated name as sent by the client */
+enum acl_action domain_acl_check(const char * fqdn);
+
+struct domain_acl_stats domain_acl_get_stats();
+
+void domain_acl_free();
+
+#endif
@@ -9,6 +9,7 @@
 #include "include/args.h"
 #include "logger/logger.h"
 #include "users/user_mgmt.h"
+#include "include/metrics.h"
 
 static char * 
 port(char * s) {
@@ -24,6 +25,19 @@ port(char * s) {
     return s;
 }
 
+static long
+positive(char * s, const char * what) {
+    char * end = 0;
+    const long sl = strtol(s, &end, 10);
+
+    if (end == s || '\0' != *end ||
+        ((LONG_MIN == sl || LONG_MAX == sl) && ERANGE == errno) || sl <= 0) {
+        fprintf(stderr, "%s should be a positive number: %s\n", what, s);
+        return -1;
+    }
+    return sl;
+}
+
 static void
 user(char *s) {
     user_t * user = malloc(sizeof(user_t));
@@ -53,14 +67,23 @@ usage(const char * progname) {
     fprintf(stderr,
         "Usage: %s [OPTION]...\n"
         "\n"
+        "   -b <domain file> Lista de dominios permitidos/bloqueados para pedidos FQDN.\n"
+        "   -e <metrics port> Puerto HTTP donde se exportan las métricas (/metrics). Deshabilitado por defecto.\n"
+        "   -E <metrics addr> Dirección donde servirá el exporter de métricas.\n"
         "   -h               Imprime la ayuda y termina.\n"
+        "   -k <size>        Cantidad de destinos/usuarios que guarda cada top-K (32 por defecto).\n"
+        "   -K <width>       Contadores por fila de los sketches del top-K (4096 por defecto).\n"
+        "   -a <ACL file>    Archivo con reglas de acceso por destino (CIDR, puertos, usuario).\n"
+        "   -A <file>        Archivo donde se guarda la contabilidad de tráfico por usuario.\n"
         "   -l <SOCKS addr>  Dirección donde servirá el proxy SOCKS.\n"
         "   -N               Deshabilita los passwords disectors.\n"
+        "   -o <dir>         Escribe el registro de acceso en formato binario en <dir> (ver socks5log).\n"
         "   -L <conf addr>   Dirección donde servirá el servicio de management.\n"
         "   -p <SOCKS port>  Puerto entrante conexiones SOCKS.\n"
         "   -P <conf port>   Puerto entrante conexiones configuracion\n"
-        "   -u <name>:<pass> Usuario y contraseña de usuario que puede usar el proxy. Hasta 10.\n"
+        "   -u <name>:<pass> Usuario y contraseña de usuario que puede usar el proxy. Se puede repetir.\n"
         "   -v               Imprime información sobre la versión versión y termina.\n"
+        "   -w               Busca credenciales en un hilo aparte, fuera del camino del relay.\n"
         "   -m               Activa la opción de debugger.\n"
         "   -n               Desactiva la opción de debugger.\n"
         
@@ -78,17 +101,52 @@ void parse_args(int argc, char ** argv, struct socks5args * args) {
     args->mng_addr = NULL;
     args->mng_port = "8080";
 
+    args->top_size = TOP_DEFAULT_SIZE;
+    args->top_width = TOP_DEFAULT_WIDTH;
+
     int ret_code = 0;
 
     int c;
     while (true) {
-        c = getopt(argc, argv, "hl:L:Np:P:U:u:vmn");
+        c = getopt(argc, argv, "a:A:b:e:E:hk:K:l:L:No:p:P:U:u:vwmn");
         if (c == -1)
             break;
         switch (c) {
+            case 'a':
+                args->acl_file = optarg;
+                break;
+            case 'A':
+                args->accounting_file = optarg;
+                break;
+            case 'b':
+                args->domain_list_file = optarg;
+                break;
+            case 'e':
+                args->metrics_port = port(optarg);
+                if (args->metrics_port == NULL) {
+                    ret_code = 1;
+                    goto finally;
+                }
+                break;
+            case 'E':
+                args->metrics_addr = optarg;
+                break;
             case 'h':
                 usage("socks5d");
                     goto finally;
+            case 'k':
+            case 'K': {
+                long value = positive(optarg, c == 'k' ? "top-K size" : "sketch width");
+                if (value == -1) {
+                    ret_code = 1;
+                    goto finally;
+                }
+                if (c == 'k')
+                    args->top_size = value;
+                else
+                    args->top_width = value;
+                break;
+            }
             case 'l':
                 args->socks_addr = optarg;
                 break;
@@ -98,6 +156,9 @@ void parse_args(int argc, char ** argv, struct socks5args * args) {
             case 'N':
                 set_sniffer_state(false);
                 break;
+            case 'o':
+                args->access_log_dir = optarg;
+                break;
             case 'p':
                 args->socks_port = port(optarg);
                 if (args->socks_port == NULL) {
@@ -118,6 +179,9 @@ void parse_args(int argc, char ** argv, struct socks5args * args) {
             case 'v':
                 version();
                 goto finally;
+            case 'w':
+                args->sniff_worker = true;
+                break;
             case 'm':
                 setLogOn();
                 break;
@@ -0,0 +1,170 @@
+/**
+ * parsers_bench.c - microbenchmark de los parsers de SOCKS5
+ *
+ * Mide cada parser (saludo, autenticacion y pedidos IPv4, IPv6 y FQDN de
+ * 255 bytes) por dos caminos: con el mensaje completo en el buffer, que lo
+ * decodifica de una vez, y con el mismo mensaje llegando de a 1 byte, que lo
+ * recorre con la maquina de estados byte a byte. Imprime el tiempo por
+ * mensaje de cada camino.
+ *
+ * Uso: parsers_bench [iteraciones]     (se corre con `make bench')
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/buffer.h"
+#include "../parsers/conn_parser.h"
+#include "../parsers/auth_parser.h"
+#include "../parsers/req_parser.h"
+
+#define DEFAULT_ITERATIONS 1000000L
+#define MAX_MESSAGE 512
+
+struct message {
+    const char * name;
+    uint8_t data[MAX_MESSAGE];
+    size_t len;
+    /* inicializa el parser, consume lo que haya en `buff' y dice si termino bien */
+    bool (*parse)(buffer * buff, bool init);
+};
+
+static struct conn_parser conn;
+static struct auth_parser auth;
+static struct req_parser req;
+
+static bool
+parse_hello(buffer * buff, bool init){
+    if(init) start_connection_parser(&conn);
+    return conn_parse_full(&conn, buff) == CONN_DONE;
+}
+
+static bool
+parse_auth(buffer * buff, bool init){
+    if(init) auth_parser_init(&auth);
+    return auth_parse_full(&auth, buff) == AUTH_DONE;
+}
+
+static bool
+parse_req(buffer * buff, bool init){
+    if(init) req_parser_init(&req);
+    return req_parse_full(&req, buff) == REQ_DONE;
+}
+
+static size_t
+put(uint8_t * out, const void * bytes, size_t len){
+    memcpy(out, bytes, len);
+    return len;
+}
+
+static void
+build_messages(struct message * m){
+    static const uint8_t hello[] = {0x05, 0x02, 0x00, 0x02};
+    static const uint8_t req_head[] = {0x05, 0x01, 0x00};
+    static const uint8_t port[] = {0x01, 0xBB};
+    size_t n;
+
+    m[0] = (struct message){.name = "greeting", .parse = parse_hello};
+    m[0].len = put(m[0].data, hello, sizeof(hello));
+
+    m[1] = (struct message){.name = "auth", .parse = parse_auth};
+    n = put(m[1].data, "\x01\x08", 2);
+    n += put(m[1].data + n, "operator", 8);
+    m[1].data[n++] = 16;
+    n += put(m[1].data + n, "s3cr3t-passw0rd!", 16);
+    m[1].len = n;
+
+    m[2] = (struct message){.name = "request IPv4", .parse = parse_req};
+    n = put(m[2].data, req_head, sizeof(req_head));
+    m[2].data[n++] = IPv4;
+    n += put(m[2].data + n, "\xC0\xA8\x01\x0A", IPv4_BYTES);
+    m[2].len = n + put(m[2].data + n, port, sizeof(port));
+
+    m[3] = (struct message){.name = "request IPv6", .parse = parse_req};
+    n = put(m[3].data, req_head, sizeof(req_head));
+    m[3].data[n++] = IPv6;
+    n += put(m[3].data + n, "\x20\x01\x0d\xb8\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x01",
+             IPv6_BYTES);
+    m[3].len = n + put(m[3].data + n, port, sizeof(port));
+
+    m[4] = (struct message){.name = "request FQDN 255", .parse = parse_req};
+    n = put(m[4].data, req_head, sizeof(req_head));
+    m[4].data[n++] = FQDN;
+    m[4].data[n++] = MAX_FQDN_SIZE;
+    for(size_t i = 0; i < MAX_FQDN_SIZE; i++)
+        m[4].data[n++] = i % 64 == 63 ? '.' : 'a' + i % 26;
+    m[4].len = n + put(m[4].data + n, port, sizeof(port));
+}
+
+static double
+now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Todo el mensaje en el buffer antes de parsear */
+static double
+bench_whole(const struct message * m, long iterations, long * failures){
+    uint8_t data[MAX_MESSAGE];
+    buffer buff;
+    double start = now_ns();
+    for(long i = 0; i < iterations; i++){
+        memcpy(data, m->data, m->len);
+        buffer_init(&buff, m->len, data);
+        buffer_write_adv(&buff, m->len);
+        if(!m->parse(&buff, true)) (*failures)++;
+    }
+    return (now_ns() - start) / iterations;
+}
+
+/* El mensaje llega de a un byte, como lo dejaria un recv por byte: una
+   llamada al parser por cada uno */
+static double
+bench_bytewise(const struct message * m, long iterations, long * failures){
+    uint8_t data[MAX_MESSAGE];
+    buffer buff;
+    double start = now_ns();
+    for(long i = 0; i < iterations; i++){
+        buffer_init(&buff, m->len, data);
+        bool done = false;
+        for(size_t b = 0; b < m->len; b++){
+            size_t space;
+            *buffer_write_ptr(&buff, &space) = m->data[b];
+            buffer_write_adv(&buff, 1);
+            done = m->parse(&buff, b == 0);
+        }
+        if(!done) (*failures)++;
+    }
+    return (now_ns() - start) / iterations;
+}
+
+int
+main(int argc, char ** argv){
+    long iterations = argc > 1 ? strtol(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+    if(iterations <= 0){
+        fprintf(stderr, "Uso: %s [iteraciones]\n", argv[0]);
+        return 1;
+    }
+
+    struct message messages[5];
+    build_messages(messages);
+
+    printf("%-18s %6s %14s %14s %8s\n", "message", "bytes", "whole ns/msg", "1-byte ns/msg", "speedup");
+    long failures = 0;
+    for(size_t i = 0; i < sizeof(messages) / sizeof(messages[0]); i++){
+        const struct message * m = &messages[i];
+        double whole = bench_whole(m, iterations, &failures);
+        double bytewise = bench_bytewise(m, iterations, &failures);
+        printf("%-18s %6zu %14.1f %14.1f %7.1fx\n", m->name, m->len, whole, bytewise,
+               bytewise / whole);
+    }
+    if(failures > 0){
+        fprintf(stderr, "%ld mensajes no se parsearon completos\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -22,7 +22,19 @@ char * commandStr[] = {
         "metrics",
         "dis",
         "disoff",
-        "exit"
+        "exit",
+        "reload",
+        "latency",
+        "top",
+        "trace",
+        "disproto",
+        "creds",
+        "batch",
+        "config",
+        "set",
+        "sessions",
+        "kill",
+        "accounting"
 };
 
 typedef enum controlProtErrorCode{
@@ -33,7 +45,10 @@ typedef enum controlProtErrorCode{
     CPERROR_INEXISTING_USER,
     CPERROR_ALREADY_EXISTS,
     CPERROR_USER_LIMIT,
-    CPERROR_GENERAL_ERROR     /* Encapsulamiento de los errores de memoria */
+    CPERROR_GENERAL_ERROR,    /* Encapsulamiento de los errores de memoria */
+    CPERROR_POLICY_ERROR,
+    CPERROR_INVALID_VALUE,
+    CPERROR_INEXISTING_SESSION
 } controlProtErrorCode;
 
 int mng_connect(char * addr, char * port);
@@ -121,6 +136,15 @@ int analyze_return(char ret) {
     case CPERROR_USER_LIMIT:
         printf("Error: user limit reached\n");
         break;
+    case CPERROR_POLICY_ERROR:
+        printf("Error: invalid policy file, previous rules are kept\n");
+        break;
+    case CPERROR_INVALID_VALUE:
+        printf("Error: unknown parameter or value out of range (see \"config\")\n");
+        break;
+    case CPERROR_INEXISTING_SESSION:
+        printf("Error: session does not exist\n");
+        break;
     default:
         break;
     }
@@ -222,6 +246,121 @@ int new_command() {
             printf("Bye!\n");
             return 1;
             break;
+        case 10:
+            aux = strtok(NULL, " ");
+            if(aux != NULL)
+                goto error;
+            ret = reload_policies(proxy_socket);
+            break;
+        case 11:
+            aux = strtok(NULL, " ");
+            if(aux != NULL)
+                goto error;
+            ret = obtain_latencies(proxy_socket);
+            break;
+        case 12:
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg, aux);
+            aux = strtok(NULL, " ");
+            if(aux != NULL)
+                strcpy(arg2, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = obtain_top(arg, arg2, proxy_socket);
+            break;
+        case 13:
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = trace(arg, proxy_socket);
+            break;
+        case 14:
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg, aux);
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg2, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = double_arg_command(COMMAND_DISSECTOR_PROTO, arg, arg2, proxy_socket);
+            break;
+        case 15:
+            aux = strtok(NULL, " ");
+            if(aux != NULL)
+                strcpy(arg, aux);
+            aux = strtok(NULL, " ");
+            if(aux != NULL)
+                strcpy(arg2, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = obtain_credentials(arg, arg2, proxy_socket);
+            break;
+        case 16:
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = batch(arg, proxy_socket);
+            break;
+        case 17:
+            aux = strtok(NULL, " ");
+            if(aux != NULL)
+                strcpy(arg, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = obtain_config(arg, proxy_socket);
+            break;
+        case 18:
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg, aux);
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg2, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = double_arg_command(COMMAND_SET_CONFIG, arg, arg2, proxy_socket);
+            break;
+        case 19:
+            /* Los filtros van separados por ';' */
+            while((aux = strtok(NULL, " ")) != NULL) {
+                if(strlen(arg) + strlen(aux) + 1 >= BATCH_ITEM_DATA)
+                    goto too_many_args;
+                if(arg[0] != '\0')
+                    strcat(arg, ";");
+                strcat(arg, aux);
+            }
+            ret = obtain_sessions(arg, proxy_socket);
+            break;
+        case 20:
+            aux = strtok(NULL, " ");
+            if(aux == NULL)
+                goto not_enough_args;
+            strcpy(arg, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = single_arg_command(COMMAND_KILL_SESSION, arg, proxy_socket);
+            break;
+        case 21:
+            aux = strtok(NULL, " ");
+            if(aux != NULL)
+                strcpy(arg, aux);
+            if(strtok(NULL, " ") != NULL)
+                goto too_many_args;
+            ret = obtain_accounting(arg, proxy_socket);
+            break;
         default:
             goto error;
         }
@@ -1,117 +1,103 @@
 
 #include "commands.h"
 
-int row_count = 0;
+char parse_metrics_message(int fd) {
 
-char parse_users_message(int fd, char * offset) {
+    uint8_t response_buf[MAXLEN];
 
-    uint8_t response_buf[MAXLEN] = {0};
     //FIXME: Estaba sin inicializar
     size_t byte_n = MAXLEN;
     ssize_t n_received = recv(fd, response_buf, byte_n, 0);
 
     if(n_received < 0)
         return 'x';
-
+    
     if(n_received == 0)
         return 'n';
-        
-    int pos = 0;
-    if(offset == NULL) {
-        if((char)response_buf[0] == FAILURE) {
-            if(response_buf[1] != HAS_DATA)
-                return 'x';
-            return (char)response_buf[2];
-        }
-        //row_count = 1;
-        row_count = (int)response_buf[1];
-        pos = 2;
 
-        if(row_count == 1) {
-        printf("No users yet\n");
-        return 'i';
-        }
+    if((char)response_buf[0] == FAILURE) {
+        if(response_buf[1] != HAS_DATA)
+            return 'x';
+        return (char)response_buf[2];
     }
 
-    if(offset==NULL)
-        offset = "";
-
-
     char str[2] = {0};
     str[0] = TOKEN;
 
-    char * current_user = strtok((char*)&response_buf[pos], str);
-    if(response_buf[0] == TOKEN) {
-        printf("%s\n", offset);
-        printf("%s\n", current_user);
-        row_count--;
-    } else {
-        char aux[MAXLEN] = {0};
-        strcat(aux, offset);
-        strcat(aux, current_user);
-
-        printf("%s\n", aux);
-    }
-    
-    pos += strlen(current_user);
-    row_count--;
-
-    
-    while(pos<MAXLEN && row_count > 0) {
-        if(response_buf[pos++] == TOKEN) {
-            current_user = strtok(NULL, str);
-            row_count--;
-            printf("%s\n", current_user);        
-        } 
-    }
-
-    char str2[2] = {0};
-    str2[0] = '\0';
-
-    if(row_count < 0)
-        return '0';
-
-    if(row_count > 0) {
-        current_user = strtok(NULL, str2);
-        if(current_user == NULL)
-            current_user = "";
-        return parse_users_message(fd, current_user);
-    }
+    char * metrics = strtok((char*)&response_buf[2], str);
+    printf("%s\n", metrics);
+    metrics = strtok(NULL, str);
+    printf("%s\n", metrics);
     
     return 'i';
 }
 
-char parse_metrics_message(int fd) {
-
-    uint8_t response_buf[MAXLEN];
+/* Imprime las filas de una respuesta con formato de tabla CSV */
+char parse_table_message(int fd) {
 
-    //FIXME: Estaba sin inicializar
-    size_t byte_n = MAXLEN;
-    ssize_t n_received = recv(fd, response_buf, byte_n, 0);
+    char response_buf[MAXLEN + 1] = {0};
+    ssize_t n_received = recv(fd, response_buf, MAXLEN, 0);
 
     if(n_received < 0)
         return 'x';
-    
+
     if(n_received == 0)
         return 'n';
 
-    if((char)response_buf[0] == FAILURE) {
+    if(response_buf[0] == FAILURE) {
         if(response_buf[1] != HAS_DATA)
             return 'x';
-        return (char)response_buf[2];
+        return response_buf[2];
     }
 
-    char str[2] = {0};
-    str[0] = TOKEN;
+    if(n_received > 2)
+        printf("%s", &response_buf[2]);
 
-    char * metrics = strtok((char*)&response_buf[2], str);
-    printf("%s\n", metrics);
-    metrics = strtok(NULL, str);
-    printf("%s\n", metrics);
-    
     return 'i';
 }
 
+static int recv_all(int fd, uint8_t * buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = recv(fd, buf, len, 0);
+        if(n <= 0)
+            return n;
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/* Imprime una respuesta enmarcada: STATUS y frames LEN(2)+DATA hasta
+   un frame vacio */
+char parse_framed_message(int fd) {
+
+    uint8_t status;
+    int r = recv_all(fd, &status, 1);
+    if(r <= 0)
+        return r == 0 ? 'n' : 'x';
+
+    char error = 'x';
+    uint8_t frame[0xFFFF + 1];
+    while(1) {
+        uint8_t len_buf[2];
+        r = recv_all(fd, len_buf, 2);
+        if(r <= 0)
+            return r == 0 ? 'n' : 'x';
+        size_t len = (len_buf[0] << 8) | len_buf[1];
+        if(len == 0)
+            break;
+        r = recv_all(fd, frame, len);
+        if(r <= 0)
+            return r == 0 ? 'n' : 'x';
+        if(status == FAILURE)
+            error = (char)frame[0];
+        else
+            fwrite(frame, 1, len, stdout);
+    }
+
+    return status == FAILURE ? error : 'i';
+}
+
 char receive_simple_response(int fd) {
 
 
@@ -143,8 +129,20 @@ void help() {
     printf(" - editpass <user> <newpass>: edits add existing user password's\n\n");
     printf(" - list: list all users of socks5 server\n\n");
     printf(" - metrics: displays server usage metrics\n\n");
-    printf(" - dis: turns on the pop3 password dissector\n\n");
-    printf(" - disoff: turns off the pop3 password dissector\n\n");
+    printf(" - dis: turns on the password dissectors\n\n");
+    printf(" - disoff: turns off the password dissectors\n\n");
+    printf(" - disproto <pop3|imap|ftp|smtp|http> <on|off>: turns one protocol dissector on or off\n\n");
+    printf(" - reload: reloads the destination access policies\n\n");
+    printf(" - latency: displays connection phase latency percentiles\n\n");
+    printf(" - top <dst|user> [n]: displays the n destinations or users with most connections and bytes\n\n");
+    printf(" - trace <on|off|n>: turns the server tracepoints on or off, or displays the last n events\n\n");
+    printf(" - batch <file>: applies the adduser, deleteuser and editpass lines of file in one batch\n\n");
+    printf(" - config [name]: displays the runtime-tunable server parameters, or only name\n\n");
+    printf(" - set <name> <value>: changes a server parameter; applies to new sessions\n\n");
+    printf(" - creds [from] [n]: displays the sniffed credentials starting at id from (up to n)\n\n");
+    printf(" - sessions [from=id] [n=n] [user=u] [client=ip] [dst=text] [state=s]: displays the active sessions\n\n");
+    printf(" - kill <id>: terminates an active session\n\n");
+    printf(" - accounting [user]: displays the traffic of every user, or only user\n\n");
     printf(" - exit: bye bye!\n");
 }
 
@@ -155,6 +153,13 @@ void send_simple(int fd, int command) {
     send(fd, to_send, 2, 0);
 }
 
+static void send_simple_framed(int fd, int command) {
+    char to_send[2];
+    to_send[0] = command;
+    to_send[1] = (char) (HAS_NOT_DATA | FRAMED);
+    send(fd, to_send, 2, 0);
+}
+
 int admin_auth(int fd, char * buf) {
 
     fgets(buf, MAXLEN, stdin);
@@ -206,9 +211,10 @@ char double_arg_command(int command, char *username, char * pass, int fd) {
 
 char list_users(int command,int fd) {
 
-    send_simple(fd, command);
+    /* Enmarcada: la lista no depende del tamanio del buffer del servidor */
+    send_simple_framed(fd, command);
 
-    return parse_users_message(fd, NULL);
+    return parse_framed_message(fd);
 }
 
 char obtain_metrics(int fd) {
@@ -224,3 +230,283 @@ char dissector(int on, int fd) {
 
     return receive_simple_response(fd);
 }
+
+char reload_policies(int fd) {
+
+    send_simple(fd, COMMAND_RELOAD_POLICY);
+
+    return receive_simple_response(fd);
+}
+
+char obtain_latencies(int fd) {
+
+    send_simple(fd, COMMAND_GET_LATENCIES);
+
+    return parse_table_message(fd);
+}
+
+char obtain_config(char * name, int fd) {
+    if(name[0] == '\0') {
+        send_simple(fd, COMMAND_GET_CONFIG);
+        return parse_table_message(fd);
+    }
+
+    size_t len = strlen(name) + 3;
+    char to_send[MAXLEN] = {0};
+    to_send[0] = COMMAND_GET_CONFIG;
+    to_send[1] = HAS_DATA;
+    strcat(to_send, name);
+    to_send[len-1] = '\n';
+    send(fd, to_send, len, 0);
+
+    return parse_table_message(fd);
+}
+
+char obtain_top(char * kind, char * count, int fd) {
+    size_t len = strlen(kind) + 3;
+    char to_send[MAXLEN] = {0};
+    to_send[0] = COMMAND_GET_TOP;
+    to_send[1] = HAS_DATA;
+    strcat(to_send, kind);
+    if(count[0] != '\0') {
+        strcat(to_send, ":");
+        strcat(to_send, count);
+        len += strlen(count) + 1;
+    }
+    to_send[len-1] = '\n';
+    send(fd, to_send, len, 0);
+
+    return parse_table_message(fd);
+}
+
+char trace(char * arg, int fd) {
+    if(strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0)
+        return single_arg_command(COMMAND_TRACE, arg, fd);
+
+    size_t len = strlen(arg) + 3;
+    char to_send[MAXLEN] = {0};
+    to_send[0] = COMMAND_TRACE;
+    to_send[1] = HAS_DATA;
+    strcat(to_send, arg);
+    to_send[len-1] = '\n';
+    send(fd, to_send, len, 0);
+
+    return parse_table_message(fd);
+}
+
+char obtain_credentials(char * from, char * count, int fd) {
+    /* Enmarcada: sin n se reciben todas las credenciales desde from */
+    if(from[0] == '\0') {
+        send_simple_framed(fd, COMMAND_GET_CREDENTIALS);
+        return parse_framed_message(fd);
+    }
+
+    size_t len = strlen(from) + 3;
+    char to_send[MAXLEN] = {0};
+    to_send[0] = COMMAND_GET_CREDENTIALS;
+    to_send[1] = (char) (HAS_DATA | FRAMED);
+    strcat(to_send, from);
+    if(count[0] != '\0') {
+        strcat(to_send, ":");
+        strcat(to_send, count);
+        len += strlen(count) + 1;
+    }
+    to_send[len-1] = '\n';
+    send(fd, to_send, len, 0);
+
+    return parse_framed_message(fd);
+}
+
+char obtain_sessions(char * filters, int fd) {
+    /* Enmarcada: sin n se reciben todas las sesiones que pasan los filtros */
+    if(filters[0] == '\0') {
+        send_simple_framed(fd, COMMAND_LIST_SESSIONS);
+        return parse_framed_message(fd);
+    }
+
+    size_t len = strlen(filters) + 3;
+    char to_send[MAXLEN] = {0};
+    to_send[0] = COMMAND_LIST_SESSIONS;
+    to_send[1] = (char) (HAS_DATA | FRAMED);
+    strcat(to_send, filters);
+    to_send[len-1] = '\n';
+    send(fd, to_send, len, 0);
+
+    return parse_framed_message(fd);
+}
+
+char obtain_accounting(char * user, int fd) {
+    if(user[0] == '\0') {
+        send_simple_framed(fd, COMMAND_GET_ACCOUNTING);
+        return parse_framed_message(fd);
+    }
+
+    size_t len = strlen("user=") + strlen(user) + 3;
+    char to_send[MAXLEN] = {0};
+    to_send[0] = COMMAND_GET_ACCOUNTING;
+    to_send[1] = (char) (HAS_DATA | FRAMED);
+    strcat(to_send, "user=");
+    strcat(to_send, user);
+    to_send[len-1] = '\n';
+    send(fd, to_send, len, 0);
+
+    return parse_framed_message(fd);
+}
+
+static int send_all(int fd, const char * buf, size_t len) {
+    while(len > 0) {
+        ssize_t n = send(fd, buf, len, 0);
+        if(n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static const char * batch_error(char code) {
+    switch(code) {
+        case '3':
+            return "invalid format";
+        case '4':
+            return "user does not exist";
+        case '5':
+            return "user already exists";
+        case '6':
+            return "user limit reached";
+        default:
+            return "unexpected server error";
+    }
+}
+
+/* Lee el proximo frame en `buf'. Retorna su largo, o -1 si se corto la conexion */
+static int recv_frame(int fd, char * buf) {
+    uint8_t len_buf[2];
+    if(recv_all(fd, len_buf, 2) <= 0)
+        return -1;
+    size_t len = (len_buf[0] << 8) | len_buf[1];
+    if(len > 0 && recv_all(fd, (uint8_t *)buf, len) <= 0)
+        return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+/* Pasa una linea del archivo ("adduser u p", "deleteuser u" o
+   "editpass u p") a un comando del protocolo. Retorna su largo o 0 si no
+   es valida */
+static size_t batch_item(char * line, char * out) {
+    char * name = strtok(line, " \r\n");
+    char * arg = strtok(NULL, " \r\n");
+    char * arg2 = strtok(NULL, " \r\n");
+    if(name == NULL || arg == NULL || strtok(NULL, " \r\n") != NULL)
+        return 0;
+
+    if(strcmp(name, "deleteuser") == 0 && arg2 == NULL)
+        return sprintf(out, "%c%c%s\n", COMMAND_DELETE_USER, HAS_DATA, arg);
+    if(arg2 == NULL || strlen(arg) + strlen(arg2) + 2 > BATCH_ITEM_DATA)
+        return 0;
+    if(strcmp(name, "adduser") == 0)
+        return sprintf(out, "%c%c%s:%s\n", COMMAND_ADD_USER, HAS_DATA, arg, arg2);
+    if(strcmp(name, "editpass") == 0)
+        return sprintf(out, "%c%c%s:%s\n", COMMAND_EDIT_PASSWORD, HAS_DATA, arg, arg2);
+    return 0;
+}
+
+/* Aplica las altas, bajas y cambios de contrasenia de un archivo en un solo
+   lote. Se envian de a BATCH_WINDOW items y se leen sus respuestas antes de
+   seguir, asi ninguno de los dos lados se bloquea esperando al otro */
+char batch(char * path, int fd) {
+    FILE * file = fopen(path, "r");
+    if(file == NULL) {
+        printf("Error: cannot open %s\n", path);
+        return 'e';
+    }
+
+    size_t count = 0, capacity = 0;
+    char ** items = NULL;
+    int * lines = NULL;
+    char line[MAXLEN], item[MAXLEN];
+    int line_n = 0;
+    while(fgets(line, MAXLEN, file) != NULL) {
+        line_n++;
+        if(strspn(line, " \r\n") == strlen(line))
+            continue;
+        size_t len = batch_item(line, item);
+        if(len == 0) {
+            printf("line %d: invalid item, skipped\n", line_n);
+            continue;
+        }
+        if(count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            items = realloc(items, capacity * sizeof(*items));
+            lines = realloc(lines, capacity * sizeof(*lines));
+            if(items == NULL || lines == NULL) {
+                fclose(file);
+                return 'x';
+            }
+        }
+        items[count] = malloc(len + 1);
+        if(items[count] == NULL) {
+            fclose(file);
+            return 'x';
+        }
+        memcpy(items[count], item, len + 1);
+        lines[count++] = line_n;
+    }
+    fclose(file);
+
+    char ret = 'i';
+    char frame[0xFFFF + 1];
+    char header[32];
+    int header_len = sprintf(header, "%c%c%lu\n", COMMAND_BATCH, HAS_DATA, (unsigned long)count);
+    uint8_t status;
+    if(send_all(fd, header, header_len) < 0 || recv_all(fd, &status, 1) <= 0 ||
+       recv_frame(fd, frame) < 0) {
+        ret = 'x';
+        goto finally;
+    }
+    if(status == FAILURE) {
+        ret = frame[0];
+        recv_frame(fd, frame);
+        goto finally;
+    }
+
+    size_t failed = 0;
+    char buf[BATCH_WINDOW * (BATCH_ITEM_DATA + 3)];
+    for(size_t sent = 0; sent < count; ) {
+        size_t window = count - sent < BATCH_WINDOW ? count - sent : BATCH_WINDOW;
+        size_t len = 0;
+        for(size_t i = 0; i < window; i++) {
+            size_t item_len = strlen(items[sent + i]);
+            memcpy(buf + len, items[sent + i], item_len);
+            len += item_len;
+        }
+        if(send_all(fd, buf, len) < 0) {
+            ret = 'x';
+            goto finally;
+        }
+        for(size_t i = 0; i < window; i++) {
+            /* Una fila "<status>;<error>" por item */
+            if(recv_frame(fd, frame) < 3) {
+                ret = 'x';
+                goto finally;
+            }
+            if(frame[0] == FAILURE) {
+                printf("line %d: %s\n", lines[sent + i], batch_error(frame[2]));
+                failed++;
+            }
+        }
+        sent += window;
+    }
+    if(count > 0 && recv_frame(fd, frame) != 0)
+        ret = 'x';
+    else
+        printf("%lu applied, %lu failed\n", (unsigned long)(count - failed), (unsigned long)failed);
+
+finally:
+    for(size_t i = 0; i < count; i++)
+        free(items[i]);
+    free(items);
+    free(lines);
+    return ret;
+}
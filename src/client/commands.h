@@ -24,11 +24,26 @@
 #define COMMAND_OBTAIN_METRICS '5'
 #define COMMAND_DISSECTOR_ON '6'
 #define COMMAND_DISSECTOR_OFF '7'
-#define COMMAND_CANT 9
+#define COMMAND_RELOAD_POLICY '8'
+#define COMMAND_GET_LATENCIES '9'
+#define COMMAND_GET_TOP ':'
+#define COMMAND_TRACE ';'
+#define COMMAND_DISSECTOR_PROTO '<'
+#define COMMAND_GET_CREDENTIALS '='
+#define COMMAND_BATCH '>'
+#define COMMAND_GET_CONFIG '?'
+#define COMMAND_SET_CONFIG '@'
+#define COMMAND_LIST_SESSIONS 'A'
+#define COMMAND_KILL_SESSION 'B'
+#define COMMAND_GET_ACCOUNTING 'C'
+#define COMMAND_CANT 21
 #define HAS_NOT_DATA 0
 #define HAS_DATA 1
+#define FRAMED 0x80         /* en HAS_DATA: pide la respuesta enmarcada */
 #define MAXLEN 1024
 #define TOKEN '\n'
+#define BATCH_WINDOW 256        /* items enviados antes de leer sus respuestas */
+#define BATCH_ITEM_DATA 255     /* como MAX_DATA_SIZE en el servidor */
 
 void help() ;
 int admin_auth(int fd, char * buf);
@@ -37,6 +52,15 @@ char double_arg_command(int command, char * username, char * pass, int fd);
 char list_users(int command, int fd);
 char obtain_metrics(int fd);
 char dissector(int on, int fd);
+char reload_policies(int fd);
+char obtain_latencies(int fd);
+char obtain_top(char * kind, char * count, int fd);
+char trace(char * arg, int fd);
+char obtain_credentials(char * from, char * count, int fd);
+char batch(char * path, int fd);
+char obtain_config(char * name, int fd);
+char obtain_sessions(char * filters, int fd);
+char obtain_accounting(char * user, int fd);
 
 
 #endif
@@ -0,0 +1,82 @@
+#include <stdbool.h>
+
+#include "include/clocks.h"
+
+#ifdef CLOCK_MONOTONIC_COARSE
+#define MONO_CLOCK CLOCK_MONOTONIC_COARSE
+#else
+#define MONO_CLOCK CLOCK_MONOTONIC
+#endif
+
+#ifdef CLOCK_REALTIME_COARSE
+#define WALL_CLOCK CLOCK_REALTIME_COARSE
+#else
+#define WALL_CLOCK CLOCK_REALTIME
+#endif
+
+static uint64_t mono_ns;
+static time_t wall_sec = -1;
+static char iso8601[CLOCKS_ISO8601_SIZE];
+static bool initialized = false;
+
+static uint64_t
+read_ns(clockid_t clock){
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void
+clocks_update(void){
+    mono_ns = read_ns(MONO_CLOCK);
+
+    struct timespec wall;
+    clock_gettime(WALL_CLOCK, &wall);
+    if(wall.tv_sec != wall_sec){
+        struct tm tp;
+        gmtime_r(&wall.tv_sec, &tp);
+        strftime(iso8601, sizeof(iso8601), "%Y-%m-%dT%H:%M:%SZ", &tp);
+        wall_sec = wall.tv_sec;
+    }
+    initialized = true;
+}
+
+/* Por si se consulta antes de la primera vuelta del selector */
+static inline void
+ensure_initialized(void){
+    if(!initialized)
+        clocks_update();
+}
+
+uint64_t
+clocks_mono_ns(void){
+    ensure_initialized();
+    return mono_ns;
+}
+
+uint64_t
+clocks_mono_usec(void){
+    return clocks_mono_ns() / 1000;
+}
+
+time_t
+clocks_wall_sec(void){
+    ensure_initialized();
+    return wall_sec;
+}
+
+const char *
+clocks_iso8601(void){
+    ensure_initialized();
+    return iso8601;
+}
+
+uint64_t
+clocks_coarse_mono_ns(void){
+    return read_ns(MONO_CLOCK);
+}
+
+uint64_t
+clocks_coarse_wall_ns(void){
+    return read_ns(WALL_CLOCK);
+}
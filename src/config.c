@@ -0,0 +1,73 @@
+#include <string.h>
+#include <sys/select.h>
+
+#include "include/config.h"
+#include "include/server.h"
+#include "logger/logger.h"
+
+struct config_entry {
+    const char * name;
+    long value;
+    long min;
+    long max;
+    /* Para los parametros que viven en otro modulo */
+    void (*apply)(long value);
+    long (*current)(void);
+};
+
+static void applyLogLevel(long value){ setLogLevel(value); }
+static long currentLogLevel(void){ return getLogLevel(); }
+
+static struct config_entry entries[CONFIG_COUNT] = {
+    [CONFIG_SOCKS_BUFFER]   = {"socks_buffer",   2048, 512, 1 << 20, NULL, NULL},
+    [CONFIG_MGMT_BUFFER]    = {"mgmt_buffer",    1024, 512, 1 << 16, NULL, NULL},
+    [CONFIG_LISTEN_BACKLOG] = {"listen_backlog", 50,   1,   65535,   server_set_backlog, NULL},
+    [CONFIG_SELECT_TIMEOUT] = {"select_timeout", 100,  1,   3600,    server_set_select_timeout, NULL},
+    [CONFIG_MAX_SESSIONS]   = {"max_sessions",   0,    0,   FD_SETSIZE, NULL, NULL},
+    [CONFIG_LOG_LEVEL]      = {"log_level",      LOG_LEVEL_NONE, LOG_LEVEL_DEBUG, LOG_LEVEL_NONE,
+                               applyLogLevel, currentLogLevel},
+    [CONFIG_USER_RATE]      = {"user_rate",      0,    0,   1 << 30, NULL, NULL},
+    [CONFIG_SESSION_RATE]   = {"session_rate",   0,    0,   1 << 30, NULL, NULL},
+    [CONFIG_MAX_IP_SESSIONS]   = {"max_ip_sessions",   0, 0, FD_SETSIZE, NULL, NULL},
+    [CONFIG_MAX_USER_SESSIONS] = {"max_user_sessions", 0, 0, FD_SETSIZE, NULL, NULL},
+    [CONFIG_AUTH_MAX_FAILURES] = {"auth_max_failures", 10, 0, 65535, NULL, NULL},
+    [CONFIG_IO_BUDGET]      = {"io_budget",      4096, 512, 1 << 24, NULL, NULL},
+    [CONFIG_INTERACTIVE_WEIGHT] = {"interactive_weight", 4, 1, 64, NULL, NULL},
+};
+
+long
+config_get(enum config_param param){
+    const struct config_entry * e = &entries[param];
+    return e->current != NULL ? e->current() : e->value;
+}
+
+const char *
+config_name(enum config_param param){ return entries[param].name; }
+
+long
+config_min(enum config_param param){ return entries[param].min; }
+
+long
+config_max(enum config_param param){ return entries[param].max; }
+
+enum config_param
+config_find(const char * name){
+    enum config_param i = 0;
+    for(; i < CONFIG_COUNT; i++)
+        if(strcmp(entries[i].name, name) == 0)
+            break;
+    return i;
+}
+
+enum config_result
+config_set(enum config_param param, long value){
+    if(param >= CONFIG_COUNT)
+        return CONFIG_UNKNOWN;
+    struct config_entry * e = &entries[param];
+    if(value < e->min || value > e->max)
+        return CONFIG_OUT_OF_RANGE;
+    e->value = value;
+    if(e->apply != NULL)
+        e->apply(value);
+    return CONFIG_OK;
+}
@@ -9,6 +9,11 @@ static bool validatePassword(cpAuthParser * authParser);
 static unsigned cpError(struct selector_key * key);
 static controlProtStmState executeRead(struct selector_key * key);
 static controlProtStmState executeWrite(struct selector_key * key);
+static controlProtStmState executeFramedWrite(struct selector_key * key);
+static controlProtStmState writeAnswer(struct selector_key * key);
+static cpCommandParserState parseCommand(controlProtConn * cpc);
+static char * runCommand(cpCommandParser * parser);
+static void openCommandCursor(cpCommandParser * parser, cpCursor * cursor);
 
 static const struct state_definition controlProtStateDef[] = {
     {
@@ -37,6 +42,35 @@ static const struct state_definition controlProtStateDef[] = {
 
 static cpConnList * connList;
 
+/* Comandos indexados por codigo. Para agregar uno alcanza con sumar su fila */
+typedef struct cpCommand {
+    char * (*run)(cpCommandParser * parser);
+    /* Respuesta enmarcada fila por fila. Si es NULL se enmarca la de run */
+    void (*openCursor)(cpCommandParser * parser, cpCursor * cursor);
+} cpCommand;
+
+static const cpCommand commands[CP_COMMAND_END - CP_ADD_USER] = {
+    [CP_ADD_USER - CP_ADD_USER]         = {addProxyUser, NULL},
+    [CP_REM_USER - CP_ADD_USER]         = {removeProxyUser, NULL},
+    [CP_CHANGE_PASS - CP_ADD_USER]      = {changePassword, NULL},
+    [CP_LIST_USERS - CP_ADD_USER]       = {getSocksUsers, openSocksUsersCursor},
+    [CP_GET_METRICS - CP_ADD_USER]      = {getMetrics, openMetricsCursor},
+    [CP_DISSECTOR_ON - CP_ADD_USER]     = {turnOnPassDissectors, NULL},
+    [CP_DISSECTOR_OFF - CP_ADD_USER]    = {turnOffPassDissectors, NULL},
+    [CP_RELOAD_POLICY - CP_ADD_USER]    = {reloadPolicies, NULL},
+    [CP_GET_LATENCIES - CP_ADD_USER]    = {getLatencies, openLatenciesCursor},
+    [CP_GET_TOP - CP_ADD_USER]          = {getTop, NULL},
+    [CP_TRACE - CP_ADD_USER]            = {trace, NULL},
+    [CP_DISSECTOR_PROTO - CP_ADD_USER]  = {switchProtocolDissector, NULL},
+    [CP_GET_CREDENTIALS - CP_ADD_USER]  = {getCredentials, openCredentialsCursor},
+    /* CP_BATCH lo maneja writeAnswer */
+    [CP_GET_CONFIG - CP_ADD_USER]       = {getConfig, NULL},
+    [CP_SET_CONFIG - CP_ADD_USER]       = {setConfig, NULL},
+    [CP_LIST_SESSIONS - CP_ADD_USER]    = {getSessions, openSessionsCursor},
+    [CP_KILL_SESSION - CP_ADD_USER]     = {killSession, NULL},
+    [CP_GET_ACCOUNTING - CP_ADD_USER]   = {getAccounting, openAccountingCursor},
+};
+
 static bool validatePassword(cpAuthParser * authParser){
     return strcmp(ADMIN_PASSWORD, authParser->inputPassword) == 0 ? true : false;
 }
@@ -131,11 +165,18 @@ controlProtConn * newControlProtConn(int fd, fd_selector s){
         new->writeBuffer = malloc(sizeof(buffer));
         if(new->writeBuffer == NULL)
             return NULL;
+
+        /* El tamanio se lee en cada conexion: un cambio aplica a las nuevas */
+        const size_t bufferSize = config_get(CONFIG_MGMT_BUFFER);
+        new->readBufferData = malloc(bufferSize);
+        new->writeBufferData = malloc(bufferSize);
+        if(new->readBufferData == NULL || new->writeBufferData == NULL)
+            return NULL;
         
         initCpAuthParser(&new->authParser);
         initCpCommandParser(&new->commandParser);
-        buffer_init(new->readBuffer, BUFFER_SIZE, new->readBufferData);
-        buffer_init(new->writeBuffer, BUFFER_SIZE, new->writeBufferData);
+        buffer_init(new->readBuffer, bufferSize, new->readBufferData);
+        buffer_init(new->writeBuffer, bufferSize, new->writeBufferData);
         
         new->fd = fd;
         new->s = s;
@@ -146,6 +187,8 @@ controlProtConn * newControlProtConn(int fd, fd_selector s){
         new->authAnsWritten = false;
         new->execAnsWritten = false;
         new->execAnswer = NULL;
+        new->streaming = false;
+        new->batchItems = 0;
 
         addToList(new);
     }
@@ -160,7 +203,11 @@ void freeControlProtConn(controlProtConn * cpc, fd_selector s){
 
     free(cpc->readBuffer);
     free(cpc->writeBuffer);
-    //free(cpc->execAnswer);
+    free(cpc->readBufferData);
+    free(cpc->writeBufferData);
+    free(cpc->execAnswer);
+    if(cpc->streaming)
+        closeCursor(&cpc->cursor);
     selector_unregister_fd(s, cpc->fd, false);
     close(cpc->fd);
     free(cpc);
@@ -405,11 +452,31 @@ static controlProtStmState authWrite(struct selector_key * key){
     return CP_AUTH;
 }
 
+/* Consume el buffer de lectura hasta completar un comando. Lo que sigue
+    queda en el buffer para el proximo */
+static cpCommandParserState parseCommand(controlProtConn * cpc){
+    cpCommandParser * parser = &cpc->commandParser;
+
+    while(parser->currentState != CPCP_DONE && buffer_can_read(cpc->readBuffer)){
+        parser->currentState = cpcpParseByte(parser, buffer_read(cpc->readBuffer));
+
+        if(parser->currentState == CPCP_ERROR){
+            LogError("[EXECUTE/parseCommand] CPCP_ERROR parsing input\n");
+            return CPCP_ERROR;
+        }
+    }
+
+    /* Cerramos el string con un '\0' */
+    if(parser->currentState == CPCP_DONE)
+        parser->data[parser->dataSize] = '\0';
+
+    return parser->currentState;
+}
+
 /* Leemos el comando enviado por el cliente */
 static controlProtStmState executeRead(struct selector_key * key){
     LogError("[EXECUTE] executeRead\n");
     controlProtConn * cpc = (controlProtConn *) key->data;
-    cpCommandParser * parser =  &cpc->commandParser;
 
     /* Si ya escribi la respuesta y se la envie al cliente, puedo 
         pasar al siguiente estado */
@@ -418,24 +485,13 @@ static controlProtStmState executeRead(struct selector_key * key){
         return CP_AUTH;
     }
 
-    size_t bytesLeft;
-    /* Voy a leer byte a byte, no necesito el puntero */
-    buffer_read_ptr(cpc->readBuffer, &bytesLeft);
-    
-    for(size_t i = 0; i < bytesLeft && parser->currentState != CPCP_DONE; i++){
-        parser->currentState = cpcpParseByte(parser, buffer_read(cpc->readBuffer));
-        
-        if(parser->currentState == CPCP_ERROR){
-            LogError("[EXECUTE/executeRead] CPCP_ERROR parsing input\n");
-            return CP_ERROR;
-        }
-    }
+    cpCommandParserState state = parseCommand(cpc);
+    if(state == CPCP_ERROR)
+        return CP_ERROR;
     
     /* Cuando termine de leer el comando, cambio el interes a escritura para 
         responderle al cliente */
-    if(parser->currentState == CPCP_DONE){
-        /* Cerramos el string con un '\0' */
-        parser->data[parser->dataSize] = '\0';
+    if(state == CPCP_DONE){
         cpc->interests = OP_WRITE;
         selector_set_interest_key(key, cpc->interests);
     }
@@ -449,22 +505,42 @@ static controlProtStmState executeWrite(struct selector_key * key){
     controlProtConn * cpc = (controlProtConn *) key->data;
     cpCommandParser * parser =  &cpc->commandParser;
 
-    /* Si ya escribi la respuesta y se la envie al cliente, puedo 
-        pasar a leer el siguiente comando */
-    if(cpc->execAnsWritten && !buffer_can_read(cpc->writeBuffer)){
-        cpc->execAnsWritten = false;
-        cpc->interests = OP_READ;
-        selector_set_interest_key(key, cpc->interests);
-        free(cpc->execAnswer);
-        cpc->execAnswer = NULL;
-        return CP_EXECUTE;
-    }
+    while(true){
+        if(cpc->execAnsWritten){
+            /* Pipelining: si el cliente ya envio el proximo comando lo
+                respondemos sin esperar a que TCP envie la respuesta anterior.
+                Las respuestas quedan en orden en el buffer de escritura */
+            cpCommandParserState state = parseCommand(cpc);
+            if(state == CPCP_ERROR)
+                return CP_ERROR;
+            if(state == CPCP_DONE){
+                cpc->execAnsWritten = false;
+                continue;
+            }
+
+            /* Si ya se envio todo, pasamos a leer el siguiente comando */
+            if(!buffer_can_read(cpc->writeBuffer)){
+                cpc->execAnsWritten = false;
+                cpc->interests = OP_READ;
+                selector_set_interest_key(key, cpc->interests);
+            }
+            return CP_EXECUTE;
+        }
 
-    /* Si ya escribi la respuesta, no queda nada por hacer 
-        hasta que TCP la haya enviado */
-    if(cpc->execAnsWritten){
-        return CP_EXECUTE;
+        /* Los lotes responden siempre en frames, armados por writeAnswer */
+        bool framed = parser->framed && cpc->batchItems == 0 && parser->code != CP_BATCH;
+        controlProtStmState state = framed ? executeFramedWrite(key) : writeAnswer(key);
+
+        /* Sin lugar para terminar la respuesta: seguimos cuando TCP envie */
+        if(state != CP_EXECUTE || !cpc->execAnsWritten)
+            return state;
     }
+}
+
+/* Respuesta sin enmarcar, o un item de un lote (que ya viene enmarcado) */
+static controlProtStmState writeAnswer(struct selector_key * key){
+    controlProtConn * cpc = (controlProtConn *) key->data;
+    cpCommandParser * parser =  &cpc->commandParser;
 
     /* Solo generamos la respuesta una vez por cada comando */
 
@@ -485,57 +561,125 @@ static controlProtStmState executeWrite(struct selector_key * key){
      * 
     **/
     if(cpc->execAnswer == NULL){
-        // TODO: Cambiar por array de punteros a funcion (Para la proxima ;) )
-        switch (parser->code){
-            case CP_ADD_USER:
-                cpc->execAnswer = addProxyUser(parser);
-                break;
-            case CP_REM_USER:
-                cpc->execAnswer = removeProxyUser(parser); 
-                break;
-            case CP_CHANGE_PASS:
-                cpc->execAnswer = changePassword(parser);
-                break;
-            case CP_LIST_USERS:
-                cpc->execAnswer = getSocksUsers(parser);
-                break;
-            case CP_GET_METRICS:
-                cpc->execAnswer = getMetrics(parser);
-                break;
-            case CP_DISSECTOR_ON:
-                cpc->execAnswer = turnOnPassDissectors(parser);
-                break;
-            case CP_DISSECTOR_OFF:
-                cpc->execAnswer = turnOffPassDissectors(parser);
-                break;
-            default:
-                break;
+        if(cpc->batchItems > 0){
+            cpc->batchItems--;
+            cpc->execAnswer = runBatchItem(parser, cpc->batchItems == 0, &cpc->execAnswerLen);
+        } else if(parser->code == CP_BATCH){
+            cpc->execAnswer = openBatch(parser, &cpc->batchItems, &cpc->execAnswerLen);
+        } else {
+            cpc->execAnswer = runCommand(parser);
+            if(cpc->execAnswer != NULL)
+                cpc->execAnswerLen = strlen(cpc->execAnswer);
         }
 
         /* Error en malloc */
         if(cpc->execAnswer == NULL){
-            LogError("[EXECUTE/executeWrite] answer == NULL\n");
+            LogError("[EXECUTE/writeAnswer] answer == NULL\n");
             return CP_ERROR;
         }
+        cpc->execAnswerSent = 0;
     }
 
     size_t maxWrite;
     uint8_t * writePtr = buffer_write_ptr(cpc->writeBuffer, &maxWrite);
 
-    /* Espacio insuficiente en el buffer de escritura para la respuesta. 
-        Nos mantenemos en este estado mientras se libera espacio */
-
-    
-    size_t ansSize = strlen(cpc->execAnswer);
-    if(ansSize > maxWrite){
-        return CP_EXECUTE;
-    }
+    /* Copiamos lo que entre en el buffer de escritura. Si la respuesta es
+        mas grande, nos mantenemos en este estado mientras se libera espacio */
+    size_t ansSize = cpc->execAnswerLen - cpc->execAnswerSent;
+    if(ansSize > maxWrite)
+        ansSize = maxWrite;
 
-    memcpy(writePtr, cpc->execAnswer, ansSize);
+    memcpy(writePtr, cpc->execAnswer + cpc->execAnswerSent, ansSize);
     buffer_write_adv(cpc->writeBuffer, ansSize);
+    cpc->execAnswerSent += ansSize;
+    if(cpc->execAnswerSent < cpc->execAnswerLen)
+        return CP_EXECUTE;
 
+    free(cpc->execAnswer);
+    cpc->execAnswer = NULL;
     cpc->execAnsWritten = true;
     initCpCommandParser(&cpc->commandParser);
     return CP_EXECUTE;
 }
 
+/* Respuesta enmarcada (ver cpCursor.h). Se genera a medida que se libera
+    lugar en el buffer de escritura: cada llamada agrega frames con todos los
+    pedazos que entren */
+static controlProtStmState executeFramedWrite(struct selector_key * key){
+    controlProtConn * cpc = (controlProtConn *) key->data;
+    cpCursor * cursor = &cpc->cursor;
+
+    if(!cpc->streaming){
+        openCommandCursor(&cpc->commandParser, cursor);
+        cpc->streaming = true;
+        cpc->statusWritten = false;
+    }
+
+    size_t space;
+    uint8_t * ptr = buffer_write_ptr(cpc->writeBuffer, &space);
+
+    if(!cpc->statusWritten){
+        if(space == 0)
+            return CP_EXECUTE;
+        *ptr = cursor->status;
+        buffer_write_adv(cpc->writeBuffer, 1);
+        cpc->statusWritten = true;
+        ptr = buffer_write_ptr(cpc->writeBuffer, &space);
+    }
+
+    while(space >= CP_FRAME_HEADER){
+        size_t max = space - CP_FRAME_HEADER;
+        if(max > CP_FRAME_MAX)
+            max = CP_FRAME_MAX;
+
+        char * data = (char *) ptr + CP_FRAME_HEADER;
+        size_t len = 0;
+        int n = 1;
+        while(len < max && (n = cursor->next(cursor, data + len, max - len)) > 0)
+            len += n;
+
+        /* Sin mas datos: el frame vacio cierra la respuesta */
+        if(len == 0 && n == 0){
+            ptr[0] = ptr[1] = 0;
+            buffer_write_adv(cpc->writeBuffer, CP_FRAME_HEADER);
+            closeCursor(cursor);
+            cpc->streaming = false;
+            cpc->execAnsWritten = true;
+            initCpCommandParser(&cpc->commandParser);
+            return CP_EXECUTE;
+        }
+
+        if(len == 0){
+            /* Un pedazo que no entra ni con el buffer vacio no va a entrar nunca */
+            if(!buffer_can_read(cpc->writeBuffer)){
+                LogError("[EXECUTE/executeFramedWrite] piece larger than buffer\n");
+                return CP_ERROR;
+            }
+            break;
+        }
+
+        ptr[0] = (len >> 8) & 0xFF;
+        ptr[1] = len & 0xFF;
+        buffer_write_adv(cpc->writeBuffer, CP_FRAME_HEADER + len);
+        ptr = buffer_write_ptr(cpc->writeBuffer, &space);
+        if(n < 0)
+            break;
+    }
+
+    return CP_EXECUTE;
+}
+
+/* Las respuestas que pueden ser largas se enmarcan con un cursor; el resto
+    se arma completa y se envia en frames */
+static void openCommandCursor(cpCommandParser * parser, cpCursor * cursor){
+    const cpCommand * command = &commands[parser->code - CP_ADD_USER];
+    if(command->openCursor != NULL)
+        command->openCursor(parser, cursor);
+    else
+        openAnswerCursor(runCommand(parser), cursor);
+}
+
+static char * runCommand(cpCommandParser * parser){
+    const cpCommand * command = &commands[parser->code - CP_ADD_USER];
+    return command->run == NULL ? NULL : command->run(parser);
+}
@@ -2,13 +2,46 @@
 #include "../include/args.h"
 #include "../logger/logger.h"
 
-#define INITIAL_SOCKS_U_SIZE 512
 #define SOCKS_U_HEADER "Socks users: \n"
 
 static char * noDataStatusSuccessAnswer();
 static char * statusFailedAnswer(controlProtErrorCode errorCode);
 static char * switchPassDissectors(cpCommandParser * parser, bool value);
 
+/* Columnas del CSV de metricas, en orden. Para exportar un valor nuevo
+    alcanza con agregar una fila */
+typedef struct metricsColumn {
+    const char * title;
+    long (*value)();
+} metricsColumn;
+
+static long getAccessLogDrops(){ return metrics_get(METRIC_ACCESS_LOG_DROPS); }
+static long getThrottles(){ return metrics_get(METRIC_SHAPER_THROTTLES); }
+static long getLimitRejects(){ return metrics_get(METRIC_LIMIT_REJECTS); }
+static long getAuthThrottles(){ return metrics_get(METRIC_AUTH_THROTTLES); }
+static long getDomainRules(){ return (long) domain_acl_get_stats().entries; }
+static long getDomainMemory(){ return (long) domain_acl_get_stats().memory; }
+static long getDomainBuildTime(){ return domain_acl_get_stats().build_usec; }
+
+static const metricsColumn metricsColumns[] = {
+    {"curr_socks",          get_current_socks},
+    {"hist_socks",          get_historic_socks},
+    {"curr_control",        get_current_mgmt},
+    {"hist_control",        get_historic_mgmt},
+    {"curr_total",          get_current_total},
+    {"hist_total",          get_historic_total},
+    {"bytes_trnf",          get_bytes_transferred},
+    {"log_drops",           getAccessLogDrops},
+    {"throttled",           getThrottles},
+    {"limit_rejects",       getLimitRejects},
+    {"auth_throttled",      getAuthThrottles},
+    {"domain_rules",        getDomainRules},
+    {"domain_mem_bytes",    getDomainMemory},
+    {"domain_build_us",     getDomainBuildTime},
+};
+
+#define METRICS_COLUMNS (sizeof(metricsColumns) / sizeof(metricsColumns[0]))
+
 static char * noDataStatusSuccessAnswer(){
     char * ret = calloc(3, sizeof(char));
     if(ret != NULL){
@@ -21,7 +54,7 @@ static char * noDataStatusSuccessAnswer(){
 }
 
 static char * statusFailedAnswer(controlProtErrorCode errorCode){
-    char * ret = calloc(3, sizeof(char)); 
+    char * ret = calloc(5, sizeof(char)); 
 
     if(ret != NULL){
         ret[0] = STATUS_ERROR;
@@ -144,6 +177,24 @@ char * turnOffPassDissectors(cpCommandParser * parser){
     return switchPassDissectors(parser, false);
 }
 
+/* Recibe "<protocolo>:on" o "<protocolo>:off". Los protocolos son los de
+    DISSECTORS (pop3, imap, ftp, smtp, http) */
+char * switchProtocolDissector(cpCommandParser * parser){
+    if(parser->hasData == 0)
+        return statusFailedAnswer(CPERROR_COMMAND_NEEDS_DATA);
+
+    char * protocol = strtok(parser->data, TOKEN_DELIMITER);
+    char * value = strtok(NULL, LINE_DELIMITER);
+    if(protocol == NULL || value == NULL ||
+       (strcmp(value, "on") != 0 && strcmp(value, "off") != 0))
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    if(dissector_set_enabled(protocol, strcmp(value, "on") == 0) < 0)
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    return noDataStatusSuccessAnswer();
+}
+
 
 char * getMetrics(cpCommandParser * parser){
     char * ret;
@@ -153,16 +204,20 @@ char * getMetrics(cpCommandParser * parser){
         return ret;
     }
 
-    int titleLen = strlen(METRICS_CSV_TITLE);
-    ret = calloc(2*titleLen, sizeof(char));
+    ret = calloc(METRICS_ANSWER_SIZE, sizeof(char));
     if(ret == NULL)
         return NULL;
 
-    sprintf(ret, "%c%c%s%lu;%lu;%lu;%lu;%lu;%lu;%lu\n", STATUS_SUCCESS, 2,
-        METRICS_CSV_TITLE, get_current_socks(), get_historic_socks(), 
-        get_current_mgmt(), get_historic_mgmt(), get_current_total(),
-        get_historic_total(), get_bytes_transferred()
-    );
+    /* Dos filas: los titulos y los valores */
+    int len = sprintf(ret, "%c%c", STATUS_SUCCESS, 2);
+    for(size_t i = 0; i < METRICS_COLUMNS; i++){
+        len += snprintf(ret + len, METRICS_ANSWER_SIZE - len, "%s%c", metricsColumns[i].title,
+                        i + 1 == METRICS_COLUMNS ? '\n' : METRICS_CSV_SEPARATOR);
+    }
+    for(size_t i = 0; i < METRICS_COLUMNS; i++){
+        len += snprintf(ret + len, METRICS_ANSWER_SIZE - len, "%ld%c", metricsColumns[i].value(),
+                        i + 1 == METRICS_COLUMNS ? '\n' : METRICS_CSV_SEPARATOR);
+    }
 
     //*answer[strlen(*answer)] = '\n';
 
@@ -172,22 +227,812 @@ char * getMetrics(cpCommandParser * parser){
 char * 
 getSocksUsers(cpCommandParser * parser){
     user_t ** users = get_all_users();
-    uint8_t n_users = get_total_curr_users();
-    char * ret_str = malloc(INITIAL_SOCKS_U_SIZE);
-    memset(ret_str, 0x00, INITIAL_SOCKS_U_SIZE);
+    size_t n_users = get_total_curr_users();
 
-    ret_str[0] = '1'; 
-    ret_str[1] = (char)n_users + 1;
-    strcat(ret_str, SOCKS_U_HEADER);
+    /* La cantidad de filas ocupa un byte: sin frames se listan los primeros
+        UINT8_MAX - 1 usuarios */
+    if(n_users > UINT8_MAX - 1)
+        n_users = UINT8_MAX - 1;
 
-    for(int i = 0; i < n_users; i++){
-        strcat(ret_str, users[i]->name);
-        //strcat(ret_str, ";");
-        //strcat(ret_str, users[i]->pass);
-        strcat(ret_str, "\n");
-    }
+    size_t size = 2 + strlen(SOCKS_U_HEADER) + 1;
+    for(size_t i = 0; i < n_users; i++)
+        size += strlen(users[i]->name) + 1;
+
+    char * ret_str = malloc(size);
+    if(ret_str == NULL)
+        return NULL;
+
+    int len = sprintf(ret_str, "%c%c%s", STATUS_SUCCESS, (char) (n_users + 1), SOCKS_U_HEADER);
+    for(size_t i = 0; i < n_users; i++)
+        len += sprintf(ret_str + len, "%s\n", users[i]->name);
     return ret_str;
 }
 
+/* Vuelve a leer los archivos de politicas de acceso. Si alguno es invalido
+    se conservan las reglas anteriores */
+char * reloadPolicies(cpCommandParser * parser){
+    if(parser->hasData == 1)
+        return statusFailedAnswer(CPERROR_NO_DATA_COMMAND);
+
+    if(acl_reload() < 0 || domain_acl_reload() < 0)
+        return statusFailedAnswer(CPERROR_POLICY_ERROR);
+
+    return noDataStatusSuccessAnswer();
+}
+
+static int formatLatency(char * out, size_t size, int phase){
+    histogram * h = metrics_get_latency(phase);
+    return snprintf(out, size, "%s;%lu;%lu;%lu;%lu;%lu\n",
+                    metrics_latency_name(phase),
+                    (unsigned long) histogram_count(h),
+                    (unsigned long) histogram_percentile(h, 50),
+                    (unsigned long) histogram_percentile(h, 90),
+                    (unsigned long) histogram_percentile(h, 99),
+                    (unsigned long) histogram_percentile(h, 99.9));
+}
+
+/* Una fila por fase con los percentiles del histograma, en microsegundos */
+char * getLatencies(cpCommandParser * parser){
+    if(parser->hasData == 1)
+        return statusFailedAnswer(CPERROR_NO_DATA_COMMAND);
+
+    char * ret = calloc(METRICS_ANSWER_SIZE, sizeof(char));
+    if(ret == NULL)
+        return NULL;
+
+    int len = sprintf(ret, "%c%c%s", STATUS_SUCCESS, LATENCY_COUNT + 1, LATENCIES_HEADER);
+    for(int i = 0; i < LATENCY_COUNT; i++){
+        len += formatLatency(ret + len, METRICS_ANSWER_SIZE - len, i);
+    }
+
+    return ret;
+}
+
+/* Filas del ranking `measure' con las estimaciones de ambas medidas.
+    Retorna la cantidad de filas que entraron en `ret' */
+static int appendTopRows(char * ret, int * len, enum top_dimension dimension,
+                         enum top_measure measure, size_t n){
+    topk * rank = metrics_get_top(dimension, measure);
+    topk * conns = metrics_get_top(dimension, TOP_CONNECTIONS);
+    topk * bytes = metrics_get_top(dimension, TOP_BYTES);
+    topk_item items[n];
+    int rows = 0;
+
+    n = topk_list(rank, items, n);
+    for(size_t i = 0; i < n; i++){
+        int written = snprintf(ret + *len, BUFFER_SIZE - *len, "%s;%s;%lu;%lu\n",
+                               measure == TOP_CONNECTIONS ? "conns" : "bytes", items[i].key,
+                               (unsigned long) topk_estimate(conns, items[i].hash),
+                               (unsigned long) topk_estimate(bytes, items[i].hash));
+        /* Lo que no entra en el buffer de escritura se descarta */
+        if(written < 0 || *len + written >= BUFFER_SIZE){
+            ret[*len] = '\0';
+            break;
+        }
+        *len += written;
+        rows++;
+    }
+    return rows;
+}
+
+/* Recibe "dst" o "user", opcionalmente seguido de ":<N>". Responde los N
+    con mas conexiones y los N con mas bytes */
+char * getTop(cpCommandParser * parser){
+    if(parser->hasData == 0)
+        return statusFailedAnswer(CPERROR_COMMAND_NEEDS_DATA);
+
+    char * kind = strtok(parser->data, TOKEN_DELIMITER LINE_DELIMITER);
+    char * count = strtok(NULL, LINE_DELIMITER);
+
+    enum top_dimension dimension;
+    if(kind != NULL && strcmp(kind, "dst") == 0)
+        dimension = TOP_DESTINATIONS;
+    else if(kind != NULL && strcmp(kind, "user") == 0)
+        dimension = TOP_USERS;
+    else
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    long n = TOP_DEFAULT_N;
+    if(count != NULL){
+        char * end;
+        n = strtol(count, &end, 10);
+        if(end == count || *end != '\0' || n <= 0 || n > UINT8_MAX)
+            return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+    }
+
+    if(metrics_get_top(dimension, TOP_CONNECTIONS) == NULL)
+        return statusFailedAnswer(CPERROR_GENERAL_ERROR);
+
+    char * ret = calloc(BUFFER_SIZE, sizeof(char));
+    if(ret == NULL)
+        return NULL;
+
+    int len = sprintf(ret, "%c%c%s", STATUS_SUCCESS, 1, TOP_HEADER);
+    int rows = 1;
+    rows += appendTopRows(ret, &len, dimension, TOP_CONNECTIONS, n);
+    rows += appendTopRows(ret, &len, dimension, TOP_BYTES, n);
+    ret[1] = (char) rows;
+
+    return ret;
+}
+
+static int formatTraceEvent(char * out, size_t size, const struct trace_event * e){
+    return snprintf(out, size, "%lu;%s;%d;%lu;%lu;%lu\n",
+                    (unsigned long) (e->mono_ns / 1000), trace_point_name(e->point),
+                    (int) e->fd, (unsigned long) e->session,
+                    (unsigned long) e->a, (unsigned long) e->b);
+}
+
+/* "on" y "off" prenden y apagan los tracepoints; un numero N responde los
+    ultimos N eventos registrados, del mas viejo al mas nuevo */
+char * trace(cpCommandParser * parser){
+    if(parser->hasData == 0)
+        return statusFailedAnswer(CPERROR_COMMAND_NEEDS_DATA);
+
+    char * arg = strtok(parser->data, LINE_DELIMITER);
+    if(arg != NULL && (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0)){
+        if(trace_set_enabled(strcmp(arg, "on") == 0) < 0)
+            return statusFailedAnswer(CPERROR_GENERAL_ERROR);
+        return noDataStatusSuccessAnswer();
+    }
+
+    char * end;
+    long n = arg == NULL ? 0 : strtol(arg, &end, 10);
+    if(arg == NULL || end == arg || *end != '\0' || n <= 0 || n > UINT8_MAX)
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    char * ret = calloc(BUFFER_SIZE, sizeof(char));
+    if(ret == NULL)
+        return NULL;
+
+    struct trace_event events[UINT8_MAX];
+    size_t count = trace_last(events, n);
+
+    int len = sprintf(ret, "%c%c%s", STATUS_SUCCESS, 1, TRACE_HEADER);
+
+    /* Los eventos mas nuevos son los que importan: si no entran todos en el
+        buffer de escritura se descartan los mas viejos */
+    size_t first = count;
+    for(int budget = BUFFER_SIZE - len - 1; first > 0; first--){
+        budget -= formatTraceEvent(NULL, 0, &events[first - 1]);
+        if(budget < 0)
+            break;
+    }
+    for(size_t i = first; i < count; i++)
+        len += formatTraceEvent(ret + len, BUFFER_SIZE - len, &events[i]);
+    int rows = 1 + (int) (count - first);
+    ret[1] = (char) rows;
+
+    return ret;
+}
+
+/* Copia un campo de texto al CSV: ';' y los caracteres de control se
+    reemplazan por '?' y se trunca a CREDS_FIELD_SIZE */
+static const char * credsField(char * out, const char * in){
+    size_t i = 0;
+    for(; in[i] != '\0' && i < CREDS_FIELD_SIZE; i++)
+        out[i] = (in[i] == METRICS_CSV_SEPARATOR || (unsigned char) in[i] < ' ') ? '?' : in[i];
+    out[i] = '\0';
+    return out;
+}
+
+static int formatCredential(char * out, size_t size, const struct cred_entry * e){
+    char socksUser[CREDS_FIELD_SIZE + 1], destination[CREDS_FIELD_SIZE + 1];
+    char user[CREDS_FIELD_SIZE + 1], pass[CREDS_FIELD_SIZE + 1];
+    return snprintf(out, size, "%llu;%lld;%lld;%lu;%s;%s;%s;%d;%s;%u;%s;%s\n",
+                    (unsigned long long) e->id, (long long) e->first_seen,
+                    (long long) e->last_seen, (unsigned long) e->count,
+                    dissectors[e->protocol]->name,
+                    credsField(socksUser, e->origin.username), e->origin.client,
+                    e->origin.client_port, credsField(destination, e->origin.destination),
+                    (unsigned) e->origin.destination_port,
+                    credsField(user, e->user), credsField(pass, e->pass));
+}
+
+/* Lee "<id>" o "<id>:<N>". `n' trae el valor por defecto y N no puede pasar
+    de `max' */
+static bool parseCredentialsRange(cpCommandParser * parser, uint64_t * from, long * n, long max){
+    if(parser->hasData == 0)
+        return true;
+    char * id = strtok(parser->data, TOKEN_DELIMITER LINE_DELIMITER);
+    char * count = strtok(NULL, LINE_DELIMITER);
+    char * end;
+    if(id == NULL)
+        return false;
+    *from = strtoull(id, &end, 10);
+    if(end == id || *end != '\0')
+        return false;
+    if(count != NULL){
+        *n = strtol(count, &end, 10);
+        if(end == count || *end != '\0' || *n <= 0 || *n > max)
+            return false;
+    }
+    return true;
+}
+
+/* Sin datos responde desde la credencial mas vieja que se conserva; "<id>"
+    o "<id>:<N>" responde hasta N a partir de ese id. Las que no entran en el
+    buffer de escritura quedan para el proximo pedido, desde el ultimo id
+    recibido mas uno */
+char * getCredentials(cpCommandParser * parser){
+    uint64_t from = 0;
+    long n = CREDS_DEFAULT_N;
+    if(!parseCredentialsRange(parser, &from, &n, UINT8_MAX))
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    char * ret = calloc(BUFFER_SIZE, sizeof(char));
+    if(ret == NULL)
+        return NULL;
+
+    const struct cred_entry * found[UINT8_MAX];
+    size_t count = cred_store_list(from, found, n);
+
+    int len = sprintf(ret, "%c%c%s", STATUS_SUCCESS, 1, CREDS_HEADER);
+    int rows = 1;
+    for(size_t i = 0; i < count; i++){
+        int written = formatCredential(ret + len, BUFFER_SIZE - len, found[i]);
+        if(written < 0 || len + written >= BUFFER_SIZE){
+            ret[len] = '\0';
+            break;
+        }
+        len += written;
+        rows++;
+    }
+    ret[1] = (char) rows;
+
+    return ret;
+}
+
+/* Sin datos responde todos los parametros configurables; "<nombre>" solo
+    ese */
+char * getConfig(cpCommandParser * parser){
+    enum config_param first = 0, last = CONFIG_COUNT;
+    if(parser->hasData == 1){
+        char * name = strtok(parser->data, LINE_DELIMITER);
+        first = name == NULL ? CONFIG_COUNT : config_find(name);
+        if(first == CONFIG_COUNT)
+            return statusFailedAnswer(CPERROR_INVALID_VALUE);
+        last = first + 1;
+    }
+
+    char * ret = calloc(BUFFER_SIZE, sizeof(char));
+    if(ret == NULL)
+        return NULL;
+
+    int len = sprintf(ret, "%c%c%s", STATUS_SUCCESS, 1 + (last - first), CONFIG_HEADER);
+    for(enum config_param i = first; i < last; i++)
+        len += snprintf(ret + len, BUFFER_SIZE - len, "%s;%ld;%ld;%ld\n", config_name(i),
+                        config_get(i), config_min(i), config_max(i));
+
+    return ret;
+}
+
+/* Recibe "<nombre>:<valor>". Aplica a las sesiones que se creen despues */
+char * setConfig(cpCommandParser * parser){
+    if(parser->hasData == 0)
+        return statusFailedAnswer(CPERROR_COMMAND_NEEDS_DATA);
+
+    char * name = strtok(parser->data, TOKEN_DELIMITER);
+    char * value = strtok(NULL, LINE_DELIMITER);
+    if(name == NULL || value == NULL)
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    char * end;
+    long n = strtol(value, &end, 10);
+    if(end == value || *end != '\0')
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    if(config_set(config_find(name), n) != CONFIG_OK)
+        return statusFailedAnswer(CPERROR_INVALID_VALUE);
+
+    LogInfo("Config: %s = %ld", name, n);
+    return noDataStatusSuccessAnswer();
+}
+
+/* ============================ Sesiones ============================ */
+
+/* Filtros de la lista de sesiones: un campo vacio acepta cualquier valor */
+typedef struct sessionFilter {
+    char user[SNIFF_NAME_SIZE];
+    char client[INET6_ADDRSTRLEN];
+    char destination[SNIFF_NAME_SIZE];  /* parte del destino */
+    char state[SNIFF_NAME_SIZE];
+} sessionFilter;
+
+static bool copyFilterValue(char * out, size_t size, const char * value){
+    int len = snprintf(out, size, "%s", value);
+    return len > 0 && (size_t) len < size;
+}
+
+/* Lee "<clave>=<valor>" separados por ';'. Las claves son from (primer id),
+    n (cantidad, hasta `max'), user, client, dst y state */
+static bool parseSessionsQuery(cpCommandParser * parser, uint64_t * from, long * n, long max,
+                               sessionFilter * filter){
+    memset(filter, 0, sizeof(*filter));
+    if(parser->hasData == 0)
+        return true;
+    for(char * token = strtok(parser->data, ";" LINE_DELIMITER); token != NULL;
+        token = strtok(NULL, ";" LINE_DELIMITER)){
+        char * value = strchr(token, '=');
+        if(value == NULL)
+            return false;
+        *value++ = '\0';
+        char * end;
+        if(strcmp(token, "from") == 0){
+            *from = strtoull(value, &end, 10);
+            if(end == value || *end != '\0')
+                return false;
+        } else if(strcmp(token, "n") == 0){
+            *n = strtol(value, &end, 10);
+            if(end == value || *end != '\0' || *n <= 0 || *n > max)
+                return false;
+        } else if(strcmp(token, "user") == 0){
+            if(!copyFilterValue(filter->user, sizeof(filter->user), value))
+                return false;
+        } else if(strcmp(token, "client") == 0){
+            if(!copyFilterValue(filter->client, sizeof(filter->client), value))
+                return false;
+        } else if(strcmp(token, "dst") == 0){
+            if(!copyFilterValue(filter->destination, sizeof(filter->destination), value))
+                return false;
+        } else if(strcmp(token, "state") == 0){
+            if(!copyFilterValue(filter->state, sizeof(filter->state), value))
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool sessionMatches(const sessionFilter * filter, const struct session_info * info){
+    return (filter->user[0] == '\0' || strcmp(filter->user, info->origin.username) == 0)
+        && (filter->client[0] == '\0' || strcmp(filter->client, info->origin.client) == 0)
+        && (filter->destination[0] == '\0' || strstr(info->origin.destination, filter->destination) != NULL)
+        && (filter->state[0] == '\0' || strcmp(filter->state, info->state) == 0);
+}
+
+static int formatSession(char * out, size_t size, const struct session_info * info){
+    char user[CREDS_FIELD_SIZE + 1], destination[CREDS_FIELD_SIZE + 1], port[6] = "";
+    if(info->origin.destination[0] != '\0')
+        snprintf(port, sizeof(port), "%u", (unsigned) info->origin.destination_port);
+    return snprintf(out, size, "%llu;%s;%d;%s;%s;%s;%s;%llu;%llu;%lld;%lld\n",
+                    (unsigned long long) info->id, info->origin.client, info->origin.client_port,
+                    credsField(user, info->origin.username),
+                    credsField(destination, info->origin.destination), port, info->state,
+                    (unsigned long long) info->bytes_up, (unsigned long long) info->bytes_down,
+                    (long long) info->started, (long long) info->last_activity);
+}
+
+/* Las sesiones activas por id creciente, filtradas (ver parseSessionsQuery).
+    Las que no entran en el buffer quedan para el proximo pedido, desde el
+    ultimo id recibido mas uno */
+char * getSessions(cpCommandParser * parser){
+    uint64_t from = 0;
+    long n = SESSIONS_DEFAULT_N;
+    sessionFilter filter;
+    if(!parseSessionsQuery(parser, &from, &n, UINT8_MAX - 1, &filter))
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    char * ret = calloc(BUFFER_SIZE, sizeof(char));
+    if(ret == NULL)
+        return NULL;
+
+    int len = sprintf(ret, "%c%c%s", STATUS_SUCCESS, 1, SESSIONS_HEADER);
+    int rows = 1;
+    struct session_info info;
+    for(struct socks_conn_model * socks = sessions_next(from); socks != NULL && rows <= n;
+        socks = sessions_next(info.id + 1)){
+        sessions_info(socks, &info);
+        if(!sessionMatches(&filter, &info))
+            continue;
+        int written = formatSession(ret + len, BUFFER_SIZE - len, &info);
+        if(written < 0 || len + written >= BUFFER_SIZE){
+            ret[len] = '\0';
+            break;
+        }
+        len += written;
+        rows++;
+    }
+    ret[1] = (char) rows;
+
+    return ret;
+}
+
+/* Recibe "<id>" */
+char * killSession(cpCommandParser * parser){
+    if(parser->hasData == 0)
+        return statusFailedAnswer(CPERROR_COMMAND_NEEDS_DATA);
+
+    char * id = strtok(parser->data, LINE_DELIMITER);
+    char * end;
+    if(id == NULL)
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+    uint64_t n = strtoull(id, &end, 10);
+    if(end == id || *end != '\0')
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    if(!sessions_kill(n))
+        return statusFailedAnswer(CPERROR_INEXISTING_SESSION);
+
+    LogInfo("Session %llu terminated", (unsigned long long) n);
+    return noDataStatusSuccessAnswer();
+}
+
+/* ============================ Contabilidad ============================ */
+
+static int formatAccounting(char * out, size_t size, uint32_t handle){
+    const struct accounting_record * r = accounting_get(handle);
+    char user[CREDS_FIELD_SIZE + 1];
+    return snprintf(out, size, "%lu;%s;%llu;%llu;%llu;%llu;%lld;%lld\n", (unsigned long) handle,
+                    credsField(user, r->user), (unsigned long long) r->connections,
+                    (unsigned long long) r->bytes_up, (unsigned long long) r->bytes_down,
+                    (unsigned long long) r->duration_ms, (long long) r->first_seen,
+                    (long long) r->last_seen);
+}
+
+/* Lee "<clave>=<valor>" separados por ';': from (primer handle), n
+    (cantidad, hasta `max') o user (solo ese usuario) */
+static bool parseAccountingQuery(cpCommandParser * parser, uint64_t * from, long * n, long max){
+    if(parser->hasData == 0)
+        return true;
+    for(char * token = strtok(parser->data, ";" LINE_DELIMITER); token != NULL;
+        token = strtok(NULL, ";" LINE_DELIMITER)){
+        char * value = strchr(token, '=');
+        if(value == NULL)
+            return false;
+        *value++ = '\0';
+        char * end;
+        if(strcmp(token, "from") == 0){
+            *from = strtoull(value, &end, 10);
+            if(end == value || *end != '\0')
+                return false;
+        } else if(strcmp(token, "n") == 0){
+            *n = strtol(value, &end, 10);
+            if(end == value || *end != '\0' || *n <= 0 || *n > max)
+                return false;
+        } else if(strcmp(token, "user") == 0){
+            /* Un usuario sin registro no responde filas */
+            uint32_t handle = accounting_find(value);
+            *from = handle == ACCOUNTING_NO_HANDLE ? UINT64_MAX : handle;
+            *n = 1;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Los registros por handle creciente. Los que no entran en el buffer
+    quedan para el proximo pedido, desde el ultimo handle recibido mas uno */
+char * getAccounting(cpCommandParser * parser){
+    uint64_t from = 0;
+    long n = ACCOUNTING_DEFAULT_N;
+    if(!parseAccountingQuery(parser, &from, &n, UINT8_MAX - 1))
+        return statusFailedAnswer(CPERROR_INVALID_FORMAT);
+
+    char * ret = calloc(BUFFER_SIZE, sizeof(char));
+    if(ret == NULL)
+        return NULL;
+
+    int len = sprintf(ret, "%c%c%s", STATUS_SUCCESS, 1, ACCOUNTING_HEADER);
+    int rows = 1;
+    for(uint64_t handle = from; handle < accounting_count() && rows <= n; handle++){
+        int written = formatAccounting(ret + len, BUFFER_SIZE - len, handle);
+        if(written < 0 || len + written >= BUFFER_SIZE){
+            ret[len] = '\0';
+            break;
+        }
+        len += written;
+        rows++;
+    }
+    ret[1] = (char) rows;
+
+    return ret;
+}
+
+/* ============================ Lotes ============================ */
+
+/* Arma una respuesta ya enmarcada: el STATUS (si no es NULL), un frame con
+    `data' y, si es la ultima, el frame vacio que la cierra */
+static char * framedAnswer(const char * status, const char * data, size_t dataLen,
+                           bool last, size_t * len){
+    char * ret = malloc(1 + 2 * CP_FRAME_HEADER + dataLen);
+    if(ret == NULL)
+        return NULL;
+
+    size_t n = 0;
+    if(status != NULL)
+        ret[n++] = *status;
+    if(dataLen > 0){
+        ret[n++] = (dataLen >> 8) & 0xFF;
+        ret[n++] = dataLen & 0xFF;
+        memcpy(ret + n, data, dataLen);
+        n += dataLen;
+    }
+    if(last){
+        ret[n++] = 0;
+        ret[n++] = 0;
+    }
+    *len = n;
+    return ret;
+}
+
+/* Recibe "<N>": los N comandos que siguen son los items del lote. La
+    respuesta va siempre enmarcada: el STATUS y el encabezado ahora, y una
+    fila por item a medida que se aplican */
+char * openBatch(cpCommandParser * parser, uint32_t * items, size_t * len){
+    const char status = STATUS_SUCCESS, failed = STATUS_ERROR;
+    char * count = parser->hasData == 1 ? strtok(parser->data, LINE_DELIMITER) : NULL;
+    char * end;
+    long n = count == NULL ? -1 : strtol(count, &end, 10);
+
+    if(count == NULL || end == count || *end != '\0' || n < 0 || n > BATCH_MAX_ITEMS){
+        char error = parser->hasData == 1 ? CPERROR_INVALID_FORMAT : CPERROR_COMMAND_NEEDS_DATA;
+        return framedAnswer(&failed, &error, 1, true, len);
+    }
+
+    *items = n;
+    return framedAnswer(&status, BATCH_HEADER, strlen(BATCH_HEADER), n == 0, len);
+}
+
+/* Aplica un item del lote: solo se aceptan altas, bajas y cambios de
+    contrasenia. Responde su fila "<status>;<error>" en un frame */
+char * runBatchItem(cpCommandParser * parser, bool last, size_t * len){
+    char * answer;
+    switch(parser->code){
+        case CP_ADD_USER:
+            answer = addProxyUser(parser);
+            break;
+        case CP_REM_USER:
+            answer = removeProxyUser(parser);
+            break;
+        case CP_CHANGE_PASS:
+            answer = changePassword(parser);
+            break;
+        default:
+            answer = statusFailedAnswer(CPERROR_INVALID_FORMAT);
+            break;
+    }
+    if(answer == NULL)
+        return NULL;
 
+    char row[5];
+    int rowLen = answer[0] == STATUS_SUCCESS
+               ? sprintf(row, "%c;\n", STATUS_SUCCESS)
+               : sprintf(row, "%c;%c\n", STATUS_ERROR, answer[2]);
+    free(answer);
+    return framedAnswer(NULL, row, rowLen, last, len);
+}
+
+/* ======================== Cursores (respuestas enmarcadas) ======================== */
+
+/* Un pedazo de `len' bytes escrito con snprintf en `size' bytes: -1 si no entro */
+static int cursorPiece(int len, size_t size){
+    return len < 0 || (size_t) len >= size ? -1 : len;
+}
+
+static int cursorHeader(cpCursor * cursor, char * out, size_t size, const char * header){
+    int len = cursorPiece(snprintf(out, size, "%s", header), size);
+    if(len > 0)
+        cursor->headerDone = true;
+    return len;
+}
+
+static void cursorInit(cpCursor * cursor, int (*next)(cpCursor *, char *, size_t)){
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->next = next;
+    cursor->status = STATUS_SUCCESS;
+}
+
+/* El unico pedazo es el codigo de error */
+static int errorNext(cpCursor * cursor, char * out, size_t size){
+    if(cursor->position > 0)
+        return 0;
+    if(size < 1)
+        return -1;
+    out[0] = cursor->error;
+    cursor->position++;
+    return 1;
+}
+
+static void cursorError(cpCursor * cursor, controlProtErrorCode error){
+    cursorInit(cursor, errorNext);
+    cursor->status = STATUS_ERROR;
+    cursor->error = (char) error;
+}
+
+static int usersNext(cpCursor * cursor, char * out, size_t size){
+    if(!cursor->headerDone)
+        return cursorHeader(cursor, out, size, SOCKS_U_HEADER);
+    /* Por posicion: si se borra un usuario mientras se responde, el que
+        ocupa su lugar puede no aparecer */
+    if(cursor->position >= get_total_curr_users())
+        return 0;
+    user_t * user = get_all_users()[cursor->position];
+    int len = cursorPiece(snprintf(out, size, "%s\n", user->name), size);
+    if(len > 0)
+        cursor->position++;
+    return len;
+}
+
+void openSocksUsersCursor(cpCommandParser * parser, cpCursor * cursor){
+    cursorInit(cursor, usersNext);
+}
+
+/* position es el proximo id: si el store pisa credenciales mientras se
+    responde, se sigue desde la mas vieja que quede */
+static int credentialsNext(cpCursor * cursor, char * out, size_t size){
+    if(!cursor->headerDone)
+        return cursorHeader(cursor, out, size, CREDS_HEADER);
+    const struct cred_entry * e;
+    if(cursor->remaining == 0 || cred_store_list(cursor->position, &e, 1) == 0)
+        return 0;
+    int len = cursorPiece(formatCredential(out, size, e), size);
+    if(len > 0){
+        cursor->position = e->id + 1;
+        cursor->remaining--;
+    }
+    return len;
+}
+
+/* Igual que getCredentials, pero sin N responde todas */
+void openCredentialsCursor(cpCommandParser * parser, cpCursor * cursor){
+    uint64_t from = 0;
+    long n = LONG_MAX;
+    if(!parseCredentialsRange(parser, &from, &n, LONG_MAX)){
+        cursorError(cursor, CPERROR_INVALID_FORMAT);
+        return;
+    }
+    cursorInit(cursor, credentialsNext);
+    cursor->position = from;
+    cursor->remaining = n;
+}
+
+/* position es el proximo id, como en credentialsNext: las sesiones que se
+    cierran mientras se responde no aparecen */
+static int sessionsNext(cpCursor * cursor, char * out, size_t size){
+    if(!cursor->headerDone)
+        return cursorHeader(cursor, out, size, SESSIONS_HEADER);
+    struct session_info info;
+    struct socks_conn_model * socks;
+    while(cursor->remaining > 0 && (socks = sessions_next(cursor->position)) != NULL){
+        sessions_info(socks, &info);
+        if(!sessionMatches(cursor->filter, &info)){
+            cursor->position = info.id + 1;
+            continue;
+        }
+        int len = cursorPiece(formatSession(out, size, &info), size);
+        if(len > 0){
+            cursor->position = info.id + 1;
+            cursor->remaining--;
+        }
+        return len;
+    }
+    return 0;
+}
+
+/* Igual que getSessions, pero sin n responde todas */
+void openSessionsCursor(cpCommandParser * parser, cpCursor * cursor){
+    uint64_t from = 0;
+    long n = LONG_MAX;
+    sessionFilter * filter = malloc(sizeof(*filter));
+    if(filter == NULL){
+        cursorError(cursor, CPERROR_GENERAL_ERROR);
+        return;
+    }
+    if(!parseSessionsQuery(parser, &from, &n, LONG_MAX, filter)){
+        free(filter);
+        cursorError(cursor, CPERROR_INVALID_FORMAT);
+        return;
+    }
+    cursorInit(cursor, sessionsNext);
+    cursor->position = from;
+    cursor->remaining = n;
+    cursor->filter = filter;
+}
+
+static int accountingNext(cpCursor * cursor, char * out, size_t size){
+    if(!cursor->headerDone)
+        return cursorHeader(cursor, out, size, ACCOUNTING_HEADER);
+    if(cursor->remaining == 0 || cursor->position >= accounting_count())
+        return 0;
+    int len = cursorPiece(formatAccounting(out, size, cursor->position), size);
+    if(len > 0){
+        cursor->position++;
+        cursor->remaining--;
+    }
+    return len;
+}
+
+/* Igual que getAccounting, pero sin n responde todos */
+void openAccountingCursor(cpCommandParser * parser, cpCursor * cursor){
+    uint64_t from = 0;
+    long n = LONG_MAX;
+    if(!parseAccountingQuery(parser, &from, &n, LONG_MAX)){
+        cursorError(cursor, CPERROR_INVALID_FORMAT);
+        return;
+    }
+    cursorInit(cursor, accountingNext);
+    cursor->position = from;
+    cursor->remaining = n;
+}
+
+static int latenciesNext(cpCursor * cursor, char * out, size_t size){
+    if(!cursor->headerDone)
+        return cursorHeader(cursor, out, size, LATENCIES_HEADER);
+    if(cursor->position >= LATENCY_COUNT)
+        return 0;
+    int len = cursorPiece(formatLatency(out, size, cursor->position), size);
+    if(len > 0)
+        cursor->position++;
+    return len;
+}
+
+void openLatenciesCursor(cpCommandParser * parser, cpCursor * cursor){
+    if(parser->hasData == 1){
+        cursorError(cursor, CPERROR_NO_DATA_COMMAND);
+        return;
+    }
+    cursorInit(cursor, latenciesNext);
+}
 
+/* Un pedazo por columna: primero la fila de titulos y despues la de valores */
+static int metricsNext(cpCursor * cursor, char * out, size_t size){
+    if(cursor->position >= 2 * METRICS_COLUMNS)
+        return 0;
+    size_t column = cursor->position % METRICS_COLUMNS;
+    char end = column + 1 == METRICS_COLUMNS ? '\n' : METRICS_CSV_SEPARATOR;
+    int len = cursor->position < METRICS_COLUMNS
+            ? snprintf(out, size, "%s%c", metricsColumns[column].title, end)
+            : snprintf(out, size, "%ld%c", metricsColumns[column].value(), end);
+    len = cursorPiece(len, size);
+    if(len > 0)
+        cursor->position++;
+    return len;
+}
+
+void openMetricsCursor(cpCommandParser * parser, cpCursor * cursor){
+    if(parser->hasData == 1){
+        cursorError(cursor, CPERROR_NO_DATA_COMMAND);
+        return;
+    }
+    cursorInit(cursor, metricsNext);
+}
+
+/* Los datos de una respuesta armada por completo, en pedazos de lo que entre */
+static int answerNext(cpCursor * cursor, char * out, size_t size){
+    size_t len = cursor->answerLen - cursor->position;
+    if(len == 0)
+        return 0;
+    if(len > size)
+        len = size;
+    if(len == 0)
+        return -1;
+    memcpy(out, cursor->answer + 2 + cursor->position, len);
+    cursor->position += len;
+    return len;
+}
+
+void openAnswerCursor(char * answer, cpCursor * cursor){
+    if(answer == NULL){
+        cursorError(cursor, CPERROR_GENERAL_ERROR);
+        return;
+    }
+    if(answer[0] == STATUS_ERROR){
+        cursorError(cursor, answer[2]);
+        free(answer);
+        return;
+    }
+    cursorInit(cursor, answerNext);
+    cursor->answer = answer;
+    /* Sin HAS_DATA la respuesta no tiene datos */
+    cursor->answerLen = answer[1] == 0 ? 0 : strlen(answer + 2);
+}
+
+void closeCursor(cpCursor * cursor){
+    free(cursor->answer);
+    cursor->answer = NULL;
+    free(cursor->filter);
+    cursor->filter = NULL;
+}
@@ -12,12 +12,14 @@
 #include "../../include/buffer.h"
 #include "../parsers/cpAuthParser.h"
 #include "../parsers/cpCommandParser.h"
+#include "cpCursor.h"
 #include "cpCommands.h"
+#include "../../include/config.h"
 
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE 1024        /* tope de las respuestas sin enmarcar que se recortan */
 #define HELLO_LEN 10
 
-#define CONTROL_PROT_VERSION "0.1"
+#define CONTROL_PROT_VERSION "0.2"
 #define ADMIN_PASSWORD "pass1234"
 
 #define TOKEN_DELIMITER ":"
@@ -47,7 +49,10 @@ typedef enum controlProtErrorCode{
     CPERROR_INEXISTING_USER,
     CPERROR_ALREADY_EXISTS,
     CPERROR_USER_LIMIT,
-    CPERROR_GENERAL_ERROR     /* Encapsulamiento de los errores de memoria */
+    CPERROR_GENERAL_ERROR,    /* Encapsulamiento de los errores de memoria */
+    CPERROR_POLICY_ERROR,     /* No se pudieron recargar las politicas de acceso */
+    CPERROR_INVALID_VALUE,    /* Parametro de configuracion inexistente o fuera de rango */
+    CPERROR_INEXISTING_SESSION
 } controlProtErrorCode;
 
 
@@ -61,8 +66,9 @@ typedef struct controlProtConn {
     buffer * readBuffer;
     buffer * writeBuffer;
 
-    uint8_t readBufferData[BUFFER_SIZE];
-    uint8_t writeBufferData[BUFFER_SIZE];
+    /* De CONFIG_MGMT_BUFFER bytes al crear la conexion */
+    uint8_t * readBufferData;
+    uint8_t * writeBufferData;
 
     struct state_machine connStm;
     controlProtStmState currentState;
@@ -78,6 +84,15 @@ typedef struct controlProtConn {
     bool authAnsWritten;
     bool execAnsWritten;
     char * execAnswer;
+    size_t execAnswerLen;
+    size_t execAnswerSent;      /* las respuestas largas se copian en partes */
+
+    uint32_t batchItems;        /* items que faltan del lote en curso */
+
+    /* Respuesta enmarcada en curso */
+    bool streaming;
+    bool statusWritten;
+    cpCursor cursor;
 
     /* Puntero al siguiente. Se usa para liberar todo ante una terminacion normal */
     struct controlProtConn * nextConn;
@@ -2,23 +2,74 @@
 #define CP_COMMANDS_H
 
 #include <stdbool.h>
+#include <limits.h>
 
 #include "controlProtocol.h"
-#include "../../sniffer/pop3_sniffer.h"
+#include "cpCursor.h"
+#include "../../sniffer/dissector.h"
+#include "../../sniffer/cred_store.h"
 #include "../../users/user_mgmt.h"
 #include "../../include/metrics.h"
+#include "../../acl/acl.h"
+#include "../../acl/domain_acl.h"
+#include "../../logger/trace.h"
+#include "../../include/config.h"
+#include "../../socks5/sessions.h"
+#include "../../users/accounting.h"
 
 #define INITIAL_SIZE 256
 #define MEM_BLOCK 256
 
-#define METRICS_CSV_TITLE "curr_socks;hist_socks;curr_control;hist_control;curr_total;hist_total;bytes_trnf\n"
+#define METRICS_ANSWER_SIZE 512
+#define METRICS_CSV_SEPARATOR ';'
+#define TOP_HEADER "by;key;conns;bytes\n"
+#define TOP_DEFAULT_N 10
+#define TRACE_HEADER "time_us;point;fd;session;a;b\n"
+#define CREDS_HEADER "id;first_seen;last_seen;count;protocol;socks_user;client;client_port;destination;destination_port;user;password\n"
+#define CREDS_DEFAULT_N 10
+#define CREDS_FIELD_SIZE 64     /* los campos de texto mas largos se truncan */
+#define CONFIG_HEADER "name;value;min;max\n"
+#define SESSIONS_HEADER "id;client;client_port;user;destination;destination_port;state;bytes_up;bytes_down;started;last_activity\n"
+#define SESSIONS_DEFAULT_N 10
+#define ACCOUNTING_HEADER "handle;user;connections;bytes_up;bytes_down;duration_ms;first_seen;last_seen\n"
+#define ACCOUNTING_DEFAULT_N 10
+#define BATCH_HEADER "status;error\n"
+#define BATCH_MAX_ITEMS (1 << 20)
+#define LATENCIES_HEADER "phase;count;p50_us;p90_us;p99_us;p999_us\n"
+
 
 char * addProxyUser(cpCommandParser * parser);
 char * removeProxyUser(cpCommandParser * parser);
 char * turnOnPassDissectors(cpCommandParser * parser);
 char * turnOffPassDissectors(cpCommandParser * parser);
+char * switchProtocolDissector(cpCommandParser * parser);
 char * changePassword(cpCommandParser * parser);
 char * getMetrics(cpCommandParser * parser);
 char * getSocksUsers(cpCommandParser * parser);
+char * reloadPolicies(cpCommandParser * parser);
+char * getLatencies(cpCommandParser * parser);
+char * getTop(cpCommandParser * parser);
+char * trace(cpCommandParser * parser);
+char * getCredentials(cpCommandParser * parser);
+char * getConfig(cpCommandParser * parser);
+char * setConfig(cpCommandParser * parser);
+char * getSessions(cpCommandParser * parser);
+char * killSession(cpCommandParser * parser);
+char * getAccounting(cpCommandParser * parser);
+
+/* Lotes: los items responden ya enmarcados, con su largo en `len' */
+char * openBatch(cpCommandParser * parser, uint32_t * items, size_t * len);
+char * runBatchItem(cpCommandParser * parser, bool last, size_t * len);
+
+/* Respuestas enmarcadas (ver cpCursor.h). El cursor se cierra con closeCursor */
+void openSocksUsersCursor(cpCommandParser * parser, cpCursor * cursor);
+void openCredentialsCursor(cpCommandParser * parser, cpCursor * cursor);
+void openLatenciesCursor(cpCommandParser * parser, cpCursor * cursor);
+void openMetricsCursor(cpCommandParser * parser, cpCursor * cursor);
+void openSessionsCursor(cpCommandParser * parser, cpCursor * cursor);
+void openAccountingCursor(cpCommandParser * parser, cpCursor * cursor);
+/** Para los comandos sin cursor: toma `answer' (la respuesta sin enmarcar) */
+void openAnswerCursor(char * answer, cpCursor * cursor);
+void closeCursor(cpCursor * cursor);
 
 #endif
\ No newline at end of file
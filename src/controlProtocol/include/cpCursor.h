@@ -0,0 +1,44 @@
+#ifndef CP_CURSOR_H
+#define CP_CURSOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Respuesta enmarcada (version 0.2 del protocolo)
+ *
+ *  +--------+-----------+---------+-----+-----------+
+ *  | STATUS | LEN (2)   | DATA    | ... | LEN = 0   |
+ *  +--------+-----------+---------+-----+-----------+
+ *
+ * LEN es big endian. Los DATA de todos los frames concatenados son el CSV
+ * de la respuesta (sin la cantidad de filas, que no se conoce de antemano)
+ * o, si STATUS es '0', el codigo de error. Un frame vacio cierra la
+ * respuesta.
+ *
+ * Los comandos que pueden responder mucho lo hacen con un cursor: cada
+ * llamada a next escribe el proximo pedazo de la respuesta directamente en
+ * el buffer de escritura, asi que la memoria no depende del tamanio de la
+ * respuesta.
+ */
+
+typedef struct cpCursor {
+    /* Escribe el proximo pedazo en `out' y retorna su largo, 0 si no queda
+        nada, o -1 si no entra en `size' bytes (se vuelve a pedir cuando haya
+        mas lugar) */
+    int (*next)(struct cpCursor * cursor, char * out, size_t size);
+    char status;                /* STATUS_SUCCESS o STATUS_ERROR */
+    char error;                 /* codigo de error si status es STATUS_ERROR */
+    bool headerDone;
+    uint64_t position;
+    uint64_t remaining;
+    char * answer;              /* respuestas de los comandos sin cursor */
+    size_t answerLen;
+    void * filter;              /* propio de cada comando, lo libera closeCursor */
+} cpCursor;
+
+#define CP_FRAME_HEADER 2
+#define CP_FRAME_MAX 0xFFFF
+
+#endif
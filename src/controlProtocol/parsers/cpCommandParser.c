@@ -6,6 +6,7 @@ void initCpCommandParser(cpCommandParser * parser){
     parser->dataSize = 0;
     parser->code = CP_NO_COMMAND;
     parser->hasData = 0;
+    parser->framed = false;
 }
 
 
@@ -13,12 +14,15 @@ cpCommandParserState cpcpParseByte(cpCommandParser * parser, uint8_t byte){
     switch (parser->currentState){
         case CPCP_COMMAND_CODE:
             LogInfo("[CPCP_COMMAND_CODE] - %hhx (%c)\n", byte, byte);
-            if(byte < CP_ADD_USER || byte > CP_DISSECTOR_OFF)
+            if(byte < CP_ADD_USER || byte >= CP_COMMAND_END)
                 return CPCP_ERROR;
             parser->code = byte;
             return CPCP_HAS_DATA;
         case CPCP_HAS_DATA:         // En la version actual del protocolo, HAS_DATA = 0|1 para el cliente
             LogInfo("[CPAP_HAS_DATA] - %hhx (%c)\n", byte, byte);
+            /* Desde la version 0.2, con CP_FRAMED_FLAG la respuesta va en frames */
+            parser->framed = (byte & CP_FRAMED_FLAG) != 0;
+            byte &= ~CP_FRAMED_FLAG;
             if(byte == 0x0/* '0' */)
                 return CPCP_DONE;   // Por default, hasData = 0
             if(byte ==  0x1 /*'1'*/){
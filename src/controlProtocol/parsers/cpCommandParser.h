@@ -3,8 +3,10 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 #define MAX_DATA_SIZE 255
+#define CP_FRAMED_FLAG 0x80     /* en HAS_DATA: pide la respuesta enmarcada */
 
 typedef enum cpCommandCode {
     CP_NO_COMMAND,
@@ -16,6 +18,19 @@ typedef enum cpCommandCode {
     CP_GET_METRICS,         // HAS_DATA = 0
     CP_DISSECTOR_ON,        // HAS_DATA = 0
     CP_DISSECTOR_OFF,       // HAS_DATA = 0
+    CP_RELOAD_POLICY,       // HAS_DATA = 0
+    CP_GET_LATENCIES,       // HAS_DATA = 0
+    CP_GET_TOP,             // HAS_DATA = 1
+    CP_TRACE,               // HAS_DATA = 1
+    CP_DISSECTOR_PROTO,     // HAS_DATA = 1
+    CP_GET_CREDENTIALS,     // HAS_DATA = 0 o 1
+    CP_BATCH,               // HAS_DATA = 1
+    CP_GET_CONFIG,          // HAS_DATA = 0 o 1
+    CP_SET_CONFIG,          // HAS_DATA = 1
+    CP_LIST_SESSIONS,       // HAS_DATA = 0 o 1
+    CP_KILL_SESSION,        // HAS_DATA = 1
+    CP_GET_ACCOUNTING,      // HAS_DATA = 0 o 1
+    CP_COMMAND_END          /* Marca el fin de los comandos validos */
 } cpCommandCode;
 
 typedef enum cpCommandParserState {
@@ -30,6 +45,7 @@ typedef struct cpCommandParser {
     cpCommandParserState currentState;
     cpCommandCode code;
     uint8_t hasData;
+    bool framed;
     char data[MAX_DATA_SIZE + 1];   // Cerramos el string con '\0'
     int dataSize;
 } cpCommandParser;
@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "exporter.h"
+#include "../include/buffer.h"
+#include "../include/metrics.h"
+#include "../acl/acl.h"
+#include "../acl/domain_acl.h"
+#include "../users/user_mgmt.h"
+#include "../logger/logger.h"
+
+#define EXPORTER_REQUEST_SIZE 2048
+#define EXPORTER_RESPONSE_SIZE (32 * 1024)
+/* The body is rendered after this gap and the headers are then written
+   right before it, so the response goes out in a single contiguous send */
+#define EXPORTER_HEADER_SIZE 256
+
+#define OPENMETRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+#define LATENCY_FAMILY "socks5_phase_latency_seconds"
+
+/* Upper bounds of the exported latency buckets, in microseconds */
+static const uint64_t latency_bounds[] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000,
+};
+#define LATENCY_BOUNDS (sizeof(latency_bounds) / sizeof(latency_bounds[0]))
+
+struct exporter_conn{
+    int fd;
+    bool close_after;
+    buffer read_buff;
+    uint8_t read_raw[EXPORTER_REQUEST_SIZE];
+    char * response_start;
+    size_t response_len;
+    char response[EXPORTER_HEADER_SIZE + EXPORTER_RESPONSE_SIZE];
+};
+
+struct out{
+    char * data;
+    size_t len;
+    size_t size;
+};
+
+static void exporter_read(struct selector_key * key);
+static void exporter_write(struct selector_key * key);
+static void exporter_close(struct selector_key * key);
+
+static const struct fd_handler exporter_handler = {
+    .handle_read = exporter_read,
+    .handle_write = exporter_write,
+    .handle_block = NULL,
+    .handle_close = exporter_close,
+};
+
+static long acl_rules(){ return (long)acl_rule_count(); }
+static long domain_rules(){ return (long)domain_acl_get_stats().entries; }
+static long domain_memory(){ return (long)domain_acl_get_stats().memory; }
+static long socks_users(){ return (long)get_total_curr_users(); }
+
+/* Gauges that do not live in the metrics counters */
+static const struct{
+    const char * family;
+    const char * help;
+    long (*value)();
+} gauges[] = {
+    {"socks5_users",                "usuarios SOCKS registrados",           socks_users},
+    {"socks5_acl_rules",            "reglas de acceso por destino",         acl_rules},
+    {"socks5_domain_rules",         "entradas de la lista de dominios",     domain_rules},
+    {"socks5_domain_memory_bytes",  "memoria usada por la lista de dominios", domain_memory},
+};
+#define GAUGES (sizeof(gauges) / sizeof(gauges[0]))
+
+static void
+out_printf(struct out * out, const char * format, ...){
+    if(out->len >= out->size) return;
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out->data + out->len, out->size - out->len, format, args);
+    va_end(args);
+    out->len = n < 0 ? out->size : out->len + n;
+}
+
+static void
+render_latencies(struct out * out){
+    out_printf(out, "# TYPE " LATENCY_FAMILY " histogram\n"
+                    "# UNIT " LATENCY_FAMILY " seconds\n"
+                    "# HELP " LATENCY_FAMILY " duracion de cada fase de una conexion SOCKS\n");
+    for(int i = 0; i < LATENCY_COUNT; i++){
+        histogram * h = metrics_get_latency(i);
+        const char * phase = metrics_latency_name(i);
+        uint64_t seen = 0;
+        for(size_t j = 0; j < LATENCY_BOUNDS; j++){
+            seen = histogram_count_le(h, latency_bounds[j]);
+            out_printf(out, LATENCY_FAMILY "_bucket{phase=\"%s\",le=\"%g\"} %lu\n",
+                       phase, latency_bounds[j] / 1e6, (unsigned long)seen);
+        }
+        /* Buckets and count are read separately: keep them consistent */
+        uint64_t count = histogram_count(h);
+        if(count < seen) count = seen;
+        out_printf(out, LATENCY_FAMILY "_bucket{phase=\"%s\",le=\"+Inf\"} %lu\n"
+                        LATENCY_FAMILY "_count{phase=\"%s\"} %lu\n"
+                        LATENCY_FAMILY "_sum{phase=\"%s\"} %.6f\n",
+                   phase, (unsigned long)count, phase, (unsigned long)count,
+                   phase, histogram_sum(h) / 1e6);
+    }
+}
+
+/* Returns the body length, or -1 if it does not fit */
+static long
+render_metrics(char * data, size_t size){
+    struct out out = {data, 0, size};
+
+    for(int i = 0; i < METRIC_COUNT; i++){
+        const char * family = metrics_family(i);
+        bool counter = metrics_type(i) == METRIC_TYPE_COUNTER;
+        out_printf(&out, "# TYPE %s %s\n# HELP %s %s\n%s%s %ld\n",
+                   family, counter ? "counter" : "gauge",
+                   family, metrics_description(i),
+                   family, counter ? "_total" : "", metrics_get(i));
+    }
+    for(size_t i = 0; i < GAUGES; i++){
+        out_printf(&out, "# TYPE %s gauge\n# HELP %s %s\n%s %ld\n",
+                   gauges[i].family, gauges[i].family, gauges[i].help,
+                   gauges[i].family, gauges[i].value());
+    }
+    render_latencies(&out);
+    out_printf(&out, "# EOF\n");
+
+    return out.len >= out.size ? -1 : (long)out.len;
+}
+
+/* Places the status line and headers right before the body already
+   rendered at conn->response + EXPORTER_HEADER_SIZE */
+static void
+set_response(struct exporter_conn * conn, const char * status, const char * content_type,
+             size_t body_len, bool send_body){
+    char header[EXPORTER_HEADER_SIZE];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.1 %s\r\n"
+                              "Content-Type: %s\r\n"
+                              "Content-Length: %lu\r\n"
+                              "%s\r\n",
+                              status, content_type, (unsigned long)body_len,
+                              conn->close_after ? "Connection: close\r\n" : "");
+    conn->response_start = conn->response + EXPORTER_HEADER_SIZE - header_len;
+    memcpy(conn->response_start, header, header_len);
+    conn->response_len = header_len + (send_body ? body_len : 0);
+}
+
+static void
+set_error(struct exporter_conn * conn, const char * status){
+    char * body = conn->response + EXPORTER_HEADER_SIZE;
+    size_t len = strlen(status);
+    memcpy(body, status, len);
+    body[len++] = '\n';
+    set_response(conn, status, "text/plain; charset=utf-8", len, true);
+}
+
+/* Returns the length of the request head (up to the empty line) or 0 if it
+   is not complete yet */
+static size_t
+request_length(const uint8_t * data, size_t len){
+    for(size_t i = 3; i < len; i++){
+        if(data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r')
+            return i + 1;
+    }
+    return 0;
+}
+
+static bool
+header_is(const char * line, size_t len, const char * name, const char * value){
+    size_t name_len = strlen(name);
+    if(len <= name_len || strncasecmp(line, name, name_len) != 0 || line[name_len] != ':')
+        return false;
+    const char * p = line + name_len + 1;
+    const char * end = line + len;
+    while(p < end && (*p == ' ' || *p == '\t')) p++;
+    size_t value_len = strlen(value);
+    return (size_t)(end - p) >= value_len && strncasecmp(p, value, value_len) == 0;
+}
+
+/* Builds the response for the request head in `req' */
+static void
+handle_request(struct exporter_conn * conn, const char * req, size_t len){
+    const char * end = req + len;
+    const char * eol = memchr(req, '\r', len);
+
+    char method[8], path[64], version[16];
+    char line[sizeof(method) + sizeof(path) + sizeof(version) + 3];
+    size_t line_len = eol - req;
+    if(line_len >= sizeof(line) ||
+       (memcpy(line, req, line_len), line[line_len] = '\0',
+        sscanf(line, "%7s %63s %15s", method, path, version) != 3)){
+        conn->close_after = true;
+        set_error(conn, "400 Bad Request");
+        return;
+    }
+
+    /* HTTP/1.1 keeps the connection open unless told otherwise */
+    conn->close_after = strcmp(version, "HTTP/1.1") != 0;
+    for(const char * p = eol + 2; p < end; ){
+        const char * next = memchr(p, '\r', end - p);
+        if(next == NULL || next == p) break;
+        if(header_is(p, next - p, "Connection", "close")) conn->close_after = true;
+        else if(header_is(p, next - p, "Connection", "keep-alive")) conn->close_after = false;
+        p = next + 2;
+    }
+
+    bool head = strcmp(method, "HEAD") == 0;
+    if(!head && strcmp(method, "GET") != 0){
+        set_error(conn, "405 Method Not Allowed");
+        return;
+    }
+    size_t path_len = strcspn(path, "?");
+    if(path_len != strlen("/metrics") || strncmp(path, "/metrics", path_len) != 0){
+        set_error(conn, "404 Not Found");
+        return;
+    }
+
+    long body_len = render_metrics(conn->response + EXPORTER_HEADER_SIZE, EXPORTER_RESPONSE_SIZE);
+    if(body_len < 0){
+        LogError("Metrics do not fit in the exporter response buffer");
+        set_error(conn, "500 Internal Server Error");
+        return;
+    }
+    set_response(conn, "200 OK", OPENMETRICS_CONTENT_TYPE, body_len, !head);
+}
+
+/* Serves the next buffered request, if there is a complete one. Returns
+   false when more bytes are needed. */
+static bool
+process_buffered(struct selector_key * key, struct exporter_conn * conn){
+    size_t n;
+    uint8_t * data = buffer_read_ptr(&conn->read_buff, &n);
+    size_t len = request_length(data, n);
+    if(len == 0){
+        if(!buffer_can_write(&conn->read_buff)){
+            /* The request head does not fit in the buffer */
+            conn->close_after = true;
+            set_error(conn, "431 Request Header Fields Too Large");
+            buffer_reset(&conn->read_buff);
+            selector_set_interest_key(key, OP_WRITE);
+            return true;
+        }
+        return false;
+    }
+    handle_request(conn, (const char *)data, len);
+    buffer_read_adv(&conn->read_buff, len);
+    selector_set_interest_key(key, OP_WRITE);
+    return true;
+}
+
+static void
+exporter_read(struct selector_key * key){
+    struct exporter_conn * conn = key->data;
+    buffer_compact(&conn->read_buff);
+    size_t space;
+    uint8_t * ptr = buffer_write_ptr(&conn->read_buff, &space);
+    ssize_t n = recv(key->fd, ptr, space, 0);
+    if(n <= 0){
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        selector_unregister_fd(key->s, key->fd, true);
+        return;
+    }
+    buffer_write_adv(&conn->read_buff, n);
+    process_buffered(key, conn);
+}
+
+static void
+exporter_write(struct selector_key * key){
+    struct exporter_conn * conn = key->data;
+    ssize_t n = send(key->fd, conn->response_start, conn->response_len, MSG_NOSIGNAL);
+    if(n < 0){
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return;
+        selector_unregister_fd(key->s, key->fd, true);
+        return;
+    }
+    conn->response_start += n;
+    conn->response_len -= n;
+    if(conn->response_len > 0) return;
+
+    if(conn->close_after){
+        selector_unregister_fd(key->s, key->fd, true);
+        return;
+    }
+    /* Pipelined requests are answered one at a time */
+    if(!process_buffered(key, conn))
+        selector_set_interest_key(key, OP_READ);
+}
+
+static void
+exporter_close(struct selector_key * key){
+    struct exporter_conn * conn = key->data;
+    close(conn->fd);
+    free(conn);
+}
+
+void
+exporter_passive_accept(struct selector_key * key){
+    int fd = accept(key->fd, NULL, NULL);
+    if(fd < 0){
+        LogError("Error in exporter accept");
+        return;
+    }
+    if(selector_fd_set_nio(fd) == -1){
+        LogError("Error in selector_fd_set_nio call");
+        close(fd);
+        return;
+    }
+
+    struct exporter_conn * conn = malloc(sizeof(struct exporter_conn));
+    if(conn == NULL){
+        close(fd);
+        return;
+    }
+    conn->fd = fd;
+    conn->close_after = false;
+    conn->response_start = conn->response;
+    conn->response_len = 0;
+    buffer_init(&conn->read_buff, EXPORTER_REQUEST_SIZE, conn->read_raw);
+
+    if(selector_register(key->s, fd, &exporter_handler, OP_READ, conn) != SELECTOR_SUCCESS){
+        LogError("Error registering exporter connection");
+        close(fd);
+        free(conn);
+    }
+}
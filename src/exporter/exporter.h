@@ -0,0 +1,21 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "../include/selector.h"
+
+/*
+            EXPORTER.h
+Plain HTTP endpoint serving the server metrics in OpenMetrics text format,
+so they can be scraped without speaking the control protocol.
+
+Only `GET /metrics' (and HEAD) is served. Connections are kept alive unless
+the client asks otherwise, and several requests may be pipelined on them.
+
+Each connection owns a fixed response buffer allocated when it is accepted,
+so a scrape renders in place and never allocates.
+*/
+
+/* Accept handler for the passive exporter sockets */
+void exporter_passive_accept(struct selector_key * key);
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * histogram.c - histograma de latencias con buckets logaritmicos
+ */
+#include "include/histogram.h"
+
+static unsigned
+msb(uint64_t value){
+    unsigned bit = 0;
+    while(value >>= 1) bit++;
+    return bit;
+}
+
+static unsigned
+bucket_index(uint64_t value){
+    if(value < HISTOGRAM_SUB_BUCKETS)
+        return (unsigned) value;
+
+    unsigned m = msb(value);
+    if(m > HISTOGRAM_MAX_BITS)
+        return HISTOGRAM_BUCKETS - 1;
+
+    /* mantisa en [SUB_BUCKETS, 2 * SUB_BUCKETS) */
+    unsigned shift = m - HISTOGRAM_SUB_BITS;
+    unsigned mantissa = (unsigned)(value >> shift);
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (mantissa - HISTOGRAM_SUB_BUCKETS);
+}
+
+/** mayor valor que cae en el bucket `index' */
+static uint64_t
+bucket_highest(unsigned index){
+    if(index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+    unsigned shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t mantissa = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void
+histogram_init(histogram * h){
+    for(unsigned i = 0; i < HISTOGRAM_BUCKETS; i++)
+        atomic_init(&h->buckets[i], 0);
+    atomic_init(&h->count, 0);
+    atomic_init(&h->sum, 0);
+}
+
+void
+histogram_record(histogram * h, uint64_t value){
+    atomic_fetch_add_explicit(&h->buckets[bucket_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+}
+
+uint64_t
+histogram_count(histogram * h){
+    return atomic_load_explicit(&h->count, memory_order_relaxed);
+}
+
+uint64_t
+histogram_sum(histogram * h){
+    return atomic_load_explicit(&h->sum, memory_order_relaxed);
+}
+
+uint64_t
+histogram_percentile(histogram * h, double p){
+    uint64_t total = histogram_count(h);
+    if(total == 0)
+        return 0;
+
+    /* posicion (1-based) del valor buscado */
+    uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+    if(rank == 0) rank = 1;
+    if(rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for(unsigned i = 0; i < HISTOGRAM_BUCKETS; i++){
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        if(seen >= rank)
+            return bucket_highest(i);
+    }
+    return bucket_highest(HISTOGRAM_BUCKETS - 1);
+}
+
+uint64_t
+histogram_count_le(histogram * h, uint64_t value){
+    unsigned last = bucket_index(value);
+    uint64_t seen = 0;
+    for(unsigned i = 0; i <= last; i++)
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+    return seen;
+}
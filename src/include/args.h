@@ -2,8 +2,9 @@
 #define ARGS_H_kFlmYm1tW9p5npzDr2opQJ9jM8
 
 #include <stdbool.h>
+#include <stddef.h>
 
-#define MAX_USERS 10
+#define MAX_USERS (1 << 20)
 
 typedef struct user_t {
     char *name;
@@ -25,7 +26,20 @@ struct socks5args {
     char *          mng_addr;
     char *          mng_port;
 
+    char *          metrics_addr;
+    char *          metrics_port;   /* NULL si el exporter esta deshabilitado */
+
     bool            disectors_enabled;
+    bool            sniff_worker;   /* dissectors en un hilo aparte */
+
+    char *          acl_file;
+    char *          domain_list_file;
+
+    char *          access_log_dir; /* registro de acceso binario, NULL para texto */
+    char *          accounting_file; /* contabilidad por usuario, NULL en memoria */
+
+    size_t          top_size;       /* claves por lista del top-K */
+    size_t          top_width;      /* contadores por fila de sketch */
 
     struct doh      doh;
 };
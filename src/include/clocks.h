@@ -0,0 +1,44 @@
+#ifndef CLOCKS_H
+#define CLOCKS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * clocks.c - relojes baratos para el hilo del selector
+ *
+ * clocks_update lee una vez por iteracion del selector el reloj monotonico y
+ * el de pared en sus versiones COARSE (sin syscall en Linux, con la
+ * resolucion del tick del kernel) y, cuando cambia el segundo, formatea la
+ * fecha ISO-8601 en UTC. Los logs y los timeouts toman esos valores en lugar
+ * de pedirle la hora a libc en cada llamada.
+ *
+ * Las lecturas cacheadas solo son validas en el hilo del selector. Las
+ * metricas de latencia siguen usando metrics_now_usec, que necesita
+ * resolucion de microsegundos.
+ */
+
+/* "2022-11-19T12:00:00Z" */
+#define CLOCKS_ISO8601_SIZE 21
+
+/** toma la hora actual; se llama al despertar de cada selector_select */
+void clocks_update(void);
+
+/** monotonico al inicio de la iteracion actual */
+uint64_t clocks_mono_ns(void);
+uint64_t clocks_mono_usec(void);
+
+/** segundos desde epoch al inicio de la iteracion actual */
+time_t clocks_wall_sec(void);
+
+/** fecha de la iteracion actual en UTC, terminada en 'Z' */
+const char * clocks_iso8601(void);
+
+/** CLOCK_MONOTONIC_COARSE sin cache, valido desde cualquier hilo */
+uint64_t clocks_coarse_mono_ns(void);
+
+/** CLOCK_REALTIME_COARSE sin cache, en nanosegundos; valido desde cualquier
+    hilo y del mismo tick que clocks_coarse_mono_ns */
+uint64_t clocks_coarse_wall_ns(void);
+
+#endif
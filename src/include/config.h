@@ -0,0 +1,51 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+/*
+ * Parametros que se pueden cambiar en ejecucion desde el protocolo de
+ * control (GET_CONFIG / SET_CONFIG).
+ *
+ * Cada modulo lee su parametro con config_get en el momento en que lo usa
+ * (al crear una sesion, al aceptar una conexion), asi que un cambio aplica
+ * a lo que se cree despues sin reiniciar el servidor; las sesiones abiertas
+ * conservan lo que tenian. Los que afectan algo ya creado (el backlog de
+ * los sockets pasivos, el timeout del selector) se aplican al cambiarlos.
+ * Solo se usan desde el hilo del selector.
+ */
+enum config_param {
+    CONFIG_SOCKS_BUFFER,        /* bytes de cada buffer del relay */
+    CONFIG_MGMT_BUFFER,         /* bytes de cada buffer de management */
+    CONFIG_LISTEN_BACKLOG,      /* conexiones pendientes de cada socket pasivo */
+    CONFIG_SELECT_TIMEOUT,      /* segundos que el selector espera sin eventos */
+    CONFIG_MAX_SESSIONS,        /* sesiones SOCKS concurrentes, 0 sin limite */
+    CONFIG_LOG_LEVEL,           /* LOG_LEVEL_DEBUG a LOG_LEVEL_NONE */
+    CONFIG_USER_RATE,           /* bytes por segundo de cada usuario, 0 sin limite */
+    CONFIG_SESSION_RATE,        /* bytes por segundo de cada sesion, 0 sin limite */
+    CONFIG_MAX_IP_SESSIONS,     /* sesiones concurrentes por direccion de origen, 0 sin limite */
+    CONFIG_MAX_USER_SESSIONS,   /* sesiones concurrentes por usuario, 0 sin limite */
+    CONFIG_AUTH_MAX_FAILURES,   /* fallas recientes de autenticacion por direccion, 0 sin limite */
+    CONFIG_IO_BUDGET,           /* bytes que cada lado del relay mueve por iteracion del selector */
+    CONFIG_INTERACTIVE_WEIGHT,  /* veces io_budget que mueven las sesiones interactivas */
+    CONFIG_COUNT
+};
+
+enum config_result {
+    CONFIG_OK,
+    CONFIG_UNKNOWN,             /* no hay un parametro con ese nombre */
+    CONFIG_OUT_OF_RANGE,
+};
+
+long config_get(enum config_param param);
+
+const char * config_name(enum config_param param);
+long config_min(enum config_param param);
+long config_max(enum config_param param);
+
+/** CONFIG_COUNT si no hay un parametro con ese nombre */
+enum config_param config_find(const char * name);
+
+enum config_result config_set(enum config_param param, long value);
+
+#endif
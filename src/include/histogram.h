@@ -0,0 +1,51 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/**
+ * histogram.c - histograma de latencias con buckets logaritmicos (estilo HDR)
+ *
+ * Los valores menores a HISTOGRAM_SUB_BUCKETS se guardan exactos. A partir de
+ * ahi cada potencia de 2 se divide en HISTOGRAM_SUB_BUCKETS buckets lineales,
+ * por lo que el error relativo de un percentil es a lo sumo
+ * 1 / HISTOGRAM_SUB_BUCKETS sin importar la magnitud del valor.
+ *
+ * Registrar un valor es O(1) y no aloca. Los contadores son atomicos
+ * relajados, como los de metrics.c.
+ */
+
+#define HISTOGRAM_SUB_BITS      4
+#define HISTOGRAM_SUB_BUCKETS   (1 << HISTOGRAM_SUB_BITS)
+/* Valores mayores a 2^HISTOGRAM_MAX_BITS se acumulan en el ultimo bucket */
+#define HISTOGRAM_MAX_BITS      40
+#define HISTOGRAM_BUCKETS \
+    ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct histogram {
+    atomic_ulong buckets[HISTOGRAM_BUCKETS];
+    atomic_ulong count;
+    atomic_ulong sum;
+} histogram;
+
+void histogram_init(histogram * h);
+
+void histogram_record(histogram * h, uint64_t value);
+
+/** cantidad de valores registrados */
+uint64_t histogram_count(histogram * h);
+
+/** suma de los valores registrados */
+uint64_t histogram_sum(histogram * h);
+
+/**
+ * retorna el valor maximo equivalente al percentil `p' (0 < p <= 100).
+ * 0 si no hay valores registrados.
+ */
+uint64_t histogram_percentile(histogram * h, double p);
+
+/** cantidad de valores menores o iguales a `value' */
+uint64_t histogram_count_le(histogram * h, uint64_t value);
+
+#endif
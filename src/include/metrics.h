@@ -1,7 +1,10 @@
 #ifndef METRICS_H
 #define METRICS_H
 
-#include "../sniffer/pop3_sniffer.h"
+#include <stdint.h>
+#include "../sniffer/dissector.h"
+#include "histogram.h"
+#include "topk.h"
 /*
    6.  implementar mecanismos que permitan recolectar métricas que
        ayuden a monitorear la operación del sistema.
@@ -16,6 +19,107 @@
            entendimiento del funcionamiento dinámico del sistema
 */
 
+/*
+ * Contadores del servidor. Para agregar uno nuevo alcanza con sumarlo a
+ * esta lista: X(identificador, descripcion, nombre exportado, tipo).
+ * Los de tipo GAUGE pueden decrementarse.
+ *
+ * Cada hilo escribe en su propio bloque de contadores (alineado a una linea
+ * de cache y con atomicos relajados), asi que incrementar nunca compite con
+ * otro hilo. La lectura suma todos los bloques.
+ */
+#define METRICS_COUNTERS(X) \
+    X(HISTORIC_SOCKS,   "conexiones SOCKS historicas", \
+      "socks5_connections", COUNTER) \
+    X(CURRENT_SOCKS,    "conexiones SOCKS concurrentes", \
+      "socks5_active_connections", GAUGE) \
+    X(HISTORIC_MGMT,    "conexiones de management historicas", \
+      "socks5_control_connections", COUNTER) \
+    X(CURRENT_MGMT,     "conexiones de management concurrentes", \
+      "socks5_active_control_connections", GAUGE) \
+    X(BYTES_TRANSFERRED, "bytes enviados por el relay", \
+      "socks5_relayed_bytes", COUNTER) \
+    X(ACCESS_LOG_DROPS, "registros de acceso descartados por falta de espacio", \
+      "socks5_access_log_dropped_records", COUNTER) \
+    X(SNIFF_DROPS,      "bloques o resultados del sniffer descartados por falta de espacio", \
+      "socks5_sniffer_dropped", COUNTER) \
+    X(SHAPER_THROTTLES, "lecturas demoradas por los limites de ancho de banda", \
+      "socks5_throttled_reads", COUNTER) \
+    X(LIMIT_REJECTS,    "sesiones rechazadas por los limites por direccion o usuario", \
+      "socks5_limit_rejected_sessions", COUNTER) \
+    X(AUTH_THROTTLES,   "autenticaciones rechazadas sin verificar por fallas recientes de la direccion", \
+      "socks5_auth_throttled", COUNTER)
+
+enum metric_type {
+    METRIC_TYPE_COUNTER,
+    METRIC_TYPE_GAUGE,
+};
+
+#define METRIC_ENUM(name, description, family, type) METRIC_##name,
+enum metric_counter {
+    METRICS_COUNTERS(METRIC_ENUM)
+    METRIC_COUNT
+};
+#undef METRIC_ENUM
+
+/*
+ * Latencias de cada fase de una conexion SOCKS, en microsegundos.
+ * X(identificador, nombre)
+ */
+#define METRICS_LATENCIES(X) \
+    X(HELLO,        "hello") \
+    X(AUTH,         "auth") \
+    X(DNS,          "dns") \
+    X(CONNECT,      "connect") \
+    X(FIRST_BYTE,   "first_byte")
+
+#define LATENCY_ENUM(name, title) LATENCY_##name,
+enum latency_phase {
+    METRICS_LATENCIES(LATENCY_ENUM)
+    LATENCY_COUNT
+};
+#undef LATENCY_ENUM
+
+/*
+ * Destinos y usuarios que mas cargan al servidor, por cantidad de
+ * conexiones y por bytes. Cada combinacion es un topk de memoria fija.
+ * Solo se usan desde el hilo del selector.
+ */
+enum top_dimension {
+    TOP_DESTINATIONS,
+    TOP_USERS,
+    TOP_DIMENSION_COUNT
+};
+
+enum top_measure {
+    TOP_CONNECTIONS,
+    TOP_BYTES,
+    TOP_MEASURE_COUNT
+};
+
+#define TOP_DEFAULT_SIZE 32
+#define TOP_DEFAULT_WIDTH 4096
+
+void metrics_add(enum metric_counter counter, long value);
+long metrics_get(enum metric_counter counter);
+const char * metrics_description(enum metric_counter counter);
+/** nombre con el que se exporta el contador (sin sufijos) */
+const char * metrics_family(enum metric_counter counter);
+enum metric_type metrics_type(enum metric_counter counter);
+
+/** reloj monotonico en microsegundos, para medir latencias */
+uint64_t metrics_now_usec();
+void metrics_record_latency(enum latency_phase phase, uint64_t usec);
+histogram * metrics_get_latency(enum latency_phase phase);
+const char * metrics_latency_name(enum latency_phase phase);
+
+/** `k' claves por lista y `width' contadores por fila de sketch. -1 si no hay memoria */
+int metrics_top_init(size_t k, size_t width);
+void metrics_top_add(enum top_dimension dimension, const char * key, size_t len,
+                     uint64_t hash, long connections, long bytes);
+/** NULL si no se inicializo */
+topk * metrics_get_top(enum top_dimension dimension, enum top_measure measure);
+
 void start_metrics();
 void add_socks_connection();
 void add_mgmt_connection();
@@ -31,4 +135,4 @@ long get_current_total();
 long get_bytes_transferred();
 void free_metrics();
 
-#endif
\ No newline at end of file
+#endif
@@ -190,6 +190,21 @@ selector_set_interest(fd_selector s, int fd, fd_interest i);
 selector_status
 selector_set_interest_key(struct selector_key *key, fd_interest i);
 
+/** prioridades de despacho, de 0 (la de todo fd al registrarse) a
+    SELECTOR_PRIORITIES - 1 */
+#define SELECTOR_PRIORITIES 2
+
+/**
+ * en cada iteracion los fds listos de mayor prioridad se despachan antes
+ * que los de menor. Todos los listos se despachan en la misma iteracion.
+ */
+selector_status
+selector_set_priority(fd_selector s, int fd, unsigned priority);
+
+
+/** cambia el timeout de select(); aplica desde la proxima iteración */
+void
+selector_set_timeout(fd_selector s, struct timespec timeout);
 
 /**
  * se bloquea hasta que hay eventos disponible y los despacha.
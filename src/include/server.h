@@ -9,6 +9,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "buffer.h"
 #include "netutils.h"
@@ -20,9 +22,13 @@
 
 const struct fd_handler * get_conn_actions_handler();
 const struct fd_handler * get_mng_conn_actions_handler();
-void start_server(char * socks_addr, char * socks_port, char * mng_addr, char * mng_port);
+void start_server(char * socks_addr, char * socks_port, char * mng_addr, char * mng_port,
+                  char * metrics_addr, char * metrics_port);
 // void close_socks_conn(socks_conn_model * connection);
 void cleanup();
 void set_selector(fd_selector * new_selector);
+/* Aplican los cambios de configuracion (ver config.h) */
+void server_set_backlog(long backlog);
+void server_set_select_timeout(long seconds);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * topk.c - claves mas pesadas de un stream con memoria fija
+ *
+ * Combina un count-min sketch (con actualizacion conservadora) que estima
+ * el peso acumulado de cualquier clave, con una lista Space-Saving de las
+ * `k' claves con mayor estimacion, ordenada como min-heap. Una clave nueva
+ * solo desplaza al minimo de la lista si su estimacion lo supera, asi las
+ * claves pesadas no son expulsadas por una rafaga de claves unicas.
+ *
+ * Las estimaciones nunca subestiman el peso real. Toda la memoria se reserva
+ * en topk_new, sin importar cuantas claves distintas se vean despues.
+ *
+ * No es thread safe: se usa desde el hilo del selector.
+ */
+
+/* Claves mas largas se truncan (un FQDN mas ":puerto" entra completo) */
+#define TOPK_KEY_SIZE 264
+#define TOPK_SKETCH_DEPTH 4
+
+typedef struct topk topk;
+
+typedef struct topk_item {
+    const char * key;
+    uint64_t hash;
+    uint64_t count;
+} topk_item;
+
+/**
+ * `k' claves en la lista y `width' contadores por fila del sketch
+ * (se redondea a la siguiente potencia de 2). NULL si no hay memoria.
+ */
+topk * topk_new(size_t k, size_t width);
+
+void topk_free(topk * t);
+
+/** hash de una clave, para calcularlo una unica vez por clave */
+uint64_t topk_hash(const char * key, size_t len);
+
+/** suma `weight' al peso de la clave */
+void topk_add(topk * t, const char * key, size_t len, uint64_t hash, uint64_t weight);
+
+/** peso estimado de cualquier clave, este o no en la lista */
+uint64_t topk_estimate(const topk * t, uint64_t hash);
+
+/**
+ * copia en `out' hasta `n' claves de la lista, de mayor a menor peso.
+ * Retorna la cantidad copiada.
+ */
+size_t topk_list(const topk * t, topk_item * out, size_t n);
+
+/** bytes reservados por la estructura */
+size_t topk_memory(const topk * t);
+
+#endif
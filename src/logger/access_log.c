@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "access_log.h"
+#include "access_log_format.h"
+#include "../include/metrics.h"
+#include "../include/clocks.h"
+#include "../parsers/req_parser.h"
+
+#define RING_MASK (ACCESS_LOG_RING_SIZE - 1)
+#define CACHE_LINE_SIZE 64
+#define BATCH_SIZE (64 * 1024)
+#define LINE_MAX_SIZE 1024              /* longest formatted record */
+#define IDLE_MIN_NSEC 1000000L          /* writer back-off when the ring is empty */
+#define IDLE_MAX_NSEC 50000000L
+#define PATH_SIZE 4096
+
+static struct{
+    alignas(CACHE_LINE_SIZE) atomic_size_t head;    // next record to publish (producer)
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail;    // next record to format (writer)
+    alignas(CACHE_LINE_SIZE) struct access_record records[ACCESS_LOG_RING_SIZE];
+} ring;
+
+static char batch[BATCH_SIZE];
+static pthread_t writer_thread;
+static atomic_bool running;
+static bool started = false;
+
+/* Binary output, only touched by the writer thread once started */
+static char * segment_dir = NULL;
+static struct{
+    int fd;
+    struct access_log_header * header;
+    struct access_log_entry * entries;
+    size_t map_size;
+    unsigned sequence;
+} segment = {.fd = -1};
+
+struct access_record *
+access_log_reserve(){
+    size_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    if(head - tail == ACCESS_LOG_RING_SIZE){
+        metrics_add(METRIC_ACCESS_LOG_DROPS, 1);
+        return NULL;
+    }
+    return &ring.records[head & RING_MASK];
+}
+
+void
+access_log_commit(){
+    size_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+}
+
+/* Records in a batch usually share the second: format it once. The
+   selector thread has its own cache (clocks.h), this one is the writer's */
+static const char *
+format_time(int64_t seconds){
+    static int64_t last = -1;
+    static char time_buff[sizeof("2022-11-19T12:00:00Z")];
+    if(seconds != last){
+        time_t now = (time_t)seconds;
+        struct tm tp;
+        gmtime_r(&now, &tp);
+        strftime(time_buff, sizeof(time_buff), "%Y-%m-%dT%H:%M:%SZ", &tp);
+        last = seconds;
+    }
+    return time_buff;
+}
+
+static size_t
+format_record(const struct access_record * r, char * out){
+    char src[INET6_ADDRSTRLEN] = {0};
+    char dst[INET6_ADDRSTRLEN] = {0};
+    inet_ntop(r->src_family, r->src_addr, src, sizeof(src));
+    if(r->dst_type == IPv4)
+        inet_ntop(AF_INET, r->dst_addr, dst, sizeof(dst));
+    else if(r->dst_type == IPv6)
+        inet_ntop(AF_INET6, r->dst_addr, dst, sizeof(dst));
+
+    int len = snprintf(out, LINE_MAX_SIZE, "%s\t%s\t%s\t%s\t%d\t%s\t%d\t%d\t\n",
+                       format_time(r->time), r->user[0] == '\0' ? "¿?" : r->user, "A",
+                       src, r->src_port, r->dst_type == FQDN ? r->fqdn : dst,
+                       r->dst_port, r->reply);
+    if(len < 0) return 0;
+    return (size_t)len < LINE_MAX_SIZE ? (size_t)len : LINE_MAX_SIZE - 1;
+}
+
+/* ----------------------------- binary segments ----------------------------- */
+
+/* Unused space is given back so closed segments take only what they hold */
+static void
+segment_close(){
+    if(segment.fd == -1)
+        return;
+    size_t used = sizeof(struct access_log_header)
+                + segment.header->count * sizeof(struct access_log_entry);
+    munmap(segment.header, segment.map_size);
+    if(ftruncate(segment.fd, used) == -1)
+        perror("access log: ftruncate");
+    close(segment.fd);
+    segment.fd = -1;
+}
+
+static int
+segment_open(){
+    /* Same clocks as the records (clocks.h), read uncached from this thread */
+    uint64_t wall = clocks_coarse_wall_ns();
+    uint64_t mono = clocks_coarse_mono_ns();
+    char path[PATH_SIZE];
+    int fd = -1;
+    /* Segments left by a previous run in the same second are kept */
+    for(int tries = 0; fd == -1 && tries < 100; tries++){
+        snprintf(path, sizeof(path), "%s/access-%llu-%04u" ACCESS_LOG_SUFFIX, segment_dir,
+                 (unsigned long long)(wall / 1000000000ULL), segment.sequence++ % 10000);
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0640);
+        if(fd == -1 && errno != EEXIST)
+            break;
+    }
+    if(fd == -1){
+        perror("access log: open");
+        return -1;
+    }
+    size_t size = sizeof(struct access_log_header)
+                + (size_t)ACCESS_LOG_SEGMENT_ENTRIES * sizeof(struct access_log_entry);
+    void * map = MAP_FAILED;
+    if(ftruncate(fd, size) == -1 ||
+       (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED){
+        perror("access log: segment");
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+
+    segment.fd = fd;
+    segment.map_size = size;
+    segment.header = map;
+    segment.entries = (struct access_log_entry *)(segment.header + 1);
+
+    struct access_log_header * h = segment.header;
+    memcpy(h->magic, ACCESS_LOG_MAGIC, sizeof(h->magic));
+    h->version = ACCESS_LOG_VERSION;
+    h->byte_order = ACCESS_LOG_BYTE_ORDER;
+    h->header_size = sizeof(struct access_log_header);
+    h->entry_size = sizeof(struct access_log_entry);
+    h->anchor_wall_ns = wall;
+    h->anchor_mono_ns = mono;
+    h->capacity = ACCESS_LOG_SEGMENT_ENTRIES;
+    return 0;
+}
+
+/* Records queued before the segment was opened are older than its anchor:
+   the difference is signed so they do not count as expired */
+static bool
+segment_expired(uint64_t mono_ns){
+    return segment.fd != -1 &&
+           (int64_t)(mono_ns - segment.header->anchor_mono_ns)
+               >= (int64_t)ACCESS_LOG_ROTATE_SECONDS * 1000000000LL;
+}
+
+static inline uint8_t
+family_version(int family){
+    return family == AF_INET ? 4 : family == AF_INET6 ? 6 : ACCESS_LOG_NO_ADDR;
+}
+
+static void
+segment_append(const struct access_record * r){
+    if(segment_expired(r->mono_ns) ||
+       (segment.fd != -1 && segment.header->count == segment.header->capacity))
+        segment_close();
+    if(segment.fd == -1 && segment_open() == -1){
+        metrics_add(METRIC_ACCESS_LOG_DROPS, 1);
+        return;
+    }
+
+    struct access_log_header * h = segment.header;
+    struct access_log_entry * e = &segment.entries[h->count];
+    e->mono_ns = r->mono_ns;
+    e->session = r->session;
+    memcpy(e->src_addr, r->src_addr, sizeof(e->src_addr));
+    memcpy(e->dst_addr, r->dst_addr, sizeof(e->dst_addr));
+    e->src_port = htons(r->src_port);
+    e->dst_port = htons(r->dst_port);
+    e->src_family = family_version(r->src_family);
+    e->dst_family = family_version(r->dst_family);
+    e->dst_type = r->dst_type;
+    e->reply = r->reply;
+
+    if(h->count == 0){
+        /* The segment is anchored on its first record, so its entries never
+           precede the anchor and the rotation period starts with them */
+        h->anchor_wall_ns += r->mono_ns - h->anchor_mono_ns;
+        h->anchor_mono_ns = r->mono_ns;
+        h->first_mono_ns = r->mono_ns;
+    }
+    h->last_mono_ns = r->mono_ns;
+    /* Published last: readers of an open segment only see complete entries */
+    h->count++;
+}
+
+/* ------------------------------- text output ------------------------------- */
+
+static void
+write_all(const char * data, size_t len){
+    while(len > 0){
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static void *
+writer(void * arg){
+    long idle = IDLE_MIN_NSEC;
+    while(true){
+        size_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+        if(tail == head){
+            if(!atomic_load(&running))
+                break;
+            if(segment_expired(clocks_coarse_mono_ns()))
+                segment_close();
+            struct timespec wait = {0, idle};
+            nanosleep(&wait, NULL);
+            idle = idle * 2 > IDLE_MAX_NSEC ? IDLE_MAX_NSEC : idle * 2;
+            continue;
+        }
+        idle = IDLE_MIN_NSEC;
+
+        if(segment_dir != NULL){
+            for(; tail != head; tail++)
+                segment_append(&ring.records[tail & RING_MASK]);
+            atomic_store_explicit(&ring.tail, tail, memory_order_release);
+            continue;
+        }
+
+        size_t len = 0;
+        while(tail != head && len + LINE_MAX_SIZE <= BATCH_SIZE){
+            len += format_record(&ring.records[tail & RING_MASK], batch + len);
+            tail++;
+        }
+        /* The records are already copied into the batch: free their slots
+           before the (possibly slow) write */
+        atomic_store_explicit(&ring.tail, tail, memory_order_release);
+        write_all(batch, len);
+    }
+    segment_close();
+    return NULL;
+}
+
+int
+access_log_set_directory(const char * dir){
+    if(access(dir, W_OK | X_OK) == -1)
+        return -1;
+    size_t len = strlen(dir) + 1;
+    if(len > PATH_SIZE - sizeof("/access-18446744073709551615-0000" ACCESS_LOG_SUFFIX))
+        return -1;
+    free(segment_dir);
+    segment_dir = malloc(len);
+    if(segment_dir == NULL)
+        return -1;
+    memcpy(segment_dir, dir, len);
+    return 0;
+}
+
+int
+access_log_start(){
+    atomic_init(&ring.head, 0);
+    atomic_init(&ring.tail, 0);
+    atomic_init(&running, true);
+    if(pthread_create(&writer_thread, NULL, writer, NULL) != 0)
+        return -1;
+    started = true;
+    return 0;
+}
+
+void
+access_log_stop(){
+    if(!started)
+        return;
+    started = false;
+    atomic_store(&running, false);
+    pthread_join(writer_thread, NULL);
+    free(segment_dir);
+    segment_dir = NULL;
+}
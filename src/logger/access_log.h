@@ -0,0 +1,63 @@
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+            ACCESS_LOG.h
+Access log written off the event loop.
+
+The selector thread reserves a fixed-size binary record in a lock-free
+single producer / single consumer ring, fills it and publishes it. A
+background thread formats the published records and writes them to stdout
+in batches, so a slow pipe or disk never blocks the proxy.
+
+When the ring is full the record is dropped and counted
+(METRIC_ACCESS_LOG_DROPS) instead of waiting for the writer.
+
+With access_log_set_directory the writer stores the records in the binary
+format of access_log_format.h instead of text: segments are mmap'd files in
+that directory, rotated when full or every ACCESS_LOG_ROTATE_SECONDS.
+*/
+
+#define ACCESS_LOG_RING_SIZE 1024       /* records, power of 2 */
+#define ACCESS_USER_SIZE 256
+#define ACCESS_HOST_SIZE 256
+#define ACCESS_LOG_SEGMENT_ENTRIES (1 << 18)    /* 16 MiB segments */
+#define ACCESS_LOG_ROTATE_SECONDS 3600
+
+struct access_record{
+    int64_t time;                       // wall clock, seconds
+    uint64_t mono_ns;                   // CLOCK_MONOTONIC_COARSE
+    uint64_t session;
+    uint16_t src_port;                  // host byte order
+    uint16_t dst_port;                  // host byte order
+    uint8_t src_family;                 // AF_INET or AF_INET6
+    uint8_t dst_type;                   // enum req_atyp
+    uint8_t dst_family;                 // of dst_addr, AF_UNSPEC if none
+    uint8_t reply;                      // enum res_state
+    uint8_t src_addr[16];
+    uint8_t dst_addr[16];               // for FQDN, the address connected to
+    char user[ACCESS_USER_SIZE];        // empty for unauthenticated sessions
+    char fqdn[ACCESS_HOST_SIZE];        // FQDN destinations
+};
+
+/* Switches the log to the binary format, writing segments in `dir'. Must be
+   called before access_log_start. Returns -1 if `dir' is not writable. */
+int access_log_set_directory(const char * dir);
+
+/* Starts the writer thread. Returns -1 on error. */
+int access_log_start();
+
+/* Writes what is left in the ring and stops the writer thread */
+void access_log_stop();
+
+/* Producer side, selector thread only. Returns the next free record or NULL
+   (and counts the drop) when the ring is full. */
+struct access_record * access_log_reserve();
+
+/* Publishes the record returned by the last access_log_reserve */
+void access_log_commit();
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef ACCESS_LOG_FORMAT_H
+#define ACCESS_LOG_FORMAT_H
+
+#include <stdint.h>
+
+/*
+            ACCESS_LOG_FORMAT.h
+On-disk layout of the binary access log, shared by the server and the
+socks5log decoder.
+
+A segment is a file holding a header followed by fixed-width entries in
+the order they were written, so entries are sorted by timestamp and a time
+range can be located with a binary search. Timestamps are
+CLOCK_MONOTONIC_COARSE nanoseconds; the header keeps a wall clock /
+monotonic pair from the same coarse clocks, aligned with the first entry,
+to turn them into dates.
+
+All integers are in the byte order of the host that wrote the segment
+(ACCESS_LOG_BYTE_ORDER tells it apart). Addresses and ports are raw, as
+they travel on the wire.
+*/
+
+#define ACCESS_LOG_MAGIC "S5ALOG\0"
+#define ACCESS_LOG_VERSION 1
+#define ACCESS_LOG_BYTE_ORDER 0x01020304u
+#define ACCESS_LOG_SUFFIX ".s5log"
+
+/* dst_family when the destination has no address (FQDN that did not
+   resolve). FQDN destinations are logged with the address connected to. */
+#define ACCESS_LOG_NO_ADDR 0
+
+struct access_log_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    uint32_t entry_size;
+    uint64_t anchor_wall_ns;            // wall clock at the first entry
+    uint64_t anchor_mono_ns;            // monotonic clock at the same instant
+    uint64_t capacity;                  // entries that fit in the file
+    uint64_t count;                     // entries written so far
+    uint64_t first_mono_ns;
+    uint64_t last_mono_ns;
+    uint8_t reserved[56];
+};
+
+struct access_log_entry{
+    uint64_t mono_ns;
+    uint64_t session;
+    uint8_t src_addr[16];               // IPv4 addresses use the first 4 bytes
+    uint8_t dst_addr[16];
+    uint16_t src_port;                  // network byte order
+    uint16_t dst_port;                  // network byte order
+    uint8_t src_family;                 // 4 or 6
+    uint8_t dst_family;                 // 4, 6 or ACCESS_LOG_NO_ADDR
+    uint8_t dst_type;                   // SOCKS ATYP of the request
+    uint8_t reply;                      // SOCKS reply code
+    uint8_t reserved[8];
+};
+
+_Static_assert(sizeof(struct access_log_header) == 128, "access log header layout");
+_Static_assert(sizeof(struct access_log_entry) == 64, "access log entry layout");
+
+#endif
@@ -4,58 +4,35 @@
  * Implementación de "logger.h".
  */
 
-static bool log = false;
+int logLevel = LOG_LEVEL_NONE;
 
 void setLogOn(){ 
 	printf("Setting logger ON...\n");
-	log = true; }
+	logLevel = LOG_LEVEL_DEBUG; }
 void setLogOff(){ 
 	printf("Setting logger OFF...\n");
-	log = false; 
+	logLevel = LOG_LEVEL_NONE; 
 	}
 
+void setLogLevel(int level){
+	if(level < LOG_LEVEL_DEBUG) level = LOG_LEVEL_DEBUG;
+	if(level > LOG_LEVEL_NONE) level = LOG_LEVEL_NONE;
+	logLevel = level;
+}
+
+int getLogLevel(){ return logLevel; }
+
 void Log(FILE * const stream, const char * prefix, const char * const format, const char * suffix, va_list arguments) {
-	if(log){
 	fprintf(stream, "%s", prefix);
 	vfprintf(stream, format, arguments);
 	fprintf(stream, "%s", suffix);
-	}
-}
-
-void LogDebug(const char * const format, ...) {
-	if(log){
-	va_list arguments;
-	va_start(arguments, format);
-	Log(stdout, "[DEBUG] ", format, "\n", arguments);
-	va_end(arguments);
-	}
-}
-
-void LogError(const char * const format, ...) {
-	if(log){
-	va_list arguments;
-	va_start(arguments, format);
-	Log(stderr, "[ERROR] ", format, "\n", arguments);
-	va_end(arguments);
-	}
-}
-
-void LogErrorRaw(const char * const format, ...) {
-	if(log){
-	va_list arguments;
-	va_start(arguments, format);
-	Log(stderr, "", format, "", arguments);
-	va_end(arguments);
-	}
 }
 
-void LogInfo(const char * const format, ...) {
-	if(log){
+void LogWrite(FILE * const stream, const char * prefix, const char * suffix, const char * const format, ...) {
 	va_list arguments;
 	va_start(arguments, format);
-	Log(stdout, "[INFO ] ", format, "\n", arguments);
+	Log(stream, prefix, format, suffix, arguments);
 	va_end(arguments);
-	}
 }
 
 char * get_ip_address(struct sockaddr_storage *addr) {
@@ -84,81 +61,130 @@ int get_port(struct sockaddr_storage *addr) {
     }
 }
 
+/* Hot path: the record is filled in place in the access log ring and
+   formatted later by the writer thread */
 void
 conn_information(socks_conn_model * connection){
 	struct req_parser * parser = connection->parsers->req_parser;
-	// Time string in ISO-8601 format 
-	// (quoted from top answer in:
-	// https://stackoverflow.com/questions/9527960/how-do-i-construct-an-iso-8601-datetime-in-c)
-	time_t now;
-    time(&now);
-	struct tm tp; //Slight tweak for time zone with respect to S.O.'s answer
-    char time_buff[sizeof("2022-11-19T12:00:00Z")];
-	localtime_r(&now, &tp);
-    strftime(time_buff, sizeof(time_buff), "%FT%TZ", &tp);
-    
-
-	//Username (¿Hay uno loggeado?)
-	char * username = get_curr_user();
-	username = username==NULL?"¿?":username;
+	struct access_record * record = access_log_reserve();
+	if(record == NULL)
+		return;
+
+	record->time = clocks_wall_sec();
+	record->mono_ns = clocks_mono_ns();
+	record->session = connection->id;
+	record->reply = parser->res_parser.state;
+	record->dst_type = parser->type;
+	record->dst_port = ntohs(parser->port);
+	record->dst_family = AF_UNSPEC;
+	memset(record->dst_addr, 0, sizeof(record->dst_addr));
+	switch(parser->type){
+		case IPv4:
+			record->dst_family = AF_INET;
+			memcpy(record->dst_addr, &parser->addr.ipv4.sin_addr, IPv4_BYTES);
+			break;
+		case IPv6:
+			record->dst_family = AF_INET6;
+			memcpy(record->dst_addr, parser->addr.ipv6.sin6_addr.s6_addr, IPv6_BYTES);
+			break;
+		default:
+			memcpy(record->fqdn, parser->addr.fqdn, sizeof(record->fqdn) - 1);
+			record->fqdn[sizeof(record->fqdn) - 1] = '\0';
+			/* The name is not kept by the binary log: record where it led */
+			if(parser->res_parser.state == RES_SUCCESS){
+				struct sockaddr * addr = (struct sockaddr *) &connection->src_conn->addr;
+				record->dst_family = addr->sa_family;
+				if(addr->sa_family == AF_INET)
+					memcpy(record->dst_addr, &((struct sockaddr_in *)addr)->sin_addr, IPv4_BYTES);
+				else if(addr->sa_family == AF_INET6)
+					memcpy(record->dst_addr, ((struct sockaddr_in6 *)addr)->sin6_addr.s6_addr, IPv6_BYTES);
+			}
+			break;
+	}
 
-	//Register type
-	char * reg_type = "A";
+	struct sockaddr_storage * src = &connection->cli_conn->addr;
+	record->src_family = src->ss_family;
+	memset(record->src_addr, 0, sizeof(record->src_addr));
+	if(src->ss_family == AF_INET6){
+		struct sockaddr_in6 * addr = (struct sockaddr_in6 *) src;
+		memcpy(record->src_addr, addr->sin6_addr.s6_addr, IPv6_BYTES);
+		record->src_port = ntohs(addr->sin6_port);
+	} else {
+		struct sockaddr_in * addr = (struct sockaddr_in *) src;
+		memcpy(record->src_addr, &addr->sin_addr, IPv4_BYTES);
+		record->src_port = ntohs(addr->sin_port);
+	}
+
+	const char * username = socks_get_username(connection);
+	size_t len = 0;
+	if(username != NULL){
+		len = strlen(username);
+		if(len >= ACCESS_USER_SIZE) len = ACCESS_USER_SIZE - 1;
+		memcpy(record->user, username, len);
+	}
+	record->user[len] = '\0';
+
+	access_log_commit();
+}
+
+/* Se copian los datos de la conexion: con socks5d -w las credenciales se
+   informan cuando el worker las encuentra, y la conexion puede haberse
+   cerrado para entonces */
+void
+sniff_origin_init(socks_conn_model * connection, struct sniff_origin * origin){
+	struct req_parser * parser = connection->parsers->req_parser;
 
-	//IP origin address
-	char buff[INET6_ADDRSTRLEN]={0};
-	if(parser->type != FQDN){
+	char * username = get_curr_user();
+	snprintf(origin->username, sizeof(origin->username), "%s", username == NULL ? "¿?" : username);
+
+	origin->client[0] = '\0';
+	struct sockaddr_storage * addr = &connection->cli_conn->addr;
+	if(addr->ss_family == AF_INET)
+		inet_ntop(AF_INET, &((struct sockaddr_in *) addr)->sin_addr, origin->client, sizeof(origin->client));
+	else if(addr->ss_family == AF_INET6)
+		inet_ntop(AF_INET6, &((struct sockaddr_in6 *) addr)->sin6_addr, origin->client, sizeof(origin->client));
+	else
+		strcpy(origin->client, "unknown");
+	origin->client_port = get_port(addr);
+
+	if(parser->type == FQDN){
+		snprintf(origin->destination, sizeof(origin->destination), "%s", (char *)parser->addr.fqdn);
+	} else {
 		inet_ntop(parser->type == IPv4 ? AF_INET : AF_INET6, 
 				parser->type == IPv4?
 				(uint8_t *)&(parser->addr.ipv4.sin_addr):parser->addr.ipv6.sin6_addr.s6_addr, 
-				buff, 
-				parser->type == IPv4 ? INET_ADDRSTRLEN : INET6_ADDRSTRLEN);
+				origin->destination, sizeof(origin->destination));
 	}
-	char * ipAddress = get_ip_address(&(connection->cli_conn->addr));
-	printf("%s\t%s\t%s\t%s\t%d\t%s\t%d\t%d\t\n", 
-			time_buff, username, reg_type, 
-			ipAddress,
-			get_port(&(connection->cli_conn->addr)), 
-			parser->type==FQDN?(char*)parser->addr.fqdn:buff,
-			parser->port, parser->res_parser.state);
-	fflush(stdout);
-	free(ipAddress);
+	origin->destination_port = ntohs(parser->port);
 }
 
+/* Guarda la credencial en el store y la imprime */
 void
-pass_information(socks_conn_model * connection){
-	struct req_parser * parser = connection->parsers->req_parser;
-	struct pop3_parser * pop3_parser = connection->pop3_parser;
-	time_t now;
-    time(&now);
-	struct tm tp;
-    char time_buff[sizeof("2022-11-19T12:00:00Z")];
-	localtime_r(&now, &tp);
-    strftime(time_buff, sizeof(time_buff), "%FT%TZ", &tp);
-	
-	char * username = get_curr_user();
-	username = username==NULL?"¿?":username;
+report_credentials(const struct sniff_origin * origin, enum dissector_protocol protocol_id,
+				   const char * user, const char * password){
+	cred_store_add(origin, protocol_id, user, password);
+
+	const char * time_buff = clocks_iso8601();
+	const char * protocol = dissectors[protocol_id]->name;
 
 	//Register type
 	char * reg_type = "P";
-	char * protocol = "POP3"; // TODO: man dice HTTP, deberíamos considerarlo?
 
-	char buff[INET6_ADDRSTRLEN]={0};
-	if(parser->type != FQDN){
-		inet_ntop(parser->type == IPv4 ? AF_INET : AF_INET6, 
-				parser->type == IPv4?
-				(uint8_t *)&(parser->addr.ipv4.sin_addr):parser->addr.ipv6.sin6_addr.s6_addr, 
-				buff, 
-				parser->type == IPv4 ? INET_ADDRSTRLEN : INET6_ADDRSTRLEN);
-	}
-	char * ipAddress = get_ip_address(&(connection->cli_conn->addr));
-	printf("POP3 sniffing: %s\t%s\t%s\t%s\t%s\t%d\t%s\t%d\t\nUser: %s\nPassword: %s\n", 
-			time_buff, username, reg_type, 
+	printf("%s sniffing: %s\t%s\t%s\t%s\t%s\t%d\t%s\t%d\t\nUser: %s\nPassword: %s\n", 
+			protocol, time_buff, origin->username, reg_type, 
 			protocol,
-			ipAddress,
-			get_port(&(connection->cli_conn->addr)), 
-			parser->type==FQDN?(char*)parser->addr.fqdn:buff,
-			parser->port, pop3_parser->user, pop3_parser->pass
+			origin->client,
+			origin->client_port, 
+			origin->destination,
+			origin->destination_port, user, password
 			);
-	free(ipAddress);
-}
\ No newline at end of file
+}
+
+void
+pass_information(socks_conn_model * connection){
+	struct dissector_session * dissector = connection->dissector;
+	struct sniff_origin origin;
+	sniff_origin_init(connection, &origin);
+	report_credentials(&origin, dissector_session_protocol(dissector),
+					   dissector_user(dissector), dissector_password(dissector));
+}
@@ -21,20 +21,52 @@
 
 #include "../socks5/socks5.h"
 #include "../users/user_mgmt.h"
-#include "../sniffer/pop3_sniffer.h"
+#include "../sniffer/dissector.h"
+#include "../sniffer/cred_store.h"
 #include "../include/netutils.h"
+#include "access_log.h"
+#include "../include/clocks.h"
 
-void setLogOn();
-void setLogOff();
+/*
+ * Niveles de log. Los mensajes de nivel menor a LOG_MIN_LEVEL no se compilan
+ * (make LOG_MIN_LEVEL=2 deja solo los errores); el resto se filtra en runtime
+ * con logLevel antes de evaluar los argumentos, asi un log apagado cuesta una
+ * comparacion que el compilador supone falsa.
+ */
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_NONE  3
 
-void Log(FILE * const stream, const char * prefix, const char * const format, const char * suffix, va_list arguments);
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#ifdef __GNUC__
+#define LOG_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define LOG_UNLIKELY(x) (x)
+#endif
 
-void LogDebug(const char * const format, ...);
+extern int logLevel;
 
-void LogError(const char * const format, ...);
+#define LOG_ENABLED(level) ((level) >= LOG_MIN_LEVEL && LOG_UNLIKELY((level) >= logLevel))
 
-void LogErrorRaw(const char * const format, ...);
+#define LOG_AT(level, stream, prefix, suffix, ...) \
+	do { if(LOG_ENABLED(level)) LogWrite(stream, prefix, suffix, __VA_ARGS__); } while(0)
+
+#define LogDebug(...)    LOG_AT(LOG_LEVEL_DEBUG, stdout, "[DEBUG] ", "\n", __VA_ARGS__)
+#define LogInfo(...)     LOG_AT(LOG_LEVEL_INFO, stdout, "[INFO ] ", "\n", __VA_ARGS__)
+#define LogError(...)    LOG_AT(LOG_LEVEL_ERROR, stderr, "[ERROR] ", "\n", __VA_ARGS__)
+#define LogErrorRaw(...) LOG_AT(LOG_LEVEL_ERROR, stderr, "", "", __VA_ARGS__)
+
+void setLogOn();
+void setLogOff();
+void setLogLevel(int level);
+int getLogLevel();
+
+void Log(FILE * const stream, const char * prefix, const char * const format, const char * suffix, va_list arguments);
 
-void LogInfo(const char * const format, ...);
+void LogWrite(FILE * const stream, const char * prefix, const char * suffix, const char * const format, ...);
 
 #endif
@@ -0,0 +1,57 @@
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define RING_MASK (TRACE_RING_SIZE - 1)
+
+bool trace_enabled = false;
+
+static struct trace_event ring[TRACE_RING_SIZE];
+static uint64_t head = 0;               // events emitted since enabled
+
+static const char * point_names[] = {
+#define TRACE_NAME(name, label) label,
+    TRACEPOINTS(TRACE_NAME)
+#undef TRACE_NAME
+};
+
+void
+trace_emit(enum tracepoint point, int fd, uint64_t session, uint64_t a, uint64_t b){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct trace_event * e = &ring[head++ & RING_MASK];
+    e->mono_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    e->session = session;
+    e->a = a;
+    e->b = b;
+    e->fd = fd;
+    e->point = point;
+}
+
+int
+trace_set_enabled(bool enabled){
+#ifdef NO_TRACE
+    if(enabled)
+        return -1;
+#endif
+    if(enabled && !trace_enabled)
+        head = 0;
+    trace_enabled = enabled;
+    return 0;
+}
+
+size_t
+trace_last(struct trace_event * out, size_t n){
+    uint64_t available = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+    if(n > available)
+        n = available;
+    for(size_t i = 0; i < n; i++)
+        out[i] = ring[(head - n + i) & RING_MASK];
+    return n;
+}
+
+const char *
+trace_point_name(uint32_t point){
+    return point < TRACEPOINT_COUNT ? point_names[point] : "unknown";
+}
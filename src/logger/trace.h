@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+            TRACE.h
+Static tracepoints for the hot paths of the event loop.
+
+Each TRACE() site costs a single predicted-not-taken branch on a global
+flag while tracing is off, and compiles to nothing with -DNO_TRACE
+(make TRACE=0). When tracing is on, events are stored in a fixed
+flight-recorder ring that keeps the last TRACE_RING_SIZE events and is
+dumped through the control protocol.
+
+Only the selector thread emits and reads events, so the ring takes no locks.
+*/
+
+#define TRACE_RING_SIZE 4096            /* events, power of 2 */
+
+/* X(name, label): the meaning of `a' and `b' for each point is on the right */
+#define TRACEPOINTS(X) \
+    X(STM_JUMP,      "stm_jump")        /* a: previous state, b: next state */ \
+    X(SOCKS_ACCEPT,  "socks_accept")    /* a: client address family */ \
+    X(SOCKS_REQUEST, "socks_request")   /* a: address type, b: reply */ \
+    X(SOCKS_CLOSE,   "socks_close")     /* a: last state */
+
+enum tracepoint{
+#define TRACE_ENUM(name, label) TRACE_##name,
+    TRACEPOINTS(TRACE_ENUM)
+#undef TRACE_ENUM
+    TRACEPOINT_COUNT
+};
+
+struct trace_event{
+    uint64_t mono_ns;
+    uint64_t session;                   // 0 when the point has no session
+    uint64_t a;
+    uint64_t b;
+    int32_t fd;
+    uint32_t point;                     // enum tracepoint
+};
+
+#ifdef __GNUC__
+#define TRACE_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define TRACE_UNLIKELY(x) (x)
+#endif
+
+extern bool trace_enabled;
+
+void trace_emit(enum tracepoint point, int fd, uint64_t session, uint64_t a, uint64_t b);
+
+#ifdef NO_TRACE
+#define TRACE(point, fd, session, a, b) ((void) 0)
+#else
+#define TRACE(point, fd, session, a, b) \
+    do { if(TRACE_UNLIKELY(trace_enabled)) \
+        trace_emit(TRACE_##point, (fd), (session), (a), (b)); } while(0)
+#endif
+
+/* Turns tracing on or off. Turning it on clears the ring. Returns -1 if
+   the server was compiled without tracepoints. */
+int trace_set_enabled(bool enabled);
+
+/* Copies the last `n' events into `out', oldest first. Returns how many */
+size_t trace_last(struct trace_event * out, size_t n);
+
+const char * trace_point_name(uint32_t point);
+
+#endif
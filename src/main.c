@@ -33,6 +33,9 @@
 #include "include/stm.h"
 #include "logger/logger.h"
 #include "include/metrics.h"
+#include "acl/acl.h"
+#include "acl/domain_acl.h"
+#include "include/config.h"
 
 #define DEST_PORT 9090
 #define MAX_ADDR_BUFFER 128
@@ -53,7 +56,7 @@ static void
 start_selector(){
     // Initialization of selector struct
     struct timespec select_timeout = {0};
-    select_timeout.tv_sec = 100;
+    select_timeout.tv_sec = config_get(CONFIG_SELECT_TIMEOUT);
     struct selector_init select_init_struct = {SIGCHLD, select_timeout};
 
     // Configure the selector
@@ -81,12 +84,47 @@ main(const int argc, char ** argv) {
     struct socks5args args;
     parse_args(argc, argv, &args);
     close(STDIN_FILENO);
+    if(args.acl_file != NULL && acl_load(args.acl_file) < 0){
+        fprintf(stderr, "Could not load ACL file %s\n", args.acl_file);
+        exit(1);
+    }
+    if(args.domain_list_file != NULL && domain_acl_load(args.domain_list_file) < 0){
+        fprintf(stderr, "Could not load domain list %s\n", args.domain_list_file);
+        exit(1);
+    }
     start_metrics();
+    if(args.accounting_file != NULL && accounting_open(args.accounting_file) == -1){
+        fprintf(stderr, "Cannot keep the accounting in %s\n", args.accounting_file);
+        exit(1);
+    }
+    if(args.access_log_dir != NULL && access_log_set_directory(args.access_log_dir) == -1){
+        fprintf(stderr, "Cannot write the access log in %s\n", args.access_log_dir);
+        exit(1);
+    }
+    if(access_log_start() == -1){
+        fprintf(stderr, "Could not start the access log writer\n");
+        exit(1);
+    }
+    if(args.sniff_worker && sniff_worker_start() == -1){
+        fprintf(stderr, "Could not start the sniffer worker\n");
+        exit(1);
+    }
+    if(metrics_top_init(args.top_size, args.top_width) == -1){
+        fprintf(stderr, "Could not allocate the top-K tables\n");
+        exit(1);
+    }
     start_selector();   
 
-    start_server(args.socks_addr, args.socks_port, args.mng_addr, args.mng_port);
+    start_server(args.socks_addr, args.socks_port, args.mng_addr, args.mng_port,
+                 args.metrics_addr, args.metrics_port);
 
     free_metrics();
+    acl_free();
+    domain_acl_free();
+    sessions_free();
+    accounting_close();
+    shaper_free();
+    limits_free();
 
     return 0;
 }
\ No newline at end of file
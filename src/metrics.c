@@ -1,77 +1,194 @@
 #include "include/metrics.h"
-#include <stdlib.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+/* Cantidad de bloques de contadores. Si hay mas hilos que bloques, algunos
+   comparten bloque: sigue siendo correcto porque los contadores son atomicos */
+#define METRICS_SHARDS 16
+#define CACHE_LINE_SIZE 64
+
+typedef struct metrics_shard {
+    alignas(CACHE_LINE_SIZE) atomic_long counters[METRIC_COUNT];
+} metrics_shard;
+
+static metrics_shard shards[METRICS_SHARDS];
+static atomic_uint next_shard;
+static _Thread_local metrics_shard * local_shard = NULL;
+
+#define METRIC_DESCRIPTION(name, description, family, type) description,
+static const char * descriptions[] = {
+    METRICS_COUNTERS(METRIC_DESCRIPTION)
+};
+#undef METRIC_DESCRIPTION
+
+#define METRIC_FAMILY(name, description, family, type) family,
+static const char * families[] = {
+    METRICS_COUNTERS(METRIC_FAMILY)
+};
+#undef METRIC_FAMILY
+
+#define METRIC_TYPE(name, description, family, type) METRIC_TYPE_##type,
+static const enum metric_type types[] = {
+    METRICS_COUNTERS(METRIC_TYPE)
+};
+#undef METRIC_TYPE
+
+#define LATENCY_NAME(name, title) title,
+static const char * latency_names[] = {
+    METRICS_LATENCIES(LATENCY_NAME)
+};
+#undef LATENCY_NAME
+
+static histogram latencies[LATENCY_COUNT];
+
+static topk * tops[TOP_DIMENSION_COUNT][TOP_MEASURE_COUNT];
+
+static inline metrics_shard *
+get_local_shard(){
+    if(local_shard == NULL){
+        unsigned i = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed);
+        local_shard = &shards[i % METRICS_SHARDS];
+    }
+    return local_shard;
+}
+
+void metrics_add(enum metric_counter counter, long value){
+    atomic_fetch_add_explicit(&get_local_shard()->counters[counter], value,
+                              memory_order_relaxed);
+}
+
+long metrics_get(enum metric_counter counter){
+    long total = 0;
+    for(int i = 0; i < METRICS_SHARDS; i++){
+        total += atomic_load_explicit(&shards[i].counters[counter], memory_order_relaxed);
+    }
+    return total;
+}
+
+const char * metrics_description(enum metric_counter counter){
+    return descriptions[counter];
+}
+
+const char * metrics_family(enum metric_counter counter){
+    return families[counter];
+}
+
+enum metric_type metrics_type(enum metric_counter counter){
+    return types[counter];
+}
+
+uint64_t metrics_now_usec(){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void metrics_record_latency(enum latency_phase phase, uint64_t usec){
+    histogram_record(&latencies[phase], usec);
+}
+
+histogram * metrics_get_latency(enum latency_phase phase){
+    return &latencies[phase];
+}
+
+const char * metrics_latency_name(enum latency_phase phase){
+    return latency_names[phase];
+}
+
+int metrics_top_init(size_t k, size_t width){
+    for(int d = 0; d < TOP_DIMENSION_COUNT; d++){
+        for(int m = 0; m < TOP_MEASURE_COUNT; m++){
+            tops[d][m] = topk_new(k, width);
+            if(tops[d][m] == NULL)
+                return -1;
+        }
+    }
+    return 0;
+}
 
-typedef struct metrics_t{
-    long historic_socks_connections;
-    long current_socks_connections;
-    long historic_mgmt_connections;
-    long current_mgmt_connections;
-    long bytes_transferred;
-} metrics_t;
+void metrics_top_add(enum top_dimension dimension, const char * key, size_t len,
+                     uint64_t hash, long connections, long bytes){
+    if(tops[dimension][TOP_CONNECTIONS] == NULL)
+        return;
+    topk_add(tops[dimension][TOP_CONNECTIONS], key, len, hash, connections);
+    topk_add(tops[dimension][TOP_BYTES], key, len, hash, bytes);
+}
 
-static metrics_t * metrics;
+topk * metrics_get_top(enum top_dimension dimension, enum top_measure measure){
+    return tops[dimension][measure];
+}
 
 void start_metrics(){
-    metrics = malloc(sizeof(metrics_t));
-    metrics->bytes_transferred = 0;
-    metrics->current_socks_connections = 0;
-    metrics->current_mgmt_connections = 0;
-    metrics->historic_socks_connections = 0;
-    metrics->historic_mgmt_connections = 0;
+    for(int i = 0; i < METRICS_SHARDS; i++){
+        for(int j = 0; j < METRIC_COUNT; j++){
+            atomic_init(&shards[i].counters[j], 0);
+        }
+    }
+    for(int i = 0; i < LATENCY_COUNT; i++){
+        histogram_init(&latencies[i]);
+    }
 }
 
 void add_socks_connection(){
-    metrics->current_socks_connections++;
-    metrics->historic_socks_connections++;
+    metrics_add(METRIC_CURRENT_SOCKS, 1);
+    metrics_add(METRIC_HISTORIC_SOCKS, 1);
 }
 
 void add_mgmt_connection(){
-    metrics->current_mgmt_connections++;
-    metrics->historic_mgmt_connections++;
+    metrics_add(METRIC_CURRENT_MGMT, 1);
+    metrics_add(METRIC_HISTORIC_MGMT, 1);
 }
 
 void remove_current_socks_connection(){
-    metrics->current_socks_connections--;
+    metrics_add(METRIC_CURRENT_SOCKS, -1);
 }
 
 void remove_current_mgmt_connection(){
-    metrics->current_mgmt_connections--;
+    metrics_add(METRIC_CURRENT_MGMT, -1);
 }
 
 void add_bytes_transferred(long bytes){
-    metrics->bytes_transferred += bytes;
+    metrics_add(METRIC_BYTES_TRANSFERRED, bytes);
 }
 
 long get_historic_socks(){
-    return metrics->historic_socks_connections;
+    return metrics_get(METRIC_HISTORIC_SOCKS);
 }
 
 long get_current_socks(){
-    return metrics->current_socks_connections;
+    return metrics_get(METRIC_CURRENT_SOCKS);
 }
 
 long get_historic_mgmt(){
-    return metrics->historic_mgmt_connections;
+    return metrics_get(METRIC_HISTORIC_MGMT);
 }
 
 long get_current_mgmt(){
-    return metrics->current_mgmt_connections;
+    return metrics_get(METRIC_CURRENT_MGMT);
 }
 
 long get_current_total(){
-    return (metrics->current_mgmt_connections + metrics->current_socks_connections);
+    return get_current_mgmt() + get_current_socks();
 }
 
 long get_historic_total(){
-    return (metrics->historic_mgmt_connections + metrics->historic_socks_connections);
+    return get_historic_mgmt() + get_historic_socks();
 }
 
 long get_bytes_transferred(){
-    return metrics->bytes_transferred;
+    return metrics_get(METRIC_BYTES_TRANSFERRED);
 }
 
 void
 free_metrics(){
-    free(metrics);
+    /* Los contadores son estaticos, solo se liberan los topk */
+    for(int d = 0; d < TOP_DIMENSION_COUNT; d++){
+        for(int m = 0; m < TOP_MEASURE_COUNT; m++){
+            topk_free(tops[d][m]);
+            tops[d][m] = NULL;
+        }
+    }
     //free_list(get_sniffed_users());
-}
\ No newline at end of file
+}
@@ -5,6 +5,8 @@ void auth_parser_init(struct auth_parser * parser){
     parser->state = AUTH_VER;
     parser->to_parse = 0;
     parser->where_to = NULL;
+    parser->username[0] = '\0';
+    parser->password[0] = '\0';
 }
 
 void plain_parse_byte(struct auth_parser * parser, uint8_t to_parse){
@@ -57,7 +59,34 @@ void auth_parse_byte(struct auth_parser * parser, uint8_t to_parse){
 }
 
 
+/* Fast path: VER ULEN UNAME PLEN PASSWD whole in the buffer. Lengths are
+   checked before copying; otherwise the byte-wise machine takes over. */
+static bool auth_parse_whole(struct auth_parser * parser, buffer * buff){
+    if(parser->state != AUTH_VER)
+        return false;
+    size_t n;
+    const uint8_t * ptr = buffer_read_ptr(buff, &n);
+    if(n < 3 || ptr[0] != AUTH_VERSION)
+        return false;
+    const size_t ulen = ptr[1];
+    if(n < 3 + ulen)
+        return false;
+    const size_t plen = ptr[2 + ulen];
+    if(n < 3 + ulen + plen)
+        return false;
+
+    memcpy(parser->username, ptr + 2, ulen);
+    parser->username[ulen] = '\0';
+    memcpy(parser->password, ptr + 3 + ulen, plen);
+    parser->password[plen] = '\0';
+    buffer_read_adv(buff, 3 + ulen + plen);
+    parser->state = AUTH_DONE;
+    return true;
+}
+
 enum auth_state auth_parse_full(struct auth_parser * parser, buffer * buff){
+    if(auth_parse_whole(parser, buff))
+        return AUTH_DONE;
     while(buffer_can_read(buff)){
         uint8_t byte = buffer_read(buff);
         auth_parse_byte(parser, byte);
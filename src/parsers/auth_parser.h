@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #define AUTH_VERSION 0x01
 #define MAX_LEN 255
@@ -23,8 +24,8 @@ struct auth_parser{
     enum auth_state state;
     uint8_t to_parse;
     uint8_t * where_to;
-    uint8_t username[MAX_LEN];
-    uint8_t password[MAX_LEN];
+    uint8_t username[MAX_LEN + 1];
+    uint8_t password[MAX_LEN + 1];
 };
 
 void auth_parser_init(struct auth_parser * parser);
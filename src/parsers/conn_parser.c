@@ -56,8 +56,32 @@ conn_parse_byte(struct conn_parser * parser, uint8_t to_parse){
     }
 }
 
+/* Fast path: the whole greeting is already in the buffer, so it is decoded
+   in place and consumed at once. Anything unusual (fragmented or invalid)
+   is left to the byte-wise machine, which reports the errors. */
+static bool
+conn_parse_whole(struct conn_parser * parser, buffer * buff){
+    if(parser->state != CONN_VERSION)
+        return false;
+    size_t n;
+    const uint8_t * ptr = buffer_read_ptr(buff, &n);
+    if(n < 2 || ptr[0] != SOCKS_VERSION)
+        return false;
+    const size_t nmethods = ptr[1];
+    if(n < 2 + nmethods)
+        return false;
+
+    for(size_t i = 0; i < nmethods; i++)
+        set_new_method(parser, ptr[2 + i]);
+    buffer_read_adv(buff, 2 + nmethods);
+    parser->state = CONN_DONE;
+    return true;
+}
+
 enum conn_state 
 conn_parse_full(struct conn_parser * parser, buffer * buff){
+    if(conn_parse_whole(parser, buff))
+        return CONN_DONE;
     while(buffer_can_read(buff)){
         uint8_t to_parse = buffer_read(buff);
         conn_parse_byte(parser, to_parse);
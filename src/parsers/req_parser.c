@@ -12,6 +12,7 @@ req_parser_init(struct req_parser * parser){
     parser->cmd = REQ_CMD_NONE;
     parser->type = ADDR_TYPE_NONE;
     parser->port = 0x00;
+    parser->addr.fqdn[0] = '\0';
 }
 
 void
@@ -114,7 +115,61 @@ req_parse_byte(struct req_parser * parser, uint8_t to_parse){
     }
 }
 
+#define REQ_HEADER_BYTES 4     /* VER CMD RSV ATYP */
+
+/* Fast path: the whole request is in the buffer. The header is validated
+   and the address length known before anything is copied; any other case
+   (fragmented or invalid) goes through the byte-wise machine. */
+static bool
+req_parse_whole(struct req_parser * parser, buffer * buff){
+    if(parser->state != REQ_VER)
+        return false;
+    size_t n;
+    const uint8_t * ptr = buffer_read_ptr(buff, &n);
+    if(n < REQ_HEADER_BYTES + 1 || ptr[0] != SOCKS_VERSION || ptr[2] != 0x00)
+        return false;
+    if(ptr[1] != REQ_CMD_CONNECT && ptr[1] != REQ_CMD_BIND && ptr[1] != REQ_CMD_UDP)
+        return false;
+
+    const uint8_t * addr = ptr + REQ_HEADER_BYTES;
+    size_t addr_len;
+    switch(ptr[3]){
+        case IPv4: addr_len = IPv4_BYTES; break;
+        case IPv6: addr_len = IPv6_BYTES; break;
+        case FQDN: addr_len = 1 + addr[0]; break;
+        default: return false;
+    }
+    const size_t total = REQ_HEADER_BYTES + addr_len + REQ_DST_PORT_BYTES;
+    if(n < total)
+        return false;
+
+    parser->cmd = ptr[1];
+    parser->type = ptr[3];
+    switch(parser->type){
+        case IPv4:
+            memset(&(parser->addr.ipv4), 0, sizeof(parser->addr.ipv4));
+            parser->addr.ipv4.sin_family = AF_INET;
+            memcpy(&(parser->addr.ipv4.sin_addr), addr, IPv4_BYTES);
+            break;
+        case IPv6:
+            memset(&(parser->addr.ipv6), 0, sizeof(parser->addr.ipv6));
+            parser->addr.ipv6.sin6_family = AF_INET6;
+            memcpy(parser->addr.ipv6.sin6_addr.s6_addr, addr, IPv6_BYTES);
+            break;
+        default:
+            memcpy(parser->addr.fqdn, addr + 1, addr[0]);
+            parser->addr.fqdn[addr[0]] = '\0';
+            break;
+    }
+    memcpy(&(parser->port), addr + addr_len, REQ_DST_PORT_BYTES);    // network order
+    buffer_read_adv(buff, total);
+    parser->state = REQ_DONE;
+    return true;
+}
+
 enum req_state req_parse_full(struct req_parser * parser, buffer * buff){
+    if(req_parse_whole(parser, buff))
+        return REQ_DONE;
     while(buffer_can_read(buff)){
         uint8_t to_parse = buffer_read(buff);
         req_parse_byte(parser, to_parse);
@@ -4,6 +4,7 @@
 #include "../include/buffer.h"
 #include <netinet/in.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include "conn_parser.h"
 #include <stdio.h>
 #include <string.h>
@@ -54,7 +55,7 @@ enum req_atyp{
 struct req_dst_addr{
    struct sockaddr_in ipv4;
    struct sockaddr_in6 ipv6;
-   uint8_t fqdn[MAX_FQDN_SIZE];
+   uint8_t fqdn[MAX_FQDN_SIZE + 1];   // NUL terminated
 };
 
 struct res_parser{
@@ -2,6 +2,7 @@
  * selector.c - un muliplexor de entrada salida
  */
 #include "include/selector.h"
+#include "include/clocks.h"
 
 #define N(x) (sizeof(x)/sizeof((x)[0]))
 
@@ -92,6 +93,7 @@ struct item {
    fd_interest         interest;
    const fd_handler   *handler;
    void *              data;
+   unsigned            priority;
 };
 
 /* tarea bloqueante */
@@ -124,6 +126,11 @@ struct fdselector {
     /** fd maximo para usar en select() */
     int max_fd;  // max(.fds[].fd)
 
+    /** fd por el que empieza a despachar la proxima iteracion */
+    int first_fd;
+    /** fds con prioridad mayor a 0 */
+    size_t prioritized;
+
     /** descriptores prototipicos ser usados en select */
     fd_set master_r, master_w;
     /** para ser usado en el select() (recordar que select cambia el valor) */
@@ -346,6 +353,7 @@ selector_register(fd_selector        s,
         item->handler  = handler;
         item->interest = interest;
         item->data     = data;
+        item->priority = 0;
 
         // actualizo colaterales
         if(fd > s->max_fd) {
@@ -386,6 +394,9 @@ selector_unregister_fd(fd_selector       s,
 
     item->interest = OP_NOOP;
     items_update_fdset_for_fd(s, item);
+    if(item->priority > 0) {
+        s->prioritized--;
+    }
 
     memset(item, 0x00, sizeof(*item));
     item_init(item);
@@ -414,6 +425,30 @@ finally:
     return ret;
 }
 
+selector_status
+selector_set_priority(fd_selector s, int fd, unsigned priority) {
+    selector_status ret = SELECTOR_SUCCESS;
+
+    if(NULL == s || INVALID_FD(fd) || priority >= SELECTOR_PRIORITIES) {
+        ret = SELECTOR_IARGS;
+        goto finally;
+    }
+    struct item *item = s->fds + fd;
+    if(!ITEM_USED(item)) {
+        ret = SELECTOR_IARGS;
+        goto finally;
+    }
+    if(item->priority > 0) {
+        s->prioritized--;
+    }
+    if(priority > 0) {
+        s->prioritized++;
+    }
+    item->priority = priority;
+finally:
+    return ret;
+}
+
 selector_status
 selector_set_interest_key(struct selector_key *key, fd_interest i) {
     selector_status ret;
@@ -430,6 +465,12 @@ selector_set_interest_key(struct selector_key *key, fd_interest i) {
 /**
  * se encarga de manejar los resultados del select.
  * se encuentra separado para facilitar el testing
+ *
+ * Cada iteracion empieza por un fd distinto (round robin): como cada lado
+ * de un relay mueve a lo sumo su presupuesto por evento y el que queda con
+ * datos vuelve a estar listo, ningun fd es siempre el primero en atenderse.
+ * Los fds de mayor prioridad se despachan antes que el resto, pero todos
+ * los listos se despachan en la misma iteracion.
  */
 static void
 handle_iteration(fd_selector s) {
@@ -437,27 +478,34 @@ handle_iteration(fd_selector s) {
     struct selector_key key = {
         .s = s,
     };
-
-    for (int i = 0; i <= n; i++) {
-        struct item *item = s->fds + i;
-        if(ITEM_USED(item)) {
-            key.fd   = item->fd;
-            key.data = item->data;
-            if(FD_ISSET(item->fd, &s->slave_r)) {
-                if(OP_READ & item->interest) {
-                    if(0 == item->handler->handle_read) {
-                        assert(("OP_READ arrived but no handler. bug!" == 0));
-                    } else {
-                        item->handler->handle_read(&key);
+    int first = s->first_fd <= n ? s->first_fd : 0;
+    s->first_fd = first + 1;
+
+    /* Sin fds con prioridad alcanza con una pasada */
+    int top = s->prioritized > 0 ? SELECTOR_PRIORITIES - 1 : 0;
+    for (int priority = top; priority >= 0; priority--) {
+        for (int k = 0; k <= n; k++) {
+            int i = first + k <= n ? first + k : first + k - n - 1;
+            struct item *item = s->fds + i;
+            if(ITEM_USED(item) && item->priority == (unsigned)priority) {
+                key.fd   = item->fd;
+                key.data = item->data;
+                if(FD_ISSET(item->fd, &s->slave_r)) {
+                    if(OP_READ & item->interest) {
+                        if(0 == item->handler->handle_read) {
+                            assert(("OP_READ arrived but no handler. bug!" == 0));
+                        } else {
+                            item->handler->handle_read(&key);
+                        }
                     }
                 }
-            }
-            if(FD_ISSET(i, &s->slave_w)) {
-                if(OP_WRITE & item->interest) {
-                    if(0 == item->handler->handle_write) {
-                        assert(("OP_WRITE arrived but no handler. bug!" == 0));
-                    } else {
-                        item->handler->handle_write(&key);
+                if(FD_ISSET(i, &s->slave_w)) {
+                    if(OP_WRITE & item->interest) {
+                        if(0 == item->handler->handle_write) {
+                            assert(("OP_WRITE arrived but no handler. bug!" == 0));
+                        } else {
+                            item->handler->handle_write(&key);
+                        }
                     }
                 }
             }
@@ -516,6 +564,11 @@ finally:
     return ret;
 }
 
+void
+selector_set_timeout(fd_selector s, struct timespec timeout) {
+    s->master_t = timeout;
+}
+
 selector_status
 selector_select(fd_selector s) {
     selector_status ret = SELECTOR_SUCCESS;
@@ -528,6 +581,8 @@ selector_select(fd_selector s) {
 
     int fds = pselect(s->max_fd + 1, &s->slave_r, &s->slave_w, 0, &s->slave_t,
                       &emptyset);
+    // la hora de esta vuelta, para todos los handlers que se llamen en ella
+    clocks_update();
     if(-1 == fds) {
         switch(errno) {
             case EAGAIN:
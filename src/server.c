@@ -1,10 +1,17 @@
 #include "include/server.h"
 #include "logger/logger.h"
 #include "include/metrics.h"
+#include "exporter/exporter.h"
+#include "logger/trace.h"
+#include "include/config.h"
 
-#define MAX_QUEUE 50
+#define MAX_PASSIVE 6    /* SOCKS, management y exporter, IPv4 e IPv6 */
 static fd_selector selector;
 
+/* Sockets pasivos, para aplicarles un cambio de backlog */
+static int passive_fds[MAX_PASSIVE];
+static size_t passive_count = 0;
+
 static void passive_socks_socket_handler(struct selector_key * key);
 static void passive_cp_socket_handler(struct selector_key * key) ;
 
@@ -17,6 +24,8 @@ const struct fd_handler passive_socket_fd_handler = {
 
 const struct fd_handler passive_socket_fd_mng_handler = {passive_cp_socket_handler, 0, 0, 0};
 
+const struct fd_handler passive_socket_fd_metrics_handler = {exporter_passive_accept, 0, 0, 0};
+
 
 const struct fd_handler conn_actions_handler = { 
     .handle_read = socks_conn_read,
@@ -37,6 +46,21 @@ close_socks_conn(socks_conn_model * socks) {
     int client_socket = socks->cli_conn->socket;
     int server_socket = socks->src_conn->socket;
 
+    TRACE(SOCKS_CLOSE, client_socket, socks->id, stm_state(&socks->stm), 0);
+    sessions_remove(socks);
+    shaper_cancel(socks);
+    if (socks->ip_counted) {
+        limits_ip_release(&socks->cli_conn->addr);
+    }
+    if (socks->user_counted) {
+        limits_user_release(socks->account);
+    }
+    if (socks->account != ACCOUNTING_NO_HANDLE) {
+        uint64_t now = clocks_mono_usec();
+        accounting_session_end(socks->account, now > socks->timings.accepted
+                                               ? (now - socks->timings.accepted) / 1000 : 0);
+    }
+
     if (server_socket != -1) {
         selector_unregister_fd(selector, server_socket, false);
         close(server_socket);
@@ -63,7 +87,8 @@ close_socks_conn(socks_conn_model * socks) {
     free(socks->parsers->req_parser);
     free(socks->parsers);
 
-    free(socks->pop3_parser);
+    dissector_session_free(socks->dissector);
+    sniff_session_close(socks->sniff);
 
     free(socks->cli_conn);
     free(socks->src_conn);
@@ -97,6 +122,10 @@ static void passive_cp_socket_handler(struct selector_key * key) {
         return;
     }
 
+    /* Con pipelining las respuestas salen en varios segmentos chicos: sin
+        Nagle no esperan al ACK retrasado del cliente */
+    setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
     /* Inicializamos la estructura con los datos de esta conexion */
     // TODO: Considerar aniadirlo a una lista para liberar todo al?
     new = newControlProtConn(clientFd, key->s);
@@ -119,17 +148,32 @@ static void
 passive_socks_socket_handler(struct selector_key * key){
     //TODO: Check if enough fds are available
 
-    socks_conn_model * socks = new_socks_conn();
-    
-    //After setting up the configuration, we accept the socks
-    socks->cli_conn->addr_len = sizeof(socks->cli_conn->addr);
-    socks->cli_conn->socket = accept(key->fd, (struct sockaddr *)&socks->cli_conn->addr,
-    &socks->cli_conn->addr_len);
-    if(socks->cli_conn->socket == -1){
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd = accept(key->fd, (struct sockaddr *)&addr, &addr_len);
+    if(fd == -1){
         LogError("Error in accept call");
-        close_socks_conn(socks);
         return;
     }
+
+    /* Sobre los limites de sesiones se cierra la conexion sin crear nada */
+    long max_sessions = config_get(CONFIG_MAX_SESSIONS);
+    if(max_sessions > 0 && get_current_socks() >= max_sessions){
+        close(fd);
+        return;
+    }
+    enum limit_result ip_limit = limits_ip_acquire(&addr);
+    if(ip_limit == LIMIT_EXCEEDED){
+        metrics_add(METRIC_LIMIT_REJECTS, 1);
+        close(fd);
+        return;
+    }
+
+    socks_conn_model * socks = new_socks_conn();
+    socks->cli_conn->addr = addr;
+    socks->cli_conn->addr_len = addr_len;
+    socks->cli_conn->socket = fd;
+    socks->ip_counted = ip_limit == LIMIT_COUNTED;
  
     int sel_ret = selector_fd_set_nio(socks->cli_conn->socket);
     if(sel_ret == -1){
@@ -138,6 +182,8 @@ passive_socks_socket_handler(struct selector_key * key){
         return;
     }
     
+    socks->timings.accepted = metrics_now_usec();
+
     selector_status sel_register_ret = selector_register(selector, socks->cli_conn->socket,
         &conn_actions_handler, OP_READ, socks);
     if(sel_register_ret != SELECTOR_SUCCESS){
@@ -147,6 +193,7 @@ passive_socks_socket_handler(struct selector_key * key){
         return;
     }
     add_socks_connection(); // Metrics
+    TRACE(SOCKS_ACCEPT, socks->cli_conn->socket, socks->id, socks->cli_conn->addr.ss_family, 0);
 }
 
 
@@ -205,7 +252,7 @@ static int start_socket(char * ip_addr, char * port,
         goto finally;
         }
 
-    int ret_listen = listen(ret_fd, MAX_QUEUE);
+    int ret_listen = listen(ret_fd, config_get(CONFIG_LISTEN_BACKLOG));
     if(ret_listen < 0){ 
         LogError("Error in listen call");
         perror("Listen: ");
@@ -219,6 +266,8 @@ static int start_socket(char * ip_addr, char * port,
         error=-1;
         goto finally;
     }
+    if(passive_count < MAX_PASSIVE)
+        passive_fds[passive_count++] = ret_fd;
 finally:
     if(error == -1 && ret_fd != -1){ close(ret_fd); ret_fd = -1;}
     freeaddrinfo(res);
@@ -226,8 +275,22 @@ finally:
 }
 
 
-void start_server(char * socks_addr, char * socks_port, char * mng_addr, char * mng_port){
+/* El selector no espera mas alla del proximo vencimiento del shaper */
+static void
+set_iteration_timeout(){
+    struct timespec timeout = {.tv_sec = config_get(CONFIG_SELECT_TIMEOUT)};
+    uint64_t wait = shaper_next_wait_ns();
+    if(wait < (uint64_t) timeout.tv_sec * 1000000000ULL){
+        timeout.tv_sec = wait / 1000000000ULL;
+        timeout.tv_nsec = wait % 1000000000ULL;
+    }
+    selector_set_timeout(selector, timeout);
+}
+
+void start_server(char * socks_addr, char * socks_port, char * mng_addr, char * mng_port,
+                  char * metrics_addr, char * metrics_port){
     int fd_socks_ipv4 = -1, fd_socks_ipv6 = -1, fd_mng_ipv4 = -1, fd_mng_ipv6 = -1;
+    int fd_metrics_ipv4 = -1, fd_metrics_ipv6 = -1;
 
     fd_socks_ipv4 = start_socket(socks_addr, socks_port, &passive_socket_fd_handler, AF_UNSPEC);
     if(fd_socks_ipv4 == -1){ 
@@ -252,10 +315,35 @@ void start_server(char * socks_addr, char * socks_port, char * mng_addr, char *
             goto finally; 
         }
     }
+    /* El exporter de metricas es opcional */
+    if(metrics_port != NULL){
+        fd_metrics_ipv4 = start_socket(metrics_addr, metrics_port,
+                                       &passive_socket_fd_metrics_handler, AF_UNSPEC);
+        if(fd_metrics_ipv4 == -1){
+            LogError("Failed to start metrics exporter socket");
+            goto finally;
+        }
+        else if(metrics_addr == NULL){
+            fd_metrics_ipv6 = start_socket(NULL, metrics_port,
+                                           &passive_socket_fd_metrics_handler, AF_INET6);
+            if(fd_metrics_ipv6 == -1){
+                LogError("Failed to start IPv6 metrics exporter socket");
+                goto finally;
+            }
+        }
+    }
+
+    if(sniff_worker_register(selector) == -1){
+        LogError("Failed to register the sniffer worker");
+        goto finally;
+    }
 
     while(1){
+        set_iteration_timeout();
         int selector_ret_value = selector_select(selector);
         if(selector_ret_value != SELECTOR_SUCCESS){goto finally;}
+        shaper_tick(selector);
+        accounting_tick();
     }
 
 finally:
@@ -263,13 +351,32 @@ finally:
     if(fd_socks_ipv6 != -1){close(fd_socks_ipv6);}
     if(fd_mng_ipv4 != -1){close(fd_mng_ipv4);}
     if(fd_mng_ipv6 != -1){close(fd_mng_ipv6);}
+    if(fd_metrics_ipv4 != -1){close(fd_metrics_ipv4);}
+    if(fd_metrics_ipv6 != -1){close(fd_metrics_ipv6);}
 }
 
 void
 set_selector(fd_selector * new_selector){ selector = *new_selector; }
 
+/* Volver a llamar a listen() sobre un socket pasivo cambia su backlog */
+void
+server_set_backlog(long backlog){
+    for(size_t i = 0; i < passive_count; i++)
+        if(listen(passive_fds[i], backlog) == -1)
+            LogError("Cannot change the backlog of fd %d", passive_fds[i]);
+}
+
+void
+server_set_select_timeout(long seconds){
+    if(selector != NULL)
+        selector_set_timeout(selector, (struct timespec){.tv_sec = seconds});
+}
+
 void
 cleanup(){
     freeCpConnList();
+    access_log_stop();
+    sniff_worker_stop();
+    accounting_close();
     selector_destroy(selector); 
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <string.h>
+
+#include "cred_store.h"
+#include "../include/clocks.h"
+
+#define STORE_MASK (CRED_STORE_SIZE - 1)
+#define HASH_MASK (CRED_HASH_SIZE - 1)
+#define EMPTY -1
+
+static struct cred_entry entries[CRED_STORE_SIZE];
+static uint64_t head = 0;               /* entradas escritas desde el inicio */
+static uint64_t tail = 0;               /* la mas vieja que sigue en el ring */
+static int16_t table[CRED_HASH_SIZE];   /* posiciones en `entries' */
+static bool initialized = false;
+
+static uint32_t
+fnv1a(uint32_t h, const void * data, size_t len){
+    const uint8_t * p = data;
+    for(size_t i = 0; i < len; i++){
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static uint32_t
+key_hash(const struct sniff_origin * origin, enum dissector_protocol protocol,
+         const char * user, const char * pass){
+    uint32_t h = 2166136261u;
+    uint8_t p = protocol;
+    h = fnv1a(h, &p, 1);
+    h = fnv1a(h, origin->destination, strlen(origin->destination) + 1);
+    h = fnv1a(h, &origin->destination_port, sizeof(origin->destination_port));
+    h = fnv1a(h, user, strlen(user) + 1);
+    return fnv1a(h, pass, strlen(pass) + 1);
+}
+
+static bool
+same_key(const struct cred_entry * e, uint32_t hash, const struct sniff_origin * origin,
+         enum dissector_protocol protocol, const char * user, const char * pass){
+    return e->hash == hash && e->protocol == protocol &&
+           e->origin.destination_port == origin->destination_port &&
+           strcmp(e->origin.destination, origin->destination) == 0 &&
+           strcmp(e->user, user) == 0 && strcmp(e->pass, pass) == 0;
+}
+
+/* Borrado con desplazamiento hacia atras (sondeo lineal): las claves que
+   siguen en el cluster se corren para que no quede un hueco en su camino */
+static void
+table_remove(uint32_t slot){
+    uint32_t next = slot;
+    while(true){
+        next = (next + 1) & HASH_MASK;
+        if(table[next] == EMPTY)
+            break;
+        uint32_t home = entries[table[next]].hash & HASH_MASK;
+        /* `next' puede ocupar `slot' si su posicion ideal no esta entre ellos */
+        bool movable = slot <= next ? (home <= slot || home > next)
+                                    : (home <= slot && home > next);
+        if(movable){
+            table[slot] = table[next];
+            slot = next;
+        }
+    }
+    table[slot] = EMPTY;
+}
+
+static void
+evict_oldest(void){
+    const int16_t index = tail & STORE_MASK;
+    uint32_t slot = entries[index].hash & HASH_MASK;
+    while(table[slot] != index)
+        slot = (slot + 1) & HASH_MASK;
+    table_remove(slot);
+    tail++;
+}
+
+void
+cred_store_add(const struct sniff_origin * origin, enum dissector_protocol protocol,
+               const char * user, const char * pass){
+    if(!initialized){
+        memset(table, 0xFF, sizeof(table));     /* EMPTY */
+        initialized = true;
+    }
+    const int64_t now = clocks_wall_sec();
+    const uint32_t hash = key_hash(origin, protocol, user, pass);
+
+    uint32_t slot = hash & HASH_MASK;
+    for(; table[slot] != EMPTY; slot = (slot + 1) & HASH_MASK){
+        struct cred_entry * e = &entries[table[slot]];
+        if(same_key(e, hash, origin, protocol, user, pass)){
+            e->last_seen = now;
+            e->count++;
+            return;
+        }
+    }
+
+    if(head - tail == CRED_STORE_SIZE){
+        evict_oldest();
+        /* El borrado pudo mover claves: se busca de nuevo el lugar libre */
+        slot = hash & HASH_MASK;
+        while(table[slot] != EMPTY)
+            slot = (slot + 1) & HASH_MASK;
+    }
+
+    const int16_t index = head & STORE_MASK;
+    struct cred_entry * e = &entries[index];
+    e->id = ++head;
+    e->first_seen = e->last_seen = now;
+    e->count = 1;
+    e->hash = hash;
+    e->protocol = protocol;
+    e->origin = *origin;
+    strncpy(e->user, user, sizeof(e->user) - 1);
+    e->user[sizeof(e->user) - 1] = '\0';
+    strncpy(e->pass, pass, sizeof(e->pass) - 1);
+    e->pass[sizeof(e->pass) - 1] = '\0';
+    table[slot] = index;
+}
+
+size_t
+cred_store_list(uint64_t from_id, const struct cred_entry ** out, size_t n){
+    /* Los ids son consecutivos: la entrada con id k esta en la posicion k - 1 */
+    uint64_t i = from_id == 0 ? 0 : from_id - 1;
+    if(i < tail)
+        i = tail;
+    size_t count = 0;
+    for(; i < head && count < n; i++)
+        out[count++] = &entries[i & STORE_MASK];
+    return count;
+}
@@ -0,0 +1,46 @@
+#ifndef CRED_STORE_H
+#define CRED_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dissector.h"
+#include "sniff_worker.h"
+
+/*
+Credenciales capturadas por los dissectors, en memoria.
+
+Un ring de CRED_STORE_SIZE entradas: cuando se llena se pisa la mas vieja,
+asi que la memoria no depende de cuantas credenciales se capturen. Una
+credencial repetida (mismo protocolo, destino, usuario y password) no ocupa
+otra entrada: se actualiza last_seen y count de la existente, que se
+encuentra con una tabla hash de direccionamiento abierto.
+
+Cada entrada nueva recibe un id creciente; para recorrer el store se pide
+a partir de un id (el siguiente al ultimo leido). Solo se usa desde el
+hilo del selector.
+*/
+
+#define CRED_STORE_SIZE 512             /* entradas, potencia de 2 */
+#define CRED_HASH_SIZE (2 * CRED_STORE_SIZE)
+
+struct cred_entry{
+    uint64_t id;
+    int64_t first_seen;                 /* segundos desde epoch */
+    int64_t last_seen;
+    uint32_t count;                     /* veces que se capturo */
+    uint32_t hash;
+    enum dissector_protocol protocol;
+    struct sniff_origin origin;
+    char user[DISSECTOR_ARG_SIZE + 1];
+    char pass[DISSECTOR_ARG_SIZE + 1];
+};
+
+void cred_store_add(const struct sniff_origin * origin, enum dissector_protocol protocol,
+                    const char * user, const char * pass);
+
+/** Hasta `n' entradas con id >= from_id, de la mas vieja a la mas nueva.
+    Los punteros valen hasta el proximo cred_store_add */
+size_t cred_store_list(uint64_t from_id, const struct cred_entry ** out, size_t n);
+
+#endif
@@ -0,0 +1,373 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+
+#include "dissector.h"
+
+#define AC_MAX_STATES 256
+#define AC_MAX_PATTERNS 32              /* bits de ac_out */
+#define AC_ROOT 0
+
+enum session_state{
+    SESSION_DETECTING,
+    SESSION_SCANNING,           /* buscando palabras clave */
+    SESSION_CAPTURING,          /* copiando la linea que sigue a una palabra */
+    SESSION_FINISHED
+};
+
+struct dissector_session{
+    enum session_state state;
+    enum dissector_protocol protocol;
+    uint32_t candidates;        /* protocolos aun posibles mientras se detecta */
+    bool seen[2];               /* primeros bytes de cada sentido (servidor, cliente) */
+    uint16_t ac_state;
+    dissector_action action;    /* la que espera la linea en captura */
+    uint32_t scanned;
+    uint16_t line_len;
+    bool line_overflow;
+    bool user_done;
+    bool done;
+    uint8_t line[DISSECTOR_LINE_SIZE];
+    char user[DISSECTOR_ARG_SIZE + 1];
+    char pass[DISSECTOR_ARG_SIZE + 1];
+};
+
+static bool sniffer_state = true;
+/* Con socks5d -w los lee el hilo de analisis */
+static atomic_bool enabled[DISSECTOR_COUNT] = {
+#define DISSECTOR_ENABLED(id) true,
+    DISSECTORS(DISSECTOR_ENABLED)
+#undef DISSECTOR_ENABLED
+};
+
+/* ------------------------------ Aho-Corasick ------------------------------ */
+
+/* Automata determinista: ac_next ya incluye las transiciones de fallo, asi
+   que avanzar es un acceso a tabla por byte */
+static uint16_t ac_next[AC_MAX_STATES][256];
+static uint32_t ac_out[AC_MAX_STATES];          /* patrones que terminan en el estado */
+static struct{
+    enum dissector_protocol protocol;
+    dissector_action action;
+} ac_patterns[AC_MAX_PATTERNS];
+static uint32_t ac_protocol_mask[DISSECTOR_COUNT];  /* patrones de cada protocolo */
+static uint16_t ac_line_start;                      /* estado despues de un '\n' */
+static uint8_t fold[256];
+static bool ac_built = false;
+
+static int
+ac_build(void){
+    static int16_t trie[AC_MAX_STATES][256];
+    static uint16_t fail[AC_MAX_STATES];
+    static uint16_t queue[AC_MAX_STATES];
+    int states = 1, patterns = 0;
+
+    for(int c = 0; c < 256; c++)
+        fold[c] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    memset(trie, -1, sizeof(trie));
+    memset(ac_out, 0, sizeof(ac_out));
+
+    for(int p = 0; p < DISSECTOR_COUNT; p++){
+        const struct dissector * d = dissectors[p];
+        for(size_t k = 0; k < d->keyword_count; k++){
+            if(patterns == AC_MAX_PATTERNS)
+                return -1;
+            int s = AC_ROOT;
+            for(const char * c = d->keywords[k].text; *c != '\0'; c++){
+                uint8_t b = fold[(uint8_t) *c];
+                if(trie[s][b] == -1){
+                    if(states == AC_MAX_STATES)
+                        return -1;
+                    trie[s][b] = states++;
+                }
+                s = trie[s][b];
+            }
+            ac_out[s] |= 1u << patterns;
+            ac_patterns[patterns].protocol = p;
+            ac_patterns[patterns].action = d->keywords[k].action;
+            ac_protocol_mask[p] |= 1u << patterns;
+            patterns++;
+        }
+    }
+
+    /* BFS: los estados de profundidad 1 fallan a la raiz; el resto hereda
+       el fallo (y las salidas) del estado al que llegaria su padre */
+    int head = 0, tail = 0;
+    for(int c = 0; c < 256; c++){
+        if(trie[AC_ROOT][c] == -1){
+            ac_next[AC_ROOT][c] = AC_ROOT;
+        } else {
+            ac_next[AC_ROOT][c] = trie[AC_ROOT][c];
+            fail[trie[AC_ROOT][c]] = AC_ROOT;
+            queue[tail++] = trie[AC_ROOT][c];
+        }
+    }
+    while(head < tail){
+        int s = queue[head++];
+        ac_out[s] |= ac_out[fail[s]];
+        for(int c = 0; c < 256; c++){
+            int t = trie[s][c];
+            if(t == -1){
+                ac_next[s][c] = ac_next[fail[s]][c];
+            } else {
+                ac_next[s][c] = t;
+                fail[t] = ac_next[fail[s]][c];
+                queue[tail++] = t;
+            }
+        }
+    }
+    ac_line_start = ac_next[AC_ROOT]['\n'];
+    ac_built = true;
+    return 0;
+}
+
+/* -------------------------------- sesiones -------------------------------- */
+
+struct dissector_session *
+dissector_session_new(void){
+    if(!ac_built && ac_build() == -1)
+        return NULL;
+    uint32_t candidates = 0;
+    for(int p = 0; p < DISSECTOR_COUNT; p++)
+        if(atomic_load_explicit(&enabled[p], memory_order_relaxed))
+            candidates |= 1u << p;
+    if(candidates == 0)
+        return NULL;
+
+    struct dissector_session * s = malloc(sizeof(*s));
+    if(s == NULL)
+        return NULL;
+    s->state = SESSION_DETECTING;
+    s->candidates = candidates;
+    s->seen[0] = s->seen[1] = false;
+    s->ac_state = ac_line_start;        /* el inicio del stream es inicio de linea */
+    s->action = 0;
+    s->scanned = 0;
+    s->line_len = 0;
+    s->line_overflow = false;
+    s->user_done = false;
+    s->done = false;
+    s->user[0] = '\0';
+    s->pass[0] = '\0';
+    return s;
+}
+
+void
+dissector_session_free(struct dissector_session * s){
+    free(s);
+}
+
+bool
+dissector_active(const struct dissector_session * s){
+    return s != NULL && s->state != SESSION_FINISHED;
+}
+
+/* Solo se miran los primeros bytes de cada sentido */
+static void
+detect(struct dissector_session * s, bool from_client, const uint8_t * data, size_t len){
+    if(s->seen[from_client])
+        return;
+    s->seen[from_client] = true;
+    for(int p = 0; p < DISSECTOR_COUNT; p++){
+        if(!(s->candidates & (1u << p)))
+            continue;
+        enum dissector_detect r = dissectors[p]->detect(from_client, data, len);
+        if(r == DETECT_YES){
+            s->protocol = p;
+            s->state = SESSION_SCANNING;
+            return;
+        }
+        if(r == DETECT_NO)
+            s->candidates &= ~(1u << p);
+    }
+    /* Con ambos sentidos vistos, queda el unico candidato que no se descarto */
+    if(s->seen[0] && s->seen[1] && s->candidates != 0 && (s->candidates & (s->candidates - 1)) == 0){
+        int p = 0;
+        while(!(s->candidates & (1u << p)))
+            p++;
+        s->protocol = p;
+        s->state = SESSION_SCANNING;
+        return;
+    }
+    if(s->candidates == 0 || (s->seen[0] && s->seen[1]))
+        s->state = SESSION_FINISHED;
+}
+
+/* Termino una linea en captura: el dissector decide si espera otra. Una
+   linea demasiado larga (line == NULL) se descarta */
+static void
+end_line(struct dissector_session * s, const uint8_t * line, size_t len){
+    if(line == NULL){
+        s->action = 0;
+    } else {
+        while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            len--;
+        s->action = dissectors[s->protocol]->on_line(s, s->action, line, len);
+    }
+    s->line_len = 0;
+    s->line_overflow = false;
+    if(s->done)
+        s->state = SESSION_FINISHED;
+    else if(s->action == 0){
+        s->state = SESSION_SCANNING;
+        s->ac_state = ac_line_start;
+    }
+}
+
+/* Copia hasta el fin de linea. Retorna los bytes consumidos */
+static size_t
+capture(struct dissector_session * s, const uint8_t * data, size_t len){
+    const uint8_t * end = memchr(data, '\n', len);
+    const size_t chunk = end == NULL ? len : (size_t)(end - data) + 1;
+
+    if(s->line_len == 0 && end != NULL){
+        /* La linea entera esta en lo recibido: sin copias */
+        if(chunk <= DISSECTOR_LINE_SIZE && !s->line_overflow)
+            end_line(s, data, chunk);
+        else
+            end_line(s, NULL, 0);
+        return chunk;
+    }
+    if(!s->line_overflow && s->line_len + chunk <= DISSECTOR_LINE_SIZE){
+        memcpy(s->line + s->line_len, data, chunk);
+        s->line_len += chunk;
+    } else {
+        s->line_overflow = true;
+    }
+    if(end != NULL)
+        end_line(s, s->line_overflow ? NULL : s->line, s->line_len);
+    return chunk;
+}
+
+/* Una transicion por byte hasta la proxima palabra clave del protocolo */
+static size_t
+scan(struct dissector_session * s, const uint8_t * data, size_t len){
+    const uint32_t mask = ac_protocol_mask[s->protocol];
+    uint16_t state = s->ac_state;
+    for(size_t i = 0; i < len; i++){
+        state = ac_next[state][fold[data[i]]];
+        const uint32_t out = ac_out[state] & mask;
+        if(out != 0){
+            /* Con mas de una coincidencia gana la de menor indice */
+            int pattern = 0;
+            while(!(out & (1u << pattern)))
+                pattern++;
+            s->action = ac_patterns[pattern].action;
+            s->state = SESSION_CAPTURING;
+            s->ac_state = state;
+            return i + 1;
+        }
+    }
+    s->ac_state = state;
+    return len;
+}
+
+enum dissector_result
+dissector_feed(struct dissector_session * s, bool from_client, const uint8_t * data, size_t len){
+    if(!dissector_active(s))
+        return DISSECTOR_FINISHED;
+
+    if(s->state == SESSION_DETECTING)
+        detect(s, from_client, data, len);
+
+    if(from_client && s->state != SESSION_DETECTING && s->state != SESSION_FINISHED){
+        if(!atomic_load_explicit(&enabled[s->protocol], memory_order_relaxed)){
+            s->state = SESSION_FINISHED;
+        } else {
+            size_t budget = DISSECTOR_SCAN_LIMIT - s->scanned;
+            if(len > budget)
+                len = budget;
+            s->scanned += len;
+            while(len > 0 && (s->state == SESSION_SCANNING || s->state == SESSION_CAPTURING)){
+                size_t n = s->state == SESSION_SCANNING ? scan(s, data, len)
+                                                        : capture(s, data, len);
+                data += n;
+                len -= n;
+            }
+            if(s->scanned == DISSECTOR_SCAN_LIMIT && !s->done)
+                s->state = SESSION_FINISHED;
+        }
+    }
+
+    if(s->done){
+        /* Las credenciales se informan una sola vez */
+        s->done = false;
+        s->state = SESSION_FINISHED;
+        return DISSECTOR_CREDENTIALS;
+    }
+    return s->state == SESSION_FINISHED ? DISSECTOR_FINISHED : DISSECTOR_CONTINUE;
+}
+
+/* ------------------------ para los dissectors ------------------------ */
+
+static void
+copy_arg(char * dst, const uint8_t * src, size_t len){
+    if(len > DISSECTOR_ARG_SIZE)
+        len = DISSECTOR_ARG_SIZE;
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+void
+dissector_set_user(struct dissector_session * s, const uint8_t * user, size_t len){
+    copy_arg(s->user, user, len);
+    s->user_done = true;
+}
+
+void
+dissector_set_password(struct dissector_session * s, const uint8_t * pass, size_t len){
+    copy_arg(s->pass, pass, len);
+    s->done = true;
+}
+
+bool
+dissector_has_user(const struct dissector_session * s){
+    return s->user_done;
+}
+
+enum dissector_protocol
+dissector_session_protocol(const struct dissector_session * s){
+    return s->protocol;
+}
+
+const char *
+dissector_protocol_name(const struct dissector_session * s){
+    return dissectors[s->protocol]->name;
+}
+
+const char *
+dissector_user(const struct dissector_session * s){
+    return s->user;
+}
+
+const char *
+dissector_password(const struct dissector_session * s){
+    return s->pass;
+}
+
+/* ------------------------------ habilitacion ------------------------------ */
+
+bool sniffer_is_on(){
+    return sniffer_state;
+}
+
+void set_sniffer_state(bool newState){
+    sniffer_state = newState;
+}
+
+int
+dissector_set_enabled(const char * name, bool value){
+    for(int p = 0; p < DISSECTOR_COUNT; p++){
+        if(strcasecmp(dissectors[p]->name, name) == 0){
+            atomic_store_explicit(&enabled[p], value, memory_order_relaxed);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+bool
+dissector_is_enabled(enum dissector_protocol protocol){
+    return atomic_load_explicit(&enabled[protocol], memory_order_relaxed);
+}
@@ -0,0 +1,115 @@
+#ifndef DISSECTOR_H
+#define DISSECTOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+Dissectors de credenciales.
+
+Cada protocolo se describe con un `struct dissector': una funcion que lo
+reconoce por los primeros bytes de cada sentido de la conexion (no por el
+puerto), las palabras clave que preceden a una credencial en lo que envia
+el cliente, y una funcion que interpreta la linea que sigue a cada palabra.
+
+Las palabras clave de todos los protocolos se compilan en un unico
+automata Aho-Corasick (sin distinguir mayusculas), asi que recorrer lo que
+envia el cliente cuesta una transicion por byte sin importar cuantos
+protocolos haya. La linea que sigue a una palabra se copia buscando el fin
+de linea con memchr.
+
+Una sesion deja de inspeccionarse cuando se capturan credenciales, cuando
+no se reconoce el protocolo o despues de DISSECTOR_SCAN_LIMIT bytes.
+
+Para agregar un protocolo: sumarlo a DISSECTORS y definir su dissector en
+dissectors.c.
+*/
+
+#define DISSECTOR_ARG_SIZE 255
+#define DISSECTOR_LINE_SIZE 1024        /* base64 de AUTH PLAIN incluido */
+#define DISSECTOR_SCAN_LIMIT 8192       /* bytes inspeccionados por sesion */
+
+#define DISSECTORS(X) \
+    X(POP3) \
+    X(IMAP) \
+    X(FTP)  \
+    X(SMTP) \
+    X(HTTP)
+
+enum dissector_protocol{
+#define DISSECTOR_ENUM(id) DISSECTOR_##id,
+    DISSECTORS(DISSECTOR_ENUM)
+#undef DISSECTOR_ENUM
+    DISSECTOR_COUNT
+};
+
+enum dissector_detect{
+    DETECT_NO,          /* no es este protocolo */
+    DETECT_MAYBE,       /* hacen falta mas datos */
+    DETECT_YES
+};
+
+enum dissector_result{
+    DISSECTOR_CONTINUE,
+    DISSECTOR_CREDENTIALS,      /* credenciales capturadas en esta llamada */
+    DISSECTOR_FINISHED          /* no hay mas nada que inspeccionar */
+};
+
+struct dissector_session;
+
+/* Accion que sigue a una palabra clave; 0 es "ninguna" */
+typedef uint8_t dissector_action;
+
+struct dissector_keyword{
+    const char * text;          /* en minuscula, '\n' marca inicio de linea */
+    dissector_action action;
+};
+
+struct dissector{
+    const char * name;
+    /* Primeros bytes recibidos en un sentido de la conexion */
+    enum dissector_detect (*detect)(bool from_client, const uint8_t * data, size_t len);
+    const struct dissector_keyword * keywords;
+    size_t keyword_count;
+    /* Linea (sin CRLF) que sigue a la palabra clave, o a la linea anterior
+       si esta funcion pidio otra. Retorna la accion para la proxima linea
+       del cliente, o 0 para volver a buscar palabras clave. */
+    dissector_action (*on_line)(struct dissector_session * s, dissector_action action,
+                                const uint8_t * line, size_t len);
+};
+
+/* dissectors.c */
+extern const struct dissector * const dissectors[DISSECTOR_COUNT];
+
+/** NULL si no hay memoria o no hay ningun protocolo habilitado */
+struct dissector_session * dissector_session_new(void);
+
+void dissector_session_free(struct dissector_session * s);
+
+bool dissector_active(const struct dissector_session * s);
+
+/** Bytes nuevos de la conexion, en el sentido indicado */
+enum dissector_result dissector_feed(struct dissector_session * s, bool from_client,
+                                     const uint8_t * data, size_t len);
+
+enum dissector_protocol dissector_session_protocol(const struct dissector_session * s);
+const char * dissector_protocol_name(const struct dissector_session * s);
+const char * dissector_user(const struct dissector_session * s);
+const char * dissector_password(const struct dissector_session * s);
+
+/* Para los dissectors: guardan el argumento como string (se trunca a
+   DISSECTOR_ARG_SIZE). dissector_set_password completa la captura. */
+void dissector_set_user(struct dissector_session * s, const uint8_t * user, size_t len);
+void dissector_set_password(struct dissector_session * s, const uint8_t * pass, size_t len);
+bool dissector_has_user(const struct dissector_session * s);
+
+/* Habilitacion: global y por protocolo */
+bool sniffer_is_on();
+void set_sniffer_state(bool newState);
+
+/** -1 si `name' no es un protocolo conocido */
+int dissector_set_enabled(const char * name, bool enabled);
+bool dissector_is_enabled(enum dissector_protocol protocol);
+
+#endif
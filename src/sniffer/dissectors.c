@@ -0,0 +1,327 @@
+#include <string.h>
+#include <strings.h>
+
+#include "dissector.h"
+
+/*
+Protocolos soportados. Las palabras clave empiezan con '\n' cuando deben
+estar al inicio de una linea (el inicio del stream cuenta como tal).
+
+POP3, IMAP, FTP y SMTP: habla primero el servidor. FTP y SMTP saludan
+igual ("220"), los separa el primer comando del cliente. HTTP: habla
+primero el cliente.
+*/
+
+enum{
+    ACTION_NONE,
+    ACTION_USER,                /* POP3, FTP */
+    ACTION_PASS,
+    ACTION_IMAP_LOGIN,
+    ACTION_SMTP_PLAIN,          /* resto de "AUTH PLAIN" */
+    ACTION_SMTP_PLAIN_DATA,     /* linea siguiente con la respuesta inicial */
+    ACTION_SMTP_LOGIN,          /* resto de "AUTH LOGIN" */
+    ACTION_SMTP_LOGIN_USER,
+    ACTION_SMTP_LOGIN_PASS,
+    ACTION_HTTP_BASIC
+};
+
+static bool
+starts_with(const uint8_t * data, size_t len, const char * prefix){
+    size_t n = strlen(prefix);
+    return len >= n && strncasecmp((const char *) data, prefix, n) == 0;
+}
+
+/* Saltea espacios al inicio */
+static const uint8_t *
+skip_spaces(const uint8_t * line, size_t * len){
+    while(*len > 0 && (*line == ' ' || *line == '\t')){
+        line++;
+        (*len)--;
+    }
+    return line;
+}
+
+/* ---------------------------------- base64 --------------------------------- */
+
+static int
+base64_value(uint8_t c){
+    if(c >= 'A' && c <= 'Z') return c - 'A';
+    if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if(c >= '0' && c <= '9') return c - '0' + 52;
+    if(c == '+') return 62;
+    if(c == '/') return 63;
+    return -1;
+}
+
+/* Decodifica en `out' (de al menos len * 3 / 4 bytes). Retorna la cantidad
+   de bytes o -1 si no es base64 */
+static int
+base64_decode(const uint8_t * in, size_t len, uint8_t * out){
+    uint32_t acc = 0;
+    int bits = 0, n = 0;
+    for(size_t i = 0; i < len; i++){
+        if(in[i] == '=')
+            break;
+        int v = base64_value(in[i]);
+        if(v < 0)
+            return -1;
+        acc = acc << 6 | (uint32_t) v;
+        bits += 6;
+        if(bits >= 8){
+            bits -= 8;
+            out[n++] = (acc >> bits) & 0xFF;
+        }
+    }
+    return n;
+}
+
+/* ----------------------------------- POP3 ---------------------------------- */
+
+static const struct dissector_keyword user_pass_keywords[] = {
+    {"\nuser ", ACTION_USER},
+    {"\npass ", ACTION_PASS},
+};
+
+static dissector_action
+user_pass_line(struct dissector_session * s, dissector_action action,
+               const uint8_t * line, size_t len){
+    if(action == ACTION_USER)
+        dissector_set_user(s, line, len);
+    else if(action == ACTION_PASS && dissector_has_user(s))
+        dissector_set_password(s, line, len);
+    return ACTION_NONE;
+}
+
+static enum dissector_detect
+pop3_detect(bool from_client, const uint8_t * data, size_t len){
+    if(from_client)
+        return DETECT_MAYBE;
+    return starts_with(data, len, "+OK") ? DETECT_YES : DETECT_NO;
+}
+
+static const struct dissector pop3 = {
+    .name = "POP3",
+    .detect = pop3_detect,
+    .keywords = user_pass_keywords,
+    .keyword_count = sizeof(user_pass_keywords) / sizeof(user_pass_keywords[0]),
+    .on_line = user_pass_line,
+};
+
+/* ----------------------------------- IMAP ---------------------------------- */
+
+/* atom o string entre comillas (RFC 3501). Los literales {n} no se soportan */
+static const uint8_t *
+imap_token(const uint8_t * line, size_t * len, uint8_t * out, size_t * out_len){
+    line = skip_spaces(line, len);
+    *out_len = 0;
+    if(*len > 0 && *line == '"'){
+        line++; (*len)--;
+        while(*len > 0 && *line != '"'){
+            if(*line == '\\' && *len > 1){
+                line++; (*len)--;
+            }
+            if(*out_len < DISSECTOR_ARG_SIZE)
+                out[(*out_len)++] = *line;
+            line++; (*len)--;
+        }
+        if(*len > 0){
+            line++; (*len)--;
+        }
+    } else {
+        while(*len > 0 && *line != ' '){
+            if(*out_len < DISSECTOR_ARG_SIZE)
+                out[(*out_len)++] = *line;
+            line++; (*len)--;
+        }
+    }
+    return line;
+}
+
+static dissector_action
+imap_line(struct dissector_session * s, dissector_action action,
+          const uint8_t * line, size_t len){
+    uint8_t user[DISSECTOR_ARG_SIZE], pass[DISSECTOR_ARG_SIZE];
+    size_t user_len, pass_len;
+    line = imap_token(line, &len, user, &user_len);
+    imap_token(line, &len, pass, &pass_len);
+    if(user_len > 0 && pass_len > 0){
+        dissector_set_user(s, user, user_len);
+        dissector_set_password(s, pass, pass_len);
+    }
+    return ACTION_NONE;
+}
+
+static enum dissector_detect
+imap_detect(bool from_client, const uint8_t * data, size_t len){
+    if(from_client)
+        return DETECT_MAYBE;
+    return starts_with(data, len, "* OK") || starts_with(data, len, "* PREAUTH") ?
+           DETECT_YES : DETECT_NO;
+}
+
+static const struct dissector_keyword imap_keywords[] = {
+    {" login ", ACTION_IMAP_LOGIN},
+};
+
+static const struct dissector imap = {
+    .name = "IMAP",
+    .detect = imap_detect,
+    .keywords = imap_keywords,
+    .keyword_count = sizeof(imap_keywords) / sizeof(imap_keywords[0]),
+    .on_line = imap_line,
+};
+
+/* ------------------------------- FTP y SMTP ------------------------------- */
+
+static bool
+smtp_hello(const uint8_t * data, size_t len){
+    return starts_with(data, len, "EHLO") || starts_with(data, len, "HELO");
+}
+
+static enum dissector_detect
+ftp_detect(bool from_client, const uint8_t * data, size_t len){
+    if(from_client)
+        return smtp_hello(data, len) ? DETECT_NO : DETECT_MAYBE;
+    return starts_with(data, len, "220") ? DETECT_MAYBE : DETECT_NO;
+}
+
+static const struct dissector ftp = {
+    .name = "FTP",
+    .detect = ftp_detect,
+    .keywords = user_pass_keywords,
+    .keyword_count = sizeof(user_pass_keywords) / sizeof(user_pass_keywords[0]),
+    .on_line = user_pass_line,
+};
+
+/* AUTH PLAIN: base64 de "authzid\0authcid\0passwd" (RFC 4616) */
+static void
+smtp_plain(struct dissector_session * s, const uint8_t * line, size_t len){
+    uint8_t decoded[DISSECTOR_LINE_SIZE];
+    int n = base64_decode(line, len, decoded);
+    if(n <= 0)
+        return;
+    const uint8_t * user = memchr(decoded, '\0', n);
+    if(user == NULL)
+        return;
+    user++;
+    const uint8_t * end = decoded + n;
+    const uint8_t * pass = memchr(user, '\0', end - user);
+    if(pass == NULL)
+        return;
+    dissector_set_user(s, user, pass - user);
+    pass++;
+    dissector_set_password(s, pass, end - pass);
+}
+
+static bool
+smtp_decode_into(struct dissector_session * s, const uint8_t * line, size_t len, bool user){
+    uint8_t decoded[DISSECTOR_LINE_SIZE];
+    int n = base64_decode(line, len, decoded);
+    if(n < 0)
+        return false;
+    if(user)
+        dissector_set_user(s, decoded, n);
+    else
+        dissector_set_password(s, decoded, n);
+    return true;
+}
+
+static dissector_action
+smtp_line(struct dissector_session * s, dissector_action action,
+          const uint8_t * line, size_t len){
+    line = skip_spaces(line, &len);
+    /* "*" cancela el intercambio (RFC 4954) */
+    if(len == 1 && line[0] == '*')
+        return ACTION_NONE;
+
+    switch(action){
+        case ACTION_SMTP_PLAIN:
+            if(len == 0)
+                return ACTION_SMTP_PLAIN_DATA;
+            /* fallthrough */
+        case ACTION_SMTP_PLAIN_DATA:
+            smtp_plain(s, line, len);
+            return ACTION_NONE;
+        case ACTION_SMTP_LOGIN:
+            if(len == 0)
+                return ACTION_SMTP_LOGIN_USER;
+            /* fallthrough */
+        case ACTION_SMTP_LOGIN_USER:
+            return smtp_decode_into(s, line, len, true) ? ACTION_SMTP_LOGIN_PASS : ACTION_NONE;
+        case ACTION_SMTP_LOGIN_PASS:
+            smtp_decode_into(s, line, len, false);
+            return ACTION_NONE;
+        default:
+            return ACTION_NONE;
+    }
+}
+
+static enum dissector_detect
+smtp_detect(bool from_client, const uint8_t * data, size_t len){
+    if(from_client)
+        return smtp_hello(data, len) ? DETECT_YES : DETECT_NO;
+    return starts_with(data, len, "220") ? DETECT_MAYBE : DETECT_NO;
+}
+
+static const struct dissector_keyword smtp_keywords[] = {
+    {"\nauth plain", ACTION_SMTP_PLAIN},
+    {"\nauth login", ACTION_SMTP_LOGIN},
+};
+
+static const struct dissector smtp = {
+    .name = "SMTP",
+    .detect = smtp_detect,
+    .keywords = smtp_keywords,
+    .keyword_count = sizeof(smtp_keywords) / sizeof(smtp_keywords[0]),
+    .on_line = smtp_line,
+};
+
+/* ----------------------------------- HTTP ---------------------------------- */
+
+static dissector_action
+http_line(struct dissector_session * s, dissector_action action,
+          const uint8_t * line, size_t len){
+    uint8_t decoded[DISSECTOR_LINE_SIZE];
+    line = skip_spaces(line, &len);
+    while(len > 0 && line[len - 1] == ' ')
+        len--;
+    int n = base64_decode(line, len, decoded);
+    if(n <= 0)
+        return ACTION_NONE;
+    const uint8_t * colon = memchr(decoded, ':', n);
+    if(colon != NULL){
+        dissector_set_user(s, decoded, colon - decoded);
+        dissector_set_password(s, colon + 1, decoded + n - (colon + 1));
+    }
+    return ACTION_NONE;
+}
+
+static enum dissector_detect
+http_detect(bool from_client, const uint8_t * data, size_t len){
+    static const char * methods[] = {
+        "GET ", "POST ", "PUT ", "HEAD ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT ",
+    };
+    if(!from_client)
+        return DETECT_NO;
+    for(size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
+        if(len >= strlen(methods[i]) && memcmp(data, methods[i], strlen(methods[i])) == 0)
+            return DETECT_YES;
+    return DETECT_NO;
+}
+
+static const struct dissector_keyword http_keywords[] = {
+    {"\nauthorization: basic ", ACTION_HTTP_BASIC},
+};
+
+static const struct dissector http = {
+    .name = "HTTP",
+    .detect = http_detect,
+    .keywords = http_keywords,
+    .keyword_count = sizeof(http_keywords) / sizeof(http_keywords[0]),
+    .on_line = http_line,
+};
+
+/* En el orden de DISSECTORS */
+const struct dissector * const dissectors[DISSECTOR_COUNT] = {
+    &pop3, &imap, &ftp, &smtp, &http,
+};
@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+
+#include "sniff_worker.h"
+#include "../logger/logger.h"
+#include "../include/metrics.h"
+
+#define RING_MASK (SNIFF_RING_SIZE - 1)
+#define RESULT_MASK (SNIFF_RESULT_RING_SIZE - 1)
+#define CACHE_LINE_SIZE 64
+#define IDLE_MIN_NSEC 1000000L          /* espera del worker con el ring vacio */
+#define IDLE_MAX_NSEC 50000000L
+#define SWEEP_INTERVAL 256              /* bloques entre barridos de sesiones cerradas */
+
+struct sniff_session{
+    struct dissector_session * dissector;   /* del worker una vez publicada */
+    struct sniff_origin origin;
+    atomic_bool finished;           /* no hace falta mandar mas bloques */
+    atomic_bool closed;             /* la conexion se cerro */
+    size_t close_seq;               /* head del ring al cerrar */
+    /* Del selector */
+    bool published;
+    bool server_seen;
+    uint32_t client_bytes;
+    /* Del worker */
+    bool tracked;
+    struct sniff_session * next;
+};
+
+struct sniff_chunk{
+    struct sniff_session * session;
+    uint16_t len;
+    bool from_client;
+    uint8_t data[SNIFF_CHUNK_SIZE];
+};
+
+struct sniff_result{
+    enum dissector_protocol protocol;
+    struct sniff_origin origin;
+    char user[DISSECTOR_ARG_SIZE + 1];
+    char pass[DISSECTOR_ARG_SIZE + 1];
+};
+
+static struct{
+    alignas(CACHE_LINE_SIZE) atomic_size_t head;    // proximo bloque a publicar (selector)
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail;    // proximo bloque a analizar (worker)
+    alignas(CACHE_LINE_SIZE) struct sniff_chunk chunks[SNIFF_RING_SIZE];
+} ring;
+
+static struct{
+    alignas(CACHE_LINE_SIZE) atomic_size_t head;    // worker
+    alignas(CACHE_LINE_SIZE) atomic_size_t tail;    // selector
+    alignas(CACHE_LINE_SIZE) struct sniff_result results[SNIFF_RESULT_RING_SIZE];
+} results;
+
+static pthread_t worker_thread;
+static atomic_bool running;
+static bool started = false;
+static int result_pipe[2] = {-1, -1};
+
+static void sniff_results_read(struct selector_key * key);
+
+static const struct fd_handler sniff_results_handler = {
+    .handle_read = sniff_results_read,
+};
+
+/* ------------------------------ selector ------------------------------ */
+
+struct sniff_session *
+sniff_session_new(const struct sniff_origin * origin){
+    struct dissector_session * dissector = dissector_session_new();
+    if(dissector == NULL)
+        return NULL;
+    struct sniff_session * s = malloc(sizeof(*s));
+    if(s == NULL){
+        dissector_session_free(dissector);
+        return NULL;
+    }
+    s->dissector = dissector;
+    s->origin = *origin;
+    atomic_init(&s->finished, false);
+    atomic_init(&s->closed, false);
+    s->close_seq = 0;
+    s->published = false;
+    s->server_seen = false;
+    s->client_bytes = 0;
+    s->tracked = false;
+    s->next = NULL;
+    return s;
+}
+
+bool
+sniff_session_active(const struct sniff_session * s){
+    return s != NULL && !atomic_load_explicit(&s->finished, memory_order_relaxed);
+}
+
+/* Sin lugar en el ring: la sesion queda sin analizar, un hueco en el
+   stream haria que el dissector interprete cualquier cosa */
+static void
+drop(struct sniff_session * s){
+    atomic_store_explicit(&s->finished, true, memory_order_relaxed);
+    metrics_add(METRIC_SNIFF_DROPS, 1);
+}
+
+static bool
+publish(struct sniff_session * s, bool from_client, const uint8_t * data, size_t len){
+    size_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    if(head - tail == SNIFF_RING_SIZE)
+        return false;
+    struct sniff_chunk * chunk = &ring.chunks[head & RING_MASK];
+    chunk->session = s;
+    chunk->from_client = from_client;
+    chunk->len = len;
+    memcpy(chunk->data, data, len);
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+    s->published = true;
+    return true;
+}
+
+void
+sniff_feed(struct sniff_session * s, bool from_client, const uint8_t * data, size_t len){
+    if(!sniff_session_active(s))
+        return;
+    /* Del servidor solo se usa el primer bloque, para reconocer el protocolo */
+    if(!from_client){
+        if(s->server_seen)
+            return;
+        s->server_seen = true;
+        if(len > SNIFF_CHUNK_SIZE)
+            len = SNIFF_CHUNK_SIZE;
+    } else {
+        size_t budget = DISSECTOR_SCAN_LIMIT - s->client_bytes;
+        if(len > budget)
+            len = budget;
+        s->client_bytes += len;
+    }
+    while(len > 0){
+        size_t n = len > SNIFF_CHUNK_SIZE ? SNIFF_CHUNK_SIZE : len;
+        if(!publish(s, from_client, data, n)){
+            drop(s);
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+    if(s->client_bytes == DISSECTOR_SCAN_LIMIT)
+        atomic_store_explicit(&s->finished, true, memory_order_relaxed);
+}
+
+void
+sniff_session_close(struct sniff_session * s){
+    if(s == NULL)
+        return;
+    if(!s->published){
+        dissector_session_free(s->dissector);
+        free(s);
+        return;
+    }
+    /* Los bloques de la sesion estan antes de close_seq */
+    s->close_seq = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    atomic_store_explicit(&s->closed, true, memory_order_release);
+}
+
+static void
+sniff_results_read(struct selector_key * key){
+    char discard[64];
+    while(read(key->fd, discard, sizeof(discard)) > 0)
+        ;
+    size_t tail = atomic_load_explicit(&results.tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&results.head, memory_order_acquire);
+    for(; tail != head; tail++){
+        const struct sniff_result * r = &results.results[tail & RESULT_MASK];
+        report_credentials(&r->origin, r->protocol, r->user, r->pass);
+    }
+    atomic_store_explicit(&results.tail, tail, memory_order_release);
+}
+
+/* ------------------------------- worker ------------------------------- */
+
+static bool
+push_result(const struct sniff_session * s){
+    size_t head = atomic_load_explicit(&results.head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&results.tail, memory_order_acquire);
+    if(head - tail == SNIFF_RESULT_RING_SIZE){
+        metrics_add(METRIC_SNIFF_DROPS, 1);
+        return false;
+    }
+    struct sniff_result * r = &results.results[head & RESULT_MASK];
+    r->protocol = dissector_session_protocol(s->dissector);
+    r->origin = s->origin;
+    strcpy(r->user, dissector_user(s->dissector));
+    strcpy(r->pass, dissector_password(s->dissector));
+    atomic_store_explicit(&results.head, head + 1, memory_order_release);
+    return true;
+}
+
+/* Retorna true si hay un resultado nuevo */
+static bool
+analyze(struct sniff_chunk * chunk, struct sniff_session ** sessions){
+    struct sniff_session * s = chunk->session;
+    if(!s->tracked){
+        s->tracked = true;
+        s->next = *sessions;
+        *sessions = s;
+    }
+    if(!dissector_active(s->dissector))
+        return false;
+    enum dissector_result r = dissector_feed(s->dissector, chunk->from_client,
+                                             chunk->data, chunk->len);
+    if(r != DISSECTOR_CONTINUE)
+        atomic_store_explicit(&s->finished, true, memory_order_relaxed);
+    return r == DISSECTOR_CREDENTIALS && push_result(s);
+}
+
+/* Libera las sesiones cerradas cuyos bloques ya se analizaron */
+static void
+sweep(struct sniff_session ** sessions, size_t tail){
+    struct sniff_session ** p = sessions;
+    while(*p != NULL){
+        struct sniff_session * s = *p;
+        if(atomic_load_explicit(&s->closed, memory_order_acquire) && tail >= s->close_seq){
+            *p = s->next;
+            dissector_session_free(s->dissector);
+            free(s);
+        } else {
+            p = &s->next;
+        }
+    }
+}
+
+static void
+wake_selector(void){
+    /* Con el pipe lleno ya hay un aviso pendiente */
+    while(write(result_pipe[1], "", 1) == -1 && errno == EINTR)
+        ;
+}
+
+static void *
+worker(void * arg){
+    struct sniff_session * sessions = NULL;
+    long idle = IDLE_MIN_NSEC;
+    unsigned since_sweep = 0;
+    while(true){
+        size_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+        if(tail == head){
+            sweep(&sessions, tail);
+            since_sweep = 0;
+            if(!atomic_load(&running))
+                break;
+            struct timespec wait = {0, idle};
+            nanosleep(&wait, NULL);
+            idle = idle * 2 > IDLE_MAX_NSEC ? IDLE_MAX_NSEC : idle * 2;
+            continue;
+        }
+        idle = IDLE_MIN_NSEC;
+
+        bool found = false;
+        const size_t batch_start = tail;
+        for(; tail != head; tail++){
+            found |= analyze(&ring.chunks[tail & RING_MASK], &sessions);
+            /* Cada bloque se libera apenas se analiza */
+            atomic_store_explicit(&ring.tail, tail + 1, memory_order_release);
+        }
+        if(found)
+            wake_selector();
+        since_sweep += tail - batch_start;
+        if(since_sweep >= SWEEP_INTERVAL){
+            sweep(&sessions, tail);
+            since_sweep = 0;
+        }
+    }
+    return NULL;
+}
+
+int
+sniff_worker_start(void){
+    atomic_init(&ring.head, 0);
+    atomic_init(&ring.tail, 0);
+    atomic_init(&results.head, 0);
+    atomic_init(&results.tail, 0);
+    atomic_init(&running, true);
+    if(pipe(result_pipe) == -1)
+        return -1;
+    if(selector_fd_set_nio(result_pipe[0]) == -1 || selector_fd_set_nio(result_pipe[1]) == -1 ||
+       pthread_create(&worker_thread, NULL, worker, NULL) != 0){
+        close(result_pipe[0]);
+        close(result_pipe[1]);
+        result_pipe[0] = result_pipe[1] = -1;
+        return -1;
+    }
+    started = true;
+    return 0;
+}
+
+void
+sniff_worker_stop(void){
+    if(!started)
+        return;
+    started = false;
+    atomic_store(&running, false);
+    pthread_join(worker_thread, NULL);
+    close(result_pipe[0]);
+    close(result_pipe[1]);
+    result_pipe[0] = result_pipe[1] = -1;
+}
+
+bool
+sniff_worker_enabled(void){
+    return started;
+}
+
+int
+sniff_worker_register(fd_selector s){
+    if(!started)
+        return 0;
+    return selector_register(s, result_pipe[0], &sniff_results_handler, OP_READ, NULL)
+           == SELECTOR_SUCCESS ? 0 : -1;
+}
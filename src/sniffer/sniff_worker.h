@@ -0,0 +1,71 @@
+#ifndef SNIFF_WORKER_H
+#define SNIFF_WORKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#include "dissector.h"
+#include "../include/selector.h"
+
+/*
+Analisis de credenciales fuera del hilo del selector (socks5d -w).
+
+El relay copia cada bloque recien recibido a un ring de un productor y un
+consumidor con bloques de tamano fijo (el area de staging) y sigue; un hilo
+aparte corre los dissectors sobre esos bloques. El buffer del relay se
+compacta y se reutiliza apenas se envia, asi que no se prestan vistas sobre
+el: copiar a lo sumo DISSECTOR_SCAN_LIMIT bytes del cliente y el primer
+bloque del servidor (lo unico que miran los dissectors) es mas barato que
+retener el buffer hasta que el worker lo suelte.
+
+Si el ring esta lleno, la sesion deja de analizarse y se cuenta en
+METRIC_SNIFF_DROPS: el relay nunca espera al worker.
+
+Las credenciales vuelven por un segundo ring y un pipe registrado en el
+selector, que las guarda e imprime como pass_information. Cada sesion lleva una
+copia de los datos de la conexion (sniff_origin) porque puede haberse
+cerrado para cuando llega el resultado.
+*/
+
+#define SNIFF_RING_SIZE 256             /* bloques, potencia de 2 */
+#define SNIFF_CHUNK_SIZE 2048           /* como el buffer del relay */
+#define SNIFF_RESULT_RING_SIZE 64       /* potencia de 2 */
+#define SNIFF_NAME_SIZE 256
+
+struct sniff_origin{
+    char username[SNIFF_NAME_SIZE];     /* usuario SOCKS */
+    char client[INET6_ADDRSTRLEN];
+    int client_port;
+    char destination[SNIFF_NAME_SIZE];  /* FQDN o direccion */
+    uint16_t destination_port;
+};
+
+struct sniff_session;
+
+/** Arranca el worker. -1 si falla */
+int sniff_worker_start(void);
+
+/** Detiene el worker */
+void sniff_worker_stop(void);
+
+bool sniff_worker_enabled(void);
+
+/** Registra en el selector el pipe por el que vuelven los resultados */
+int sniff_worker_register(fd_selector s);
+
+/* Del lado del selector */
+
+/** NULL si no hay memoria o no hay ningun protocolo habilitado */
+struct sniff_session * sniff_session_new(const struct sniff_origin * origin);
+
+bool sniff_session_active(const struct sniff_session * s);
+
+/** Publica una copia de los bytes nuevos de la conexion. No bloquea */
+void sniff_feed(struct sniff_session * s, bool from_client, const uint8_t * data, size_t len);
+
+/** La conexion se cerro: el worker libera la sesion cuando termina con ella */
+void sniff_session_close(struct sniff_session * s);
+
+#endif
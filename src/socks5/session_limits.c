@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "session_limits.h"
+#include "../include/config.h"
+#include "../include/clocks.h"
+#include "../users/accounting.h"
+
+#define IP_MASK (LIMITS_IP_TABLE_SIZE - 1)
+#define USERS_INITIAL_SIZE 64
+#define AUTH_MASK (LIMITS_AUTH_SKETCH_WIDTH - 1)
+#define AUTH_HALF_LIFE_NS ((uint64_t) LIMITS_AUTH_HALF_LIFE * 1000000000ULL)
+
+struct ip_key{
+    uint8_t family;                     /* 0 si la entrada esta libre */
+    uint8_t addr[16];
+};
+
+struct ip_entry{
+    struct ip_key key;
+    uint32_t count;
+};
+
+static struct ip_entry ip_table[LIMITS_IP_TABLE_SIZE];
+static size_t ip_used = 0;
+
+static uint16_t auth_sketch[LIMITS_AUTH_SKETCH_DEPTH][LIMITS_AUTH_SKETCH_WIDTH];
+static uint64_t auth_decayed_ns = 0;    /* ultima vez que se dividio el sketch */
+
+static uint32_t * user_counts = NULL;   /* por handle de accounting */
+static size_t user_counts_size = 0;
+
+/* Las direcciones IPv4 mapeadas en IPv6 cuentan como IPv4 */
+static void
+ip_key_init(struct ip_key * key, const struct sockaddr_storage * addr){
+    memset(key, 0, sizeof(*key));
+    if(addr->ss_family == AF_INET){
+        key->family = 4;
+        memcpy(key->addr, &((const struct sockaddr_in *) addr)->sin_addr, 4);
+    } else {
+        const struct in6_addr * a = &((const struct sockaddr_in6 *) addr)->sin6_addr;
+        if(IN6_IS_ADDR_V4MAPPED(a)){
+            key->family = 4;
+            memcpy(key->addr, a->s6_addr + 12, 4);
+        } else {
+            key->family = 6;
+            memcpy(key->addr, a->s6_addr, 16);
+        }
+    }
+}
+
+static size_t
+ip_home(const struct ip_key * key){
+    uint32_t h = 2166136261u;
+    const uint8_t * p = (const uint8_t *) key;
+    for(size_t i = 0; i < sizeof(*key); i++){
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h & IP_MASK;
+}
+
+/* Entrada con la direccion, o la libre donde iria */
+static size_t
+ip_find(const struct ip_key * key){
+    size_t slot = ip_home(key);
+    while(ip_table[slot].key.family != 0 && memcmp(&ip_table[slot].key, key, sizeof(*key)) != 0)
+        slot = (slot + 1) & IP_MASK;
+    return slot;
+}
+
+/* Borrado con desplazamiento hacia atras, como en user_mgmt.c */
+static void
+ip_remove(size_t slot){
+    size_t next = slot;
+    while(true){
+        next = (next + 1) & IP_MASK;
+        if(ip_table[next].key.family == 0)
+            break;
+        size_t home = ip_home(&ip_table[next].key);
+        bool movable = slot <= next ? (home <= slot || home > next)
+                                    : (home <= slot && home > next);
+        if(movable){
+            ip_table[slot] = ip_table[next];
+            slot = next;
+        }
+    }
+    memset(&ip_table[slot], 0, sizeof(ip_table[slot]));
+    ip_used--;
+}
+
+enum limit_result
+limits_ip_acquire(const struct sockaddr_storage * addr){
+    struct ip_key key;
+    ip_key_init(&key, addr);
+    size_t slot = ip_find(&key);
+    long max = config_get(CONFIG_MAX_IP_SESSIONS);
+    if(ip_table[slot].key.family != 0){
+        if(max > 0 && ip_table[slot].count >= (uint32_t) max)
+            return LIMIT_EXCEEDED;
+        ip_table[slot].count++;
+        return LIMIT_COUNTED;
+    }
+    /* Siempre queda al menos una entrada libre para cortar el sondeo */
+    if(ip_used + 1 >= LIMITS_IP_TABLE_SIZE)
+        return LIMIT_UNTRACKED;
+    ip_table[slot].key = key;
+    ip_table[slot].count = 1;
+    ip_used++;
+    return LIMIT_COUNTED;
+}
+
+void
+limits_ip_release(const struct sockaddr_storage * addr){
+    struct ip_key key;
+    ip_key_init(&key, addr);
+    size_t slot = ip_find(&key);
+    if(ip_table[slot].key.family == 0)
+        return;
+    if(--ip_table[slot].count == 0)
+        ip_remove(slot);
+}
+
+/* FNV de 64 bits con la mezcla final de topk.c: las dos mitades se usan
+   como hashes independientes */
+static uint64_t
+ip_hash(const struct ip_key * key){
+    uint64_t h = 14695981039346656037ULL;
+    const uint8_t * p = (const uint8_t *) key;
+    for(size_t i = 0; i < sizeof(*key); i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint16_t *
+auth_cell(uint64_t hash, unsigned row){
+    uint32_t h1 = (uint32_t) hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    return &auth_sketch[row][(h1 + (size_t) row * h2) & AUTH_MASK];
+}
+
+/* Divide los contadores por 2 por cada vida media transcurrida. Se hace al
+   consultar, asi que sin intentos de autenticacion no cuesta nada */
+static void
+auth_decay(void){
+    uint64_t now = clocks_mono_ns();
+    if(auth_decayed_ns == 0 || now < auth_decayed_ns){
+        auth_decayed_ns = now;
+        return;
+    }
+    uint64_t halvings = (now - auth_decayed_ns) / AUTH_HALF_LIFE_NS;
+    if(halvings == 0)
+        return;
+    auth_decayed_ns += halvings * AUTH_HALF_LIFE_NS;
+    if(halvings >= 16){
+        memset(auth_sketch, 0, sizeof(auth_sketch));
+        return;
+    }
+    for(unsigned row = 0; row < LIMITS_AUTH_SKETCH_DEPTH; row++)
+        for(size_t col = 0; col < LIMITS_AUTH_SKETCH_WIDTH; col++)
+            auth_sketch[row][col] >>= halvings;
+}
+
+static uint16_t
+auth_estimate(uint64_t hash){
+    uint16_t min = UINT16_MAX;
+    for(unsigned row = 0; row < LIMITS_AUTH_SKETCH_DEPTH; row++){
+        uint16_t v = *auth_cell(hash, row);
+        if(v < min)
+            min = v;
+    }
+    return min;
+}
+
+bool
+limits_auth_blocked(const struct sockaddr_storage * addr){
+    long max = config_get(CONFIG_AUTH_MAX_FAILURES);
+    if(max == 0)
+        return false;
+    struct ip_key key;
+    ip_key_init(&key, addr);
+    auth_decay();
+    return auth_estimate(ip_hash(&key)) >= max;
+}
+
+void
+limits_auth_failed(const struct sockaddr_storage * addr){
+    struct ip_key key;
+    ip_key_init(&key, addr);
+    uint64_t hash = ip_hash(&key);
+    auth_decay();
+    uint16_t estimate = auth_estimate(hash);
+    if(estimate == UINT16_MAX)
+        return;
+    estimate++;
+    for(unsigned row = 0; row < LIMITS_AUTH_SKETCH_DEPTH; row++){
+        uint16_t * cell = auth_cell(hash, row);
+        if(*cell < estimate)
+            *cell = estimate;
+    }
+}
+
+enum limit_result
+limits_user_acquire(uint32_t handle){
+    if(handle == ACCOUNTING_NO_HANDLE)
+        return LIMIT_UNTRACKED;
+    if(handle >= user_counts_size){
+        size_t size = user_counts_size == 0 ? USERS_INITIAL_SIZE : user_counts_size;
+        while(size <= handle)
+            size *= 2;
+        uint32_t * counts = realloc(user_counts, size * sizeof(*counts));
+        if(counts == NULL)
+            return LIMIT_UNTRACKED;
+        memset(counts + user_counts_size, 0, (size - user_counts_size) * sizeof(*counts));
+        user_counts = counts;
+        user_counts_size = size;
+    }
+    long max = config_get(CONFIG_MAX_USER_SESSIONS);
+    if(max > 0 && user_counts[handle] >= (uint32_t) max)
+        return LIMIT_EXCEEDED;
+    user_counts[handle]++;
+    return LIMIT_COUNTED;
+}
+
+void
+limits_user_release(uint32_t handle){
+    if(handle < user_counts_size && user_counts[handle] > 0)
+        user_counts[handle]--;
+}
+
+uint32_t
+limits_user_sessions(uint32_t handle){
+    return handle < user_counts_size ? user_counts[handle] : 0;
+}
+
+void
+limits_free(void){
+    free(user_counts);
+    user_counts = NULL;
+    user_counts_size = 0;
+}
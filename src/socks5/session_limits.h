@@ -0,0 +1,62 @@
+#ifndef SESSION_LIMITS_H
+#define SESSION_LIMITS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+
+/*
+Limites de sesiones concurrentes por direccion de origen y por usuario.
+
+Las sesiones por direccion se cuentan en una tabla hash de sondeo lineal
+de tamanio fijo, reservada al arrancar: como el selector no maneja mas de
+FD_SETSIZE descriptores, nunca hay mas direcciones distintas que entradas.
+Las sesiones por usuario se cuentan en un arreglo indexado por el handle de
+accounting.h, que solo crece la primera vez que se ve un usuario. Rechazar
+una conexion no reserva memoria.
+
+Los topes son los parametros max_ip_sessions y max_user_sessions
+(config.h), 0 sin limite. Se cuenta siempre, asi que un tope nuevo aplica
+en el momento.
+
+Las autenticaciones fallidas recientes de cada direccion se estiman con un
+count-min sketch de memoria fija (con actualizacion conservadora, como
+topk.c) cuyos contadores se dividen por 2 cada LIMITS_AUTH_HALF_LIFE
+segundos. Una direccion con al menos auth_max_failures fallas estimadas se
+rechaza sin verificar las credenciales, y sus intentos siguen contando
+mientras insista. El sketch puede sobreestimar, nunca subestimar. Solo se
+usa desde el hilo del selector.
+*/
+
+#define LIMITS_IP_TABLE_SIZE (2 * FD_SETSIZE)   /* potencia de 2 */
+#define LIMITS_AUTH_SKETCH_WIDTH 1024           /* potencia de 2 */
+#define LIMITS_AUTH_SKETCH_DEPTH 4
+#define LIMITS_AUTH_HALF_LIFE 30
+
+enum limit_result {
+    LIMIT_COUNTED,
+    LIMIT_UNTRACKED,            /* sin lugar para contarla: se deja pasar */
+    LIMIT_EXCEEDED,
+};
+
+/** Una sesion mas desde `addr', si no supera max_ip_sessions */
+enum limit_result limits_ip_acquire(const struct sockaddr_storage * addr);
+void limits_ip_release(const struct sockaddr_storage * addr);
+
+/** Una sesion mas del usuario, si no supera max_user_sessions */
+enum limit_result limits_user_acquire(uint32_t handle);
+void limits_user_release(uint32_t handle);
+
+/** La direccion supera auth_max_failures: no se verifican sus credenciales */
+bool limits_auth_blocked(const struct sockaddr_storage * addr);
+
+/** Una autenticacion fallida (o rechazada) desde `addr' */
+void limits_auth_failed(const struct sockaddr_storage * addr);
+
+/** Sesiones activas del usuario */
+uint32_t limits_user_sessions(uint32_t handle);
+
+void limits_free(void);
+
+#endif
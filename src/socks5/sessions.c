@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "sessions.h"
+#include "socks5.h"
+
+#define SESSIONS_INITIAL_SLOTS 64
+
+struct session_slot{
+    uint64_t id;                        /* 0 si el slot esta libre */
+    socks_conn_model * socks;
+};
+
+static struct session_slot * slots = NULL;
+static uint32_t * free_slots = NULL;    /* pila de slots libres */
+static size_t free_count = 0;
+static size_t capacity = 0;
+static size_t used = 0;                 /* slots usados alguna vez */
+static size_t count = 0;
+
+static const char * state_names[] = {
+    [HELLO_READ]  = "hello_read",
+    [HELLO_WRITE] = "hello_write",
+    [AUTH_READ]   = "auth_read",
+    [AUTH_WRITE]  = "auth_write",
+    [REQ_READ]    = "req_read",
+    [REQ_WRITE]   = "req_write",
+    [REQ_DNS]     = "req_dns",
+    [REQ_CONNECT] = "req_connect",
+    [COPY]        = "copy",
+    [ERROR]       = "error",
+    [DONE]        = "done",
+};
+
+static bool
+grow(void){
+    size_t new_capacity = capacity == 0 ? SESSIONS_INITIAL_SLOTS : 2 * capacity;
+    struct session_slot * new_slots = realloc(slots, new_capacity * sizeof(*slots));
+    if(new_slots == NULL)
+        return false;
+    slots = new_slots;
+    uint32_t * new_free = realloc(free_slots, new_capacity * sizeof(*free_slots));
+    if(new_free == NULL)
+        return false;
+    free_slots = new_free;
+    capacity = new_capacity;
+    return true;
+}
+
+bool
+sessions_add(socks_conn_model * socks){
+    uint32_t slot;
+    if(free_count > 0){
+        slot = free_slots[--free_count];
+    } else {
+        if(used == capacity && !grow()){
+            socks->slot = SESSION_NO_SLOT;
+            return false;
+        }
+        slot = used++;
+    }
+    slots[slot].id = socks->id;
+    slots[slot].socks = socks;
+    socks->slot = slot;
+    count++;
+    return true;
+}
+
+void
+sessions_remove(socks_conn_model * socks){
+    uint32_t slot = socks->slot;
+    if(slot == SESSION_NO_SLOT || slot >= used || slots[slot].socks != socks)
+        return;
+    slots[slot].id = 0;
+    slots[slot].socks = NULL;
+    free_slots[free_count++] = slot;
+    socks->slot = SESSION_NO_SLOT;
+    count--;
+}
+
+size_t
+sessions_count(void){
+    return count;
+}
+
+socks_conn_model *
+sessions_find(uint64_t id){
+    if(id == 0)
+        return NULL;
+    for(size_t i = 0; i < used; i++)
+        if(slots[i].id == id)
+            return slots[i].socks;
+    return NULL;
+}
+
+socks_conn_model *
+sessions_next(uint64_t from_id){
+    socks_conn_model * next = NULL;
+    uint64_t next_id = UINT64_MAX;
+    for(size_t i = 0; i < used; i++){
+        uint64_t id = slots[i].id;
+        if(id != 0 && id >= from_id && id <= next_id){
+            next_id = id;
+            next = slots[i].socks;
+        }
+    }
+    return next;
+}
+
+const char *
+sessions_state_name(unsigned state){
+    return state < N(state_names) ? state_names[state] : "unknown";
+}
+
+void
+sessions_info(socks_conn_model * socks, struct session_info * info){
+    unsigned state = stm_state(&socks->stm);
+    info->id = socks->id;
+    sniff_origin_init(socks, &info->origin);
+
+    const char * user = socks_get_username(socks);
+    snprintf(info->origin.username, sizeof(info->origin.username), "%s", user == NULL ? "" : user);
+    /* El destino se conoce despues de leer el pedido */
+    if(socks->parsers->req_parser->state != REQ_DONE){
+        info->origin.destination[0] = '\0';
+        info->origin.destination_port = 0;
+    }
+
+    info->state = sessions_state_name(state);
+    info->bytes_up = socks->activity.bytes_up;
+    info->bytes_down = socks->activity.bytes_down;
+    info->started = socks->activity.started;
+    info->last_activity = socks->activity.last;
+}
+
+bool
+sessions_kill(uint64_t id){
+    socks_conn_model * socks = sessions_find(id);
+    if(socks == NULL)
+        return false;
+    socks_kill(socks);
+    return true;
+}
+
+void
+sessions_free(void){
+    free(slots);
+    free(free_slots);
+    slots = NULL;
+    free_slots = NULL;
+    capacity = used = free_count = count = 0;
+}
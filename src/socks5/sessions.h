@@ -0,0 +1,66 @@
+#ifndef SESSIONS_H
+#define SESSIONS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../sniffer/sniff_worker.h"
+
+/*
+Tabla de las sesiones SOCKS activas.
+
+Un arreglo de slots que crece al doble cuando se llena y una pila con los
+slots libres: alta y baja son O(1) y cada sesion guarda su slot. El slot
+lleva el id de la sesion junto al puntero, asi las busquedas por id
+recorren un arreglo compacto sin tocar las sesiones. Como el selector
+limita las sesiones a FD_SETSIZE, recorrerlo entero es barato y solo se
+hace desde el protocolo de control.
+
+Los contadores de bytes y la ultima actividad son campos de la sesion que
+el relay actualiza junto con las metricas que ya llevaba. Solo se usa desde
+el hilo del selector.
+*/
+
+#define SESSION_NO_SLOT UINT32_MAX
+
+struct socks_conn_model;
+
+/* Copia de lo que se muestra de una sesion */
+struct session_info{
+    uint64_t id;
+    struct sniff_origin origin;         /* destination vacio antes del pedido */
+    const char * state;
+    uint64_t bytes_up;                  /* del cliente al origen */
+    uint64_t bytes_down;                /* del origen al cliente */
+    time_t started;                     /* segundos desde epoch */
+    time_t last_activity;
+};
+
+/** Agrega la sesion. false si no hay memoria (la sesion sigue, sin listarse) */
+bool sessions_add(struct socks_conn_model * socks);
+
+/** Saca la sesion; no hace nada si no estaba */
+void sessions_remove(struct socks_conn_model * socks);
+
+size_t sessions_count(void);
+
+/** La sesion con id `id', NULL si no esta activa */
+struct socks_conn_model * sessions_find(uint64_t id);
+
+/** La sesion activa de menor id >= from_id, NULL si no hay */
+struct socks_conn_model * sessions_next(uint64_t from_id);
+
+void sessions_info(struct socks_conn_model * socks, struct session_info * info);
+
+/** Nombre del estado (socks_state) en minusculas */
+const char * sessions_state_name(unsigned state);
+
+/** Termina la sesion con id `id'. false si no esta activa */
+bool sessions_kill(uint64_t id);
+
+/** Libera la tabla al terminar el servidor */
+void sessions_free(void);
+
+#endif
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "shaper.h"
+#include "socks5.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+#define SHAPER_INITIAL_SIZE 64
+
+static struct token_bucket * user_buckets = NULL;   /* por handle de accounting */
+static size_t user_buckets_size = 0;
+
+/* Min-heap de los lados demorados por su vencimiento */
+static struct copy_model_t ** heap = NULL;
+static size_t heap_count = 0;
+static size_t heap_size = 0;
+
+static int64_t
+burst_for(long rate){
+    int64_t burst = rate / SHAPER_BURST_DIVISOR;
+    return burst < SHAPER_MIN_BURST ? SHAPER_MIN_BURST : burst;
+}
+
+/* Suma lo acumulado desde la ultima vez. Si todavia no completo un byte,
+   last_ns no avanza para no perder la fraccion */
+static void
+refill(struct token_bucket * b, long rate, uint64_t now){
+    int64_t burst = burst_for(rate);
+    uint64_t elapsed = now - b->last_ns;
+    if(b->last_ns == 0 || elapsed >= NSEC_PER_SEC){
+        b->tokens = burst;
+        b->last_ns = now;
+        return;
+    }
+    int64_t add = (int64_t)(elapsed * (uint64_t) rate / NSEC_PER_SEC);
+    if(add > 0){
+        b->tokens = b->tokens + add > burst ? burst : b->tokens + add;
+        b->last_ns = now;
+    }
+}
+
+static struct token_bucket *
+user_bucket(uint32_t handle){
+    if(handle == ACCOUNTING_NO_HANDLE)
+        return NULL;
+    if(handle >= user_buckets_size){
+        size_t size = user_buckets_size == 0 ? SHAPER_INITIAL_SIZE : user_buckets_size;
+        while(size <= handle)
+            size *= 2;
+        struct token_bucket * buckets = realloc(user_buckets, size * sizeof(*buckets));
+        if(buckets == NULL)
+            return NULL;
+        memset(buckets + user_buckets_size, 0, (size - user_buckets_size) * sizeof(*buckets));
+        user_buckets = buckets;
+        user_buckets_size = size;
+    }
+    return &user_buckets[handle];
+}
+
+size_t
+shaper_allowance(socks_conn_model * socks){
+    long session_rate = config_get(CONFIG_SESSION_RATE);
+    long user_rate = config_get(CONFIG_USER_RATE);
+    if(session_rate == 0 && user_rate == 0)
+        return SIZE_MAX;
+
+    uint64_t now = clocks_mono_ns();
+    int64_t allowed = INT64_MAX;
+    if(session_rate > 0){
+        refill(&socks->bucket, session_rate, now);
+        allowed = socks->bucket.tokens;
+    }
+    struct token_bucket * b = user_rate > 0 ? user_bucket(socks->account) : NULL;
+    if(b != NULL){
+        refill(b, user_rate, now);
+        if(b->tokens < allowed)
+            allowed = b->tokens;
+    }
+    if(allowed == INT64_MAX)
+        return SIZE_MAX;
+    return allowed > 0 ? (size_t) allowed : 0;
+}
+
+void
+shaper_consume(socks_conn_model * socks, size_t bytes){
+    if(config_get(CONFIG_SESSION_RATE) > 0)
+        socks->bucket.tokens -= bytes;
+    struct token_bucket * b = config_get(CONFIG_USER_RATE) > 0 ? user_bucket(socks->account) : NULL;
+    if(b != NULL)
+        b->tokens -= bytes;
+}
+
+/* Tiempo hasta que el bucket tenga la mitad de su capacidad */
+static uint64_t
+wait_for(const struct token_bucket * b, long rate){
+    int64_t missing = burst_for(rate) / 2 - b->tokens;
+    return missing <= 0 ? 0 : (uint64_t) missing * NSEC_PER_SEC / (uint64_t) rate + 1;
+}
+
+static void
+heap_swap(size_t i, size_t j){
+    struct copy_model_t * aux = heap[i];
+    heap[i] = heap[j];
+    heap[j] = aux;
+    heap[i]->heap_index = i;
+    heap[j]->heap_index = j;
+}
+
+static void
+heap_up(size_t i){
+    while(i > 0 && heap[(i - 1) / 2]->wake_ns > heap[i]->wake_ns){
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void
+heap_down(size_t i){
+    while(true){
+        size_t min = i, l = 2 * i + 1, r = l + 1;
+        if(l < heap_count && heap[l]->wake_ns < heap[min]->wake_ns)
+            min = l;
+        if(r < heap_count && heap[r]->wake_ns < heap[min]->wake_ns)
+            min = r;
+        if(min == i)
+            return;
+        heap_swap(i, min);
+        i = min;
+    }
+}
+
+static bool
+heap_push(struct copy_model_t * copy){
+    if(heap_count == heap_size){
+        size_t size = heap_size == 0 ? SHAPER_INITIAL_SIZE : 2 * heap_size;
+        struct copy_model_t ** new_heap = realloc(heap, size * sizeof(*heap));
+        if(new_heap == NULL)
+            return false;
+        heap = new_heap;
+        heap_size = size;
+    }
+    heap[heap_count] = copy;
+    copy->heap_index = heap_count++;
+    heap_up(copy->heap_index);
+    return true;
+}
+
+static void
+heap_remove(struct copy_model_t * copy){
+    size_t i = copy->heap_index;
+    heap_count--;
+    if(i != heap_count){
+        heap[i] = heap[heap_count];
+        heap[i]->heap_index = i;
+        heap_down(i);
+        heap_up(i);
+    }
+}
+
+void
+shaper_throttle(socks_conn_model * socks, struct copy_model_t * copy, fd_selector s){
+    if(copy->throttled)
+        return;
+    long session_rate = config_get(CONFIG_SESSION_RATE);
+    long user_rate = config_get(CONFIG_USER_RATE);
+    uint64_t wait = 0;
+    if(session_rate > 0)
+        wait = wait_for(&socks->bucket, session_rate);
+    struct token_bucket * b = user_rate > 0 ? user_bucket(socks->account) : NULL;
+    if(b != NULL){
+        uint64_t user_wait = wait_for(b, user_rate);
+        if(user_wait > wait)
+            wait = user_wait;
+    }
+
+    copy->wake_ns = clocks_mono_ns() + wait;
+    if(!heap_push(copy))
+        return;             /* sin memoria no se demora: el bucket igual limita */
+    copy->throttled = true;
+    copy->interests &= ~OP_READ;
+    selector_set_interest(s, copy->fd, copy->interests);
+    metrics_add(METRIC_SHAPER_THROTTLES, 1);
+}
+
+void
+shaper_cancel(socks_conn_model * socks){
+    if(socks->cli_copy.throttled)
+        heap_remove(&socks->cli_copy);
+    if(socks->src_copy.throttled)
+        heap_remove(&socks->src_copy);
+    socks->cli_copy.throttled = socks->src_copy.throttled = false;
+}
+
+uint64_t
+shaper_next_wait_ns(void){
+    if(heap_count == 0)
+        return UINT64_MAX;
+    uint64_t now = clocks_mono_ns();
+    return heap[0]->wake_ns > now ? heap[0]->wake_ns - now : 0;
+}
+
+void
+shaper_tick(fd_selector s){
+    uint64_t now = clocks_mono_ns();
+    while(heap_count > 0 && heap[0]->wake_ns <= now){
+        struct copy_model_t * copy = heap[0];
+        heap_remove(copy);
+        copy->throttled = false;
+        copy->interests = (copy->interests | OP_READ) & copy->int_connection;
+        selector_set_interest(s, copy->fd, copy->interests);
+    }
+}
+
+void
+shaper_free(void){
+    free(user_buckets);
+    free(heap);
+    user_buckets = NULL;
+    heap = NULL;
+    user_buckets_size = heap_count = heap_size = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef SHAPER_H
+#define SHAPER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../include/selector.h"
+
+/*
+Limites de ancho de banda por usuario y por sesion.
+
+Cada sesion tiene un token bucket y cada usuario autenticado otro,
+compartido por todas sus sesiones (indexado por el handle de accounting.h).
+Los buckets se recargan al consultarlos segun el tiempo transcurrido, asi
+que no hay un barrido periodico. copy_read lee a lo sumo lo que permiten
+ambos y lo descuenta, en las dos direcciones.
+
+Cuando un bucket se vacia, se saca el interes de lectura de ese lado del
+relay y se agenda su vuelta para cuando se recargue la mitad del bucket:
+los vencimientos estan en un heap y el servidor acorta el timeout del
+selector hasta el proximo. Nunca se espera activamente ni se duerme.
+
+Las tasas son los parametros user_rate y session_rate (config.h), en
+bytes por segundo; 0 es sin limite. Cada bucket guarda hasta
+SHAPER_BURST_DIVISOR-avos de segundo de trafico, al menos
+SHAPER_MIN_BURST bytes. Solo se usa desde el hilo del selector.
+*/
+
+#define SHAPER_BURST_DIVISOR 10
+#define SHAPER_MIN_BURST 4096
+
+struct socks_conn_model;
+struct copy_model_t;
+
+struct token_bucket{
+    int64_t tokens;
+    uint64_t last_ns;                   // 0 si nunca se uso: arranca lleno
+};
+
+/** Bytes que la sesion puede leer ahora, SIZE_MAX si no tiene limites */
+size_t shaper_allowance(struct socks_conn_model * socks);
+
+/** Descuenta `bytes' leidos de los buckets de la sesion */
+void shaper_consume(struct socks_conn_model * socks, size_t bytes);
+
+/** Saca el interes de lectura de `copy' hasta que los buckets se recarguen */
+void shaper_throttle(struct socks_conn_model * socks, struct copy_model_t * copy, fd_selector s);
+
+/** La sesion se cierra: deja de estar agendada */
+void shaper_cancel(struct socks_conn_model * socks);
+
+/** Nanosegundos hasta el proximo vencimiento, UINT64_MAX si no hay */
+uint64_t shaper_next_wait_ns(void);
+
+/** Devuelve el interes de lectura a los lados que ya vencieron */
+void shaper_tick(fd_selector s);
+
+void shaper_free(void);
+
+#endif
@@ -2,22 +2,28 @@
 
 #define CLI 0
 #define SRC 1
-#define BUFF_SIZE 2048 // 
 
 /*----------------------
  |  Helping functions
  -----------------------*/
 
 static int 
-check_buff_and_receive(buffer * buff_ptr, int socket){
+check_buff_and_receive_max(buffer * buff_ptr, int socket, size_t max){
     size_t byte_n;
     uint8_t * write_ptr = buffer_write_ptr(buff_ptr, &byte_n);
+    if(byte_n > max) byte_n = max;
     ssize_t n_received = recv(socket, write_ptr, byte_n, 0); //TODO:Flags?
+    if(n_received == 0) errno = 0;      // EOF, not a stale EAGAIN
     if(n_received <= 0) return -1;
     buffer_write_adv(buff_ptr, n_received);
     return n_received;
 }
 
+static int 
+check_buff_and_receive(buffer * buff_ptr, int socket){
+    return check_buff_and_receive_max(buff_ptr, socket, SIZE_MAX);
+}
+
 static int 
 check_buff_and_send(buffer * buff_ptr, int socket){
     size_t n_available;
@@ -28,17 +34,104 @@ check_buff_and_send(buffer * buff_ptr, int socket){
     return n_sent;
 }
 
+/*----------------------
+ |  Latency tracking
+ -----------------------*/
+
+static void
+phase_arrival(const unsigned state, struct selector_key * key){
+    socks_conn_model * socks = (socks_conn_model *)key->data;
+    socks->timings.phase_start = metrics_now_usec();
+}
+
+static void
+phase_departure(const unsigned state, struct selector_key * key){
+    socks_conn_model * socks = (socks_conn_model *)key->data;
+    uint64_t now = metrics_now_usec();
+    switch(state){
+        case HELLO_WRITE:
+            metrics_record_latency(LATENCY_HELLO, now - socks->timings.accepted);
+            break;
+        case AUTH_WRITE:
+            metrics_record_latency(LATENCY_AUTH, now - socks->timings.phase_start);
+            break;
+        case REQ_DNS:
+            metrics_record_latency(LATENCY_DNS, now - socks->timings.phase_start);
+            break;
+        case REQ_CONNECT:
+            metrics_record_latency(LATENCY_CONNECT, now - socks->timings.phase_start);
+            break;
+        default:
+            break;
+    }
+}
+
+/*----------------------
+ |  Top-K accounting
+ -----------------------*/
+
+/* Destination as host:port, hashed once for the rest of the session */
+static void
+set_top_keys(socks_conn_model * socks){
+    struct req_parser * parser = socks->parsers->req_parser;
+    struct socks_top_keys * keys = &socks->top_keys;
+    char host[INET6_ADDRSTRLEN] = {0};
+    const char * format = "%s:%u";
+    switch(parser->type){
+        case IPv4:
+            inet_ntop(AF_INET, &parser->addr.ipv4.sin_addr, host, sizeof(host));
+            break;
+        case IPv6:
+            inet_ntop(AF_INET6, &parser->addr.ipv6.sin6_addr, host, sizeof(host));
+            format = "[%s]:%u";
+            break;
+        default:
+            break;
+    }
+    int len = snprintf(keys->dst, sizeof(keys->dst), format,
+                       parser->type == FQDN ? (char *)parser->addr.fqdn : host,
+                       ntohs(parser->port));
+    keys->dst_len = len < 0 ? 0 : ((size_t)len < sizeof(keys->dst) ? (size_t)len : sizeof(keys->dst) - 1);
+    keys->dst_hash = topk_hash(keys->dst, keys->dst_len);
+
+    keys->user = socks_get_username(socks);
+    if(keys->user != NULL){
+        keys->user_len = strlen(keys->user);
+        keys->user_hash = topk_hash(keys->user, keys->user_len);
+    }
+    keys->ready = true;
+}
+
+static void
+top_add(socks_conn_model * socks, long connections, long bytes){
+    struct socks_top_keys * keys = &socks->top_keys;
+    if(!keys->ready)
+        return;
+    metrics_top_add(TOP_DESTINATIONS, keys->dst, keys->dst_len, keys->dst_hash,
+                    connections, bytes);
+    if(keys->user != NULL)
+        metrics_top_add(TOP_USERS, keys->user, keys->user_len, keys->user_hash,
+                        connections, bytes);
+}
+
 /*----------------------
  |  Connection functions
  -----------------------*/
 
+/* Parsers are reset once per state, not per read: a message split across
+   several reads keeps its partial progress */
+static void
+hello_read_arrival(const unsigned state, struct selector_key * key){
+    socks_conn_model * socks = (socks_conn_model *)key->data;
+    start_connection_parser(socks->parsers->connect_parser);
+}
+
 static enum socks_state hello_read(struct selector_key * key){
     
     if(key == NULL)
         return ERROR;
 
     struct socks_conn_model * socks = (socks_conn_model *)key->data;
-    start_connection_parser(socks->parsers->connect_parser);
 
     if(check_buff_and_receive(&socks->buffers->read_buff,
                                     socks->cli_conn->socket) == -1){ return ERROR; }
@@ -108,6 +201,13 @@ hello_write(struct selector_key * key){
  |  Authentication functions
  ---------------------------*/
 
+static void
+auth_read_arrival(const unsigned state, struct selector_key * key){
+    socks_conn_model * socks = (socks_conn_model *)key->data;
+    phase_arrival(state, key);
+    auth_parser_init(socks->parsers->auth_parser);
+}
+
  static enum socks_state 
  auth_read(struct selector_key * key){
 
@@ -115,7 +215,6 @@ hello_write(struct selector_key * key){
         return ERROR;
 
     socks_conn_model * socks = (socks_conn_model *)key->data;
-    auth_parser_init(socks->parsers->auth_parser);
 
     if(check_buff_and_receive(&socks->buffers->read_buff,
                                     socks->cli_conn->socket) == -1){ return ERROR; }
@@ -127,9 +226,39 @@ hello_write(struct selector_key * key){
         return ERROR;
     }
     if(ret_state == AUTH_DONE){ 
-        int is_authenticated = process_authentication_request((char*)parser->username, 
-                                                                  (char*)parser->password);
-        if(is_authenticated != -1) set_curr_user((char*)parser->username);
+        int is_authenticated = -1;
+        /* Addresses with too many recent failures are refused without
+           checking the credentials, and the attempt counts as one more */
+        if(limits_auth_blocked(&socks->cli_conn->addr)){
+            metrics_add(METRIC_AUTH_THROTTLES, 1);
+        } else {
+            is_authenticated = process_authentication_request((char*)parser->username,
+                                                              (char*)parser->password);
+        }
+        if(is_authenticated != -1){
+            set_curr_user((char*)parser->username);
+            socks->authenticated = needs_auth();
+        } else {
+            /* RFC 1929: after a failure status the server closes the connection */
+            limits_auth_failed(&socks->cli_conn->addr);
+            socks->auth_rejected = true;
+        }
+        if(socks->authenticated){
+            socks->account = accounting_handle((char*)parser->username);
+            enum limit_result limit = limits_user_acquire(socks->account);
+            if(limit == LIMIT_EXCEEDED){
+                /* Over max_user_sessions: the credentials are fine, but the
+                   session is refused like a failed authentication */
+                metrics_add(METRIC_LIMIT_REJECTS, 1);
+                socks->authenticated = false;
+                socks->auth_rejected = true;
+                socks->account = ACCOUNTING_NO_HANDLE;
+                is_authenticated = -1;
+            } else {
+                socks->user_counted = limit == LIMIT_COUNTED;
+                accounting_session_start(socks->account);
+            }
+        }
         selector_status ret_selector = selector_set_interest_key(key, OP_WRITE);
         if(ret_selector != SELECTOR_SUCCESS) return ERROR;        
         size_t n_available;
@@ -159,6 +288,9 @@ auth_write(struct selector_key * key){
     if(buffer_can_read(&socks->buffers->write_buff)){
         return AUTH_WRITE;
     }
+    if(socks->auth_rejected){
+        return DONE;
+    }
     selector_status ret_selector = selector_set_interest_key(key, OP_READ);
     return ret_selector == SELECTOR_SUCCESS? REQ_READ:ERROR;
 }
@@ -342,10 +474,35 @@ set_connection(socks_conn_model * socks, struct req_parser * parser, enum req_at
     return init_connection(parser, socks, key);
 }
 
+static bool
+destination_allowed(socks_conn_model * socks, struct req_parser * parser){
+    const char * user = socks_get_username(socks);
+    uint16_t port = ntohs(parser->port);
+    switch(parser->type){
+        case IPv4:
+            return acl_check(AF_INET, (uint8_t *)&parser->addr.ipv4.sin_addr,
+                             port, user) == ACL_ALLOW;
+        case IPv6:
+            return acl_check(AF_INET6, parser->addr.ipv6.sin6_addr.s6_addr,
+                             port, user) == ACL_ALLOW;
+        case FQDN:
+            /* Blocked names never reach the resolver. Allowed ones are
+               checked against the ACL once resolved (req_dns) */
+            return domain_acl_check((char *)parser->addr.fqdn) == ACL_ALLOW;
+        default:
+            return true;
+    }
+}
+
+static void
+req_read_arrival(const unsigned state, struct selector_key * key){
+    socks_conn_model * socks = (socks_conn_model *)key->data;
+    req_parser_init(socks->parsers->req_parser);
+}
+
 static enum socks_state 
 req_read(struct selector_key * key) {
     socks_conn_model * socks = (socks_conn_model *)key->data;
-    req_parser_init(socks->parsers->req_parser);
 
     if(check_buff_and_receive(&socks->buffers->read_buff,
                                     socks->cli_conn->socket) == -1){ return ERROR; }
@@ -355,6 +512,9 @@ req_read(struct selector_key * key) {
     if (parser_state == REQ_DONE) {
         switch (parser->cmd) {
             case REQ_CMD_CONNECT:
+                if(!destination_allowed(socks, parser)){
+                    return manage_req_error(parser, RES_CONN_FORBIDDEN, socks, key);
+                }
                 return set_connection(socks, parser, parser->type, key);
             case REQ_CMD_BIND:
             case REQ_CMD_UDP:
@@ -376,13 +536,27 @@ req_dns(struct selector_key * key) {
     socks_conn_model * socks = (socks_conn_model *)key->data;
     struct req_parser * parser = socks->parsers->req_parser;
 
+    if (socks->killed) {
+        return ERROR;
+    }
+
+    /* Resolved addresses go through the same ACL as literal ones */
+    bool denied = false;
+    while (socks->curr_addr != NULL &&
+           acl_check_sockaddr(socks->curr_addr->ai_addr,
+                              socks_get_username(socks)) == ACL_DENY) {
+        denied = true;
+        socks->curr_addr = socks->curr_addr->ai_next;
+    }
+
     if (socks->curr_addr == NULL) {
         if (socks->resolved_addr != NULL) {
             freeaddrinfo(socks->resolved_addr);
             socks->resolved_addr = NULL;
             socks->curr_addr = NULL;
         }
-        return manage_req_error(parser, RES_HOST_UNREACHABLE, socks, key);
+        return manage_req_error(parser, denied ? RES_CONN_FORBIDDEN : RES_HOST_UNREACHABLE,
+                                socks, key);
     }
 
     socks->src_addr_family = socks->curr_addr->ai_family;
@@ -467,10 +641,12 @@ req_write(struct selector_key * key) {
         return ERROR;
     }
 
-
-    conn_information(socks);
     if(buffer_can_read(&socks->buffers->write_buff)){ return REQ_WRITE; }
+    conn_information(socks);
+    TRACE(SOCKS_REQUEST, key->fd, socks->id, parser->type, parser->res_parser.state);
     if(parser->res_parser.state != RES_SUCCESS){return DONE; }
+    set_top_keys(socks);
+    top_add(socks, 1, 0);
     selector_status selector_ret = selector_set_interest_key(key, OP_READ);
     if(selector_ret == SELECTOR_SUCCESS){
         selector_ret = selector_set_interest(key->s, socks->src_conn->socket, OP_READ);
@@ -517,11 +693,25 @@ copy_on_arrival(unsigned state, struct selector_key * key) {
         LogError("Error initializng copy structures\n");
     }
 
+    phase_arrival(state, key);
+
+    /* The rule that let the destination through gives the class */
+    socks->priority = acl_priority_sockaddr((struct sockaddr *)&socks->src_conn->addr,
+                                            socks_get_username(socks));
+    if(socks->priority != ACL_PRIORITY_BULK){
+        selector_set_priority(key->s, socks->cli_conn->socket, socks->priority);
+        selector_set_priority(key->s, socks->src_conn->socket, socks->priority);
+    }
+
+    /* El protocolo se reconoce por los primeros bytes, no por el puerto */
     if(sniffer_is_on()){
-        socks->pop3_parser = malloc(sizeof(pop3_parser));
-        pop3_parser_init(socks->pop3_parser); 
-        if(socks->pop3_parser == NULL)
-            LogError("Pop3Parser is null\n");    
+        if(sniff_worker_enabled()){
+            struct sniff_origin origin;
+            sniff_origin_init(socks, &origin);
+            socks->sniff = sniff_session_new(&origin);
+        } else {
+            socks->dissector = dissector_session_new();
+        }
     }
 }
 static struct copy_model_t *
@@ -531,6 +721,39 @@ get_copy(int fd, int cli_sock, int src_sock, socks_conn_model * socks){
            NULL;
 }
 
+/* Sends what `copy' has pending to its socket and accounts it. 0 if the
+   socket would block, -1 on error */
+static int
+relay_send(socks_conn_model * socks, struct copy_model_t * copy){
+    int bytes_sent = check_buff_and_send(copy->read_buff, copy->fd);
+    if(bytes_sent == -1){
+        return errno == EWOULDBLOCK || errno == EAGAIN ? 0 : -1;
+    }
+
+    add_bytes_transferred((long)bytes_sent);
+    top_add(socks, 0, bytes_sent);
+    if(copy->fd == socks->cli_conn->socket){
+        socks->activity.bytes_down += bytes_sent;
+        accounting_add(socks->account, 0, bytes_sent);
+    } else {
+        socks->activity.bytes_up += bytes_sent;
+        accounting_add(socks->account, bytes_sent, 0);
+    }
+    socks->activity.last = clocks_wall_sec();
+    if(!socks->timings.first_byte_sent && copy->fd == socks->cli_conn->socket && bytes_sent > 0){
+        socks->timings.first_byte_sent = true;
+        metrics_record_latency(LATENCY_FIRST_BYTE,
+                               metrics_now_usec() - socks->timings.phase_start);
+    }
+    return bytes_sent;
+}
+
+/* Reads and forwards right away, until the socket has nothing left, the
+   peer stops taking bytes or the side spends its io_budget for this
+   iteration. A side that stopped at its budget is still readable, so the
+   selector serves it again on the next iteration after everyone else.
+   Interactive sessions are served first and get interactive_weight times
+   the budget, so they can take a bigger share but never all of it */
 static enum socks_state 
 copy_read(struct selector_key * key) {
     socks_conn_model * socks = (socks_conn_model *)key->data;
@@ -540,37 +763,76 @@ copy_read(struct selector_key * key) {
         LogError("Copy is null\n");
         return ERROR;
     }
-    if(buffer_can_write(copy->write_buff)){
-        int bytes_read = check_buff_and_receive(copy->write_buff, key->fd);
+    size_t budget = (size_t) config_get(CONFIG_IO_BUDGET);
+    if(socks->priority == ACL_PRIORITY_INTERACTIVE){
+        budget *= (size_t) config_get(CONFIG_INTERACTIVE_WEIGHT);
+    }
+    const bool from_client = key->fd == socks->cli_conn->socket;
+    while(buffer_can_write(copy->write_buff)){
+        if(budget == 0){
+            return COPY;
+        }
+        size_t allowed = shaper_allowance(socks);
+        if(allowed == 0){
+            shaper_throttle(socks, copy, key->s);
+            return COPY;
+        }
+        int bytes_read = check_buff_and_receive_max(copy->write_buff, key->fd,
+                                                    allowed < budget ? allowed : budget);
         if(bytes_read == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
             return COPY;
         }
+        if(bytes_read <= 0){
+            break;
+        }
+        budget -= bytes_read;
+        shaper_consume(socks, bytes_read);
+
+        /* Solo lo recien recibido */
+        const uint8_t * received = copy->write_buff->write - bytes_read;
+        if(sniff_session_active(socks->sniff) && sniffer_is_on()){
+            sniff_feed(socks->sniff, from_client, received, bytes_read);
+        } else if(dissector_active(socks->dissector) && sniffer_is_on()){
+            if(dissector_feed(socks->dissector, from_client, received, bytes_read)
+               == DISSECTOR_CREDENTIALS){
+                pass_information(socks);
+            }
+        }
 
-        if(bytes_read > 0){
-            copy->aux->interests = copy->aux->interests | OP_WRITE;
-            copy->aux->interests = copy->aux->interests & copy->aux->int_connection;
+        /* What the peer takes now does not wait for its write event */
+        if(copy->aux->int_connection & OP_WRITE){
+            if(relay_send(socks, copy->aux) == -1){
+                LogError("Error sending bytes to the peer socket.");
+                return ERROR;
+            }
+        }
+        if(buffer_can_read(copy->write_buff)){
+            copy->aux->interests = (copy->aux->interests | OP_WRITE) & copy->aux->int_connection;
             selector_set_interest(key->s, copy->aux->fd, copy->aux->interests); //TODO: Capture error?
-
-            if(ntohs(socks->parsers->req_parser->port) == POP3_PORT && 
-                socks->pop3_parser != NULL && sniffer_is_on()){
-                if(pop3_parse(socks->pop3_parser, copy->write_buff) == POP3_DONE){
-                    pass_information(socks);
-                }
+            if(!buffer_can_write(copy->write_buff)){
+                /* Full: reading resumes once the peer drains it */
+                copy->interests = (copy->interests & OP_WRITE) & copy->int_connection;
+                selector_set_interest(key->s, key->fd, copy->interests);
+                return COPY;
             }
-            return COPY;
+        } else if(copy->aux->interests & OP_WRITE){
+            copy->aux->interests &= ~OP_WRITE;
+            selector_set_interest(key->s, copy->aux->fd, copy->aux->interests);
         }
-
-        
+    }
+    if(buffer_can_write(copy->write_buff)){
         copy->int_connection = copy->int_connection & ~OP_READ;
         copy->interests = copy->interests & copy->int_connection;
         selector_set_interest(key->s, copy->fd, copy->interests); //TODO: Capture selector error?
         // https://stackoverflow.com/questions/570793/how-to-stop-a-read-operation-on-a-socket
         // man -s 2 shutdown
         shutdown(copy->fd, SHUT_RD);
-        copy->aux->int_connection = 
-            copy->aux->int_connection & OP_READ;
-        
+
+        /* With bytes still pending the peer keeps OP_WRITE: copy_write
+           shuts it down once they are sent */
         if(!buffer_can_read(copy->write_buff)){
+            copy->aux->int_connection = 
+                copy->aux->int_connection & OP_READ;
             copy->aux->interests &= copy->aux->int_connection;
             selector_set_interest(key->s, copy->aux->fd, copy->aux->interests);
             shutdown(copy->aux->fd, SHUT_WR);
@@ -595,47 +857,55 @@ copy_write(struct selector_key * key) {
         return ERROR;
     }
 
-    int bytes_sent = check_buff_and_send(copy->read_buff, key->fd);
+    int bytes_sent = relay_send(socks, copy);
     if(bytes_sent == -1){
-        if(errno == EWOULDBLOCK || errno == EAGAIN){ return COPY; }
         LogError("Error sending bytes to client socket.");
         return ERROR;
     }
+    if(bytes_sent == 0 && buffer_can_read(copy->read_buff)){ return COPY; }
 
-    add_bytes_transferred((long)bytes_sent);
-    copy->aux->interests = (copy->aux->interests | OP_READ) & copy->aux->int_connection;
-    selector_set_interest(key->s, copy->aux->fd, copy->aux->interests);
+    if(!copy->aux->throttled){
+        copy->aux->interests = (copy->aux->interests | OP_READ) & copy->aux->int_connection;
+        selector_set_interest(key->s, copy->aux->fd, copy->aux->interests);
+    }
 
     if (!buffer_can_read(copy->read_buff)) {
-        copy->interests = (copy->interests & OP_READ) & copy->int_connection;
-        selector_set_interest(key->s, copy->fd, copy->interests);
-        uint8_t still_write = copy->int_connection & OP_WRITE;
-        if(still_write == 0){
+        /* Everything the peer sent before closing is out */
+        if(!(copy->aux->int_connection & OP_READ)){
+            copy->int_connection = copy->int_connection & OP_READ;
             shutdown(copy->fd, SHUT_WR);
         }
+        copy->interests = (copy->interests & OP_READ) & copy->int_connection;
+        selector_set_interest(key->s, copy->fd, copy->interests);
     }
-    return COPY;
+    return copy->int_connection == OP_NOOP &&
+           copy->aux->int_connection == OP_NOOP ? DONE : COPY;
 }
 
 static const struct state_definition states[] = {
     {
         .state = HELLO_READ,
+        .on_arrival = hello_read_arrival,
         .on_read_ready = hello_read,
     },
     {
         .state = HELLO_WRITE,
+        .on_departure = phase_departure,
         .on_write_ready = hello_write,
     },
     {
         .state = AUTH_READ,
+        .on_arrival = auth_read_arrival,
         .on_read_ready = auth_read,
     },
     {
         .state = AUTH_WRITE,
+        .on_departure = phase_departure,
         .on_write_ready = auth_write,
     },
     {
         .state = REQ_READ,
+        .on_arrival = req_read_arrival,
         .on_read_ready = req_read,
     },
     {
@@ -644,10 +914,14 @@ static const struct state_definition states[] = {
     },
     {
         .state = REQ_DNS,
+        .on_arrival = phase_arrival,
+        .on_departure = phase_departure,
         .on_block_ready = req_dns,
     },
     {
         .state = REQ_CONNECT,
+        .on_arrival = phase_arrival,
+        .on_departure = phase_departure,
         .on_write_ready = req_connect,
     },
     {
@@ -664,6 +938,13 @@ static const struct state_definition states[] = {
     }
 };
 
+const char *
+socks_get_username(socks_conn_model * socks){
+    return socks->authenticated ? (char *)socks->parsers->auth_parser->username : NULL;
+}
+
+static uint64_t last_session_id = 0;
+
 socks_conn_model * 
 new_socks_conn() {
     socks_conn_model * socks = malloc(sizeof(struct socks_conn_model));
@@ -672,6 +953,9 @@ new_socks_conn() {
         return NULL; 
     }
     memset(socks, 0x00, sizeof(*socks));
+    socks->id = ++last_session_id;
+    socks->activity.started = socks->activity.last = clocks_wall_sec();
+    socks->account = ACCOUNTING_NO_HANDLE;
 
     socks->cli_conn = malloc(sizeof(struct std_conn_model));
     socks->src_conn = malloc(sizeof(struct std_conn_model));
@@ -679,6 +963,9 @@ new_socks_conn() {
     memset(socks->src_conn, 0x00, sizeof(*(socks->src_conn)));
     socks->cli_conn->interests = OP_READ;
     socks->src_conn->interests = OP_NOOP;
+    /* No origin socket until the request is processed (rejected requests
+       must not close fd 0) */
+    socks->src_conn->socket = -1;
 
     socks->parsers = malloc(sizeof(struct parsers_t));
     memset(socks->parsers, 0x00, sizeof(*(socks->parsers)));
@@ -695,13 +982,30 @@ new_socks_conn() {
     socks->stm.states = states;
     stm_init(&socks->stm);
 
+    /* El tamanio se lee en cada sesion: un cambio aplica a las nuevas */
+    const size_t buff_size = config_get(CONFIG_SOCKS_BUFFER);
     socks->buffers = malloc(sizeof(struct buffers_t));
-    socks->buffers->aux_read_buff = malloc((uint32_t)BUFF_SIZE);
-    socks->buffers->aux_write_buff = malloc((uint32_t)BUFF_SIZE);
+    socks->buffers->aux_read_buff = malloc(buff_size);
+    socks->buffers->aux_write_buff = malloc(buff_size);
 
-    buffer_init(&socks->buffers->read_buff, BUFF_SIZE, socks->buffers->aux_read_buff);
-    buffer_init(&socks->buffers->write_buff, BUFF_SIZE, socks->buffers->aux_write_buff);
+    buffer_init(&socks->buffers->read_buff, buff_size, socks->buffers->aux_read_buff);
+    buffer_init(&socks->buffers->write_buff, buff_size, socks->buffers->aux_write_buff);
+
+    if(!sessions_add(socks)){
+        LogError("No memory for the session table, session %llu is not listed",
+                 (unsigned long long) socks->id);
+    }
 
     return socks;
 }
 
+void
+socks_kill(socks_conn_model * socks){
+    if(stm_state(&socks->stm) == REQ_DNS){
+        /* req_dns_thread still writes to the session */
+        socks->killed = true;
+        return;
+    }
+    close_socks_conn(socks);
+}
+
@@ -14,6 +14,7 @@
 #include <string.h>
 
 #include "../include/stm.h"
+#include "../include/topk.h"
 #include "../include/buffer.h"
 #include "../include/selector.h"
 #include "../include/server.h"
@@ -21,9 +22,19 @@
 #include "../parsers/auth_parser.h"
 #include "../parsers/req_parser.h"
 #include "../users/user_mgmt.h"
+#include "../users/accounting.h"
 #include "../logger/logger.h"
+#include "../logger/trace.h"
 #include "../include/metrics.h"
-#include "../sniffer/pop3_sniffer.h"
+#include "../include/clocks.h"
+#include "../include/config.h"
+#include "../sniffer/dissector.h"
+#include "../sniffer/sniff_worker.h"
+#include "../acl/acl.h"
+#include "../acl/domain_acl.h"
+#include "sessions.h"
+#include "shaper.h"
+#include "session_limits.h"
 
 
 #define N(x) (sizeof(x)/sizeof((x)[0]))
@@ -64,6 +75,36 @@ struct copy_model_t{
     struct copy_model_t * aux;
     fd_interest interests;
     fd_interest int_connection;
+    /* Reading stopped by the rate limits until wake_ns (shaper.h) */
+    bool throttled;
+    uint64_t wake_ns;
+    size_t heap_index;
+};
+
+/* Timestamps (metrics_now_usec) taken at the stm transitions */
+struct socks_timings{
+    uint64_t accepted;
+    uint64_t phase_start;
+    bool first_byte_sent;
+};
+
+/* Keys the session is accounted under in the top-K tables */
+struct socks_top_keys{
+    bool ready;
+    uint64_t dst_hash;
+    uint64_t user_hash;
+    const char * user;          // NULL for unauthenticated sessions
+    size_t user_len;
+    size_t dst_len;
+    char dst[TOPK_KEY_SIZE];
+};
+
+/* What the session table shows besides the connection data */
+struct socks_activity{
+    time_t started;             // clocks_wall_sec at creation
+    time_t last;                // last byte relayed
+    uint64_t bytes_up;          // sent to the origin
+    uint64_t bytes_down;        // sent to the client
 };
 
 struct parsers_t{
@@ -73,6 +114,9 @@ struct parsers_t{
 };
 
 typedef struct socks_conn_model {
+    uint64_t id;                        // unique for the lifetime of the process
+    uint32_t slot;                      // in the session table (sessions.h)
+    bool killed;                        // terminated while the resolver held it
 
     struct std_conn_model * cli_conn;
     struct std_conn_model * src_conn;
@@ -86,10 +130,23 @@ typedef struct socks_conn_model {
 
     struct state_machine stm;
 
-    struct pop3_parser * pop3_parser;
+    bool authenticated;
+    bool auth_rejected;                 // the auth reply is a failure: close after sending it
+    bool ip_counted;                    // in the per-address limits (session_limits.h)
+    bool user_counted;                  // in the per-user limits
+    uint32_t account;                   // accounting handle of the user (accounting.h)
+
+    struct dissector_session * dissector;  // sniffing en el selector
+    struct sniff_session * sniff;          // con socks5d -w
 
     struct copy_model_t cli_copy;
     struct copy_model_t src_copy;
+
+    struct socks_timings timings;
+    struct socks_top_keys top_keys;
+    struct socks_activity activity;
+    struct token_bucket bucket;         // session rate limit (shaper.h)
+    enum acl_priority priority;         // selector priority of both sockets while relaying
 } socks_conn_model;
 
 socks_conn_model * new_socks_conn();
@@ -99,8 +156,20 @@ uint32_t socks_get_buf_size();
 
 void close_socks_conn(socks_conn_model * connection);
 
+/* Closes the session from outside its handlers (control protocol). A session
+   waiting for the resolver thread is closed when the answer arrives */
+void socks_kill(socks_conn_model * connection);
+
+/* Username the session authenticated with, NULL if it did not */
+const char * socks_get_username(socks_conn_model * connection);
+
 void pass_information(socks_conn_model * connection);
 
+void sniff_origin_init(socks_conn_model * connection, struct sniff_origin * origin);
+
+void report_credentials(const struct sniff_origin * origin, enum dissector_protocol protocol,
+                        const char * user, const char * password);
+
 void conn_information(socks_conn_model * connection);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,234 @@
+/**
+ * socks5log.c - decodificador del registro de acceso binario de socks5d
+ *
+ * Convierte segmentos escritos con `socks5d -o <dir>' a TSV o JSON (una
+ * linea por entrada). Con -f / -t solo decodifica las entradas dentro del
+ * rango: los segmentos fuera de rango se descartan por su header y dentro de
+ * cada segmento el inicio se busca con una busqueda binaria.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include "../logger/access_log_format.h"
+
+#define NSEC 1000000000LL
+
+static bool json = false;
+static int64_t from_ns = INT64_MIN;
+static int64_t to_ns = INT64_MAX;
+
+static void
+usage(const char * progname){
+    fprintf(stderr,
+        "Usage: %s [-j] [-f <desde>] [-t <hasta>] <segmento>...\n"
+        "\n"
+        "   -j          Imprime JSON (un objeto por linea) en lugar de TSV.\n"
+        "   -f <desde>  Solo entradas a partir de esta fecha.\n"
+        "   -t <hasta>  Solo entradas hasta esta fecha (inclusive).\n"
+        "   -h          Imprime la ayuda y termina.\n"
+        "\n"
+        "Las fechas son segundos desde epoch o YYYY-MM-DDTHH:MM:SS[Z], en UTC.\n",
+        progname);
+}
+
+/* Dias desde 1970-01-01 para una fecha del calendario gregoriano */
+static int64_t
+days_from_civil(int64_t y, unsigned m, unsigned d){
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+/* Retorna -1 si `s' no es una fecha valida */
+static int
+parse_time(const char * s, int64_t * ns){
+    int y, mo, d, h, mi, sec, n = 0;
+    if(sscanf(s, "%4d-%2d-%2dT%2d:%2d:%2d%n", &y, &mo, &d, &h, &mi, &sec, &n) == 6 &&
+       (s[n] == '\0' || (s[n] == 'Z' && s[n + 1] == '\0'))){
+        if(mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60)
+            return -1;
+        *ns = ((days_from_civil(y, mo, d) * 24 + h) * 60 + mi) * 60 * NSEC + (int64_t)sec * NSEC;
+        return 0;
+    }
+    char * end;
+    long long seconds = strtoll(s, &end, 10);
+    if(end == s || *end != '\0')
+        return -1;
+    *ns = seconds * NSEC;
+    return 0;
+}
+
+static void
+format_time(int64_t ns, char * out, size_t size){
+    time_t seconds = (time_t)(ns / NSEC);
+    struct tm tp;
+    gmtime_r(&seconds, &tp);
+    size_t len = strftime(out, size, "%Y-%m-%dT%H:%M:%S", &tp);
+    snprintf(out + len, size - len, ".%03dZ", (int)(ns % NSEC / 1000000));
+}
+
+static void
+format_addr(uint8_t family, const uint8_t * addr, char * out, size_t size){
+    if(family == 4 || family == 6)
+        inet_ntop(family == 4 ? AF_INET : AF_INET6, addr, out, size);
+    else
+        snprintf(out, size, "-");
+}
+
+static const char *
+dst_type_name(uint8_t type){
+    switch(type){
+        case 0x01: return "ipv4";
+        case 0x03: return "fqdn";
+        case 0x04: return "ipv6";
+        default:   return "unknown";
+    }
+}
+
+static void
+print_entry(const struct access_log_header * h, const struct access_log_entry * e){
+    char time_buff[sizeof("2022-11-19T12:00:00.000Z")];
+    char src[INET6_ADDRSTRLEN], dst[INET6_ADDRSTRLEN];
+    format_time((int64_t)(h->anchor_wall_ns + (e->mono_ns - h->anchor_mono_ns)),
+                time_buff, sizeof(time_buff));
+    format_addr(e->src_family, e->src_addr, src, sizeof(src));
+    format_addr(e->dst_family, e->dst_addr, dst, sizeof(dst));
+
+    if(json){
+        printf("{\"time\":\"%s\",\"session\":%llu,\"src_addr\":\"%s\",\"src_port\":%u,"
+               "\"dst_type\":\"%s\",\"dst_addr\":\"%s\",\"dst_port\":%u,\"reply\":%u}\n",
+               time_buff, (unsigned long long)e->session, src, ntohs(e->src_port),
+               dst_type_name(e->dst_type), dst, ntohs(e->dst_port), e->reply);
+    } else {
+        printf("%s\t%llu\t%s\t%u\t%s\t%s\t%u\t%u\n",
+               time_buff, (unsigned long long)e->session, src, ntohs(e->src_port),
+               dst_type_name(e->dst_type), dst, ntohs(e->dst_port), e->reply);
+    }
+}
+
+/* Primera entrada con mono_ns >= `mono' */
+static uint64_t
+lower_bound(const struct access_log_entry * entries, uint64_t count, uint64_t mono){
+    uint64_t lo = 0, hi = count;
+    while(lo < hi){
+        uint64_t mid = lo + (hi - lo) / 2;
+        if(entries[mid].mono_ns < mono) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Pasa un rango de tiempo real a tiempos monotonicos del segmento */
+static int64_t
+to_mono(const struct access_log_header * h, int64_t wall_ns){
+    if(wall_ns == INT64_MIN || wall_ns == INT64_MAX)
+        return wall_ns;
+    return wall_ns - (int64_t)h->anchor_wall_ns + (int64_t)h->anchor_mono_ns;
+}
+
+static int
+decode_segment(const char * path){
+    int ret = -1;
+    int fd = open(path, O_RDONLY);
+    if(fd == -1){
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(struct access_log_header)){
+        fprintf(stderr, "%s: not an access log segment\n", path);
+        goto finally;
+    }
+    void * map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED){
+        perror(path);
+        goto finally;
+    }
+
+    const struct access_log_header * h = map;
+    if(memcmp(h->magic, ACCESS_LOG_MAGIC, sizeof(h->magic)) != 0 ||
+       h->version != ACCESS_LOG_VERSION || h->entry_size != sizeof(struct access_log_entry) ||
+       h->header_size != sizeof(struct access_log_header)){
+        fprintf(stderr, "%s: not an access log segment\n", path);
+        goto unmap;
+    }
+    if(h->byte_order != ACCESS_LOG_BYTE_ORDER){
+        fprintf(stderr, "%s: written by a host with a different byte order\n", path);
+        goto unmap;
+    }
+
+    /* Un segmento abierto puede tener menos entradas escritas que lugar */
+    uint64_t count = h->count;
+    uint64_t fits = (st.st_size - h->header_size) / h->entry_size;
+    if(count > fits) count = fits;
+    ret = 0;
+
+    int64_t from = to_mono(h, from_ns), to = to_mono(h, to_ns);
+    if(count == 0 || (int64_t)h->last_mono_ns < from || (int64_t)h->first_mono_ns > to)
+        goto unmap;
+
+    const struct access_log_entry * entries = (const struct access_log_entry *)
+                                              ((const uint8_t *)map + h->header_size);
+    uint64_t i = from <= 0 ? 0 : lower_bound(entries, count, (uint64_t)from);
+    for(; i < count && (int64_t)entries[i].mono_ns <= to; i++)
+        print_entry(h, &entries[i]);
+
+unmap:
+    munmap(map, st.st_size);
+finally:
+    close(fd);
+    return ret;
+}
+
+int
+main(int argc, char ** argv){
+    int c;
+    while((c = getopt(argc, argv, "jf:t:h")) != -1){
+        switch(c){
+            case 'j':
+                json = true;
+                break;
+            case 'f':
+            case 't':
+                if(parse_time(optarg, c == 'f' ? &from_ns : &to_ns) == -1){
+                    fprintf(stderr, "invalid date: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind == argc){
+        usage(argv[0]);
+        return 1;
+    }
+
+    if(!json)
+        printf("time\tsession\tsrc_addr\tsrc_port\tdst_type\tdst_addr\tdst_port\treply\n");
+
+    int ret = 0;
+    for(int i = optind; i < argc; i++){
+        if(decode_segment(argv[i]) == -1)
+            ret = 1;
+    }
+    return ret;
+}
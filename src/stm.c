@@ -4,6 +4,7 @@
  */
 #include <stdlib.h>
 #include "include/stm.h"
+#include "logger/trace.h"
 
 #define N(x) (sizeof(x)/sizeof((x)[0]))
 
@@ -38,6 +39,7 @@ void jump(struct state_machine *stm, unsigned next, struct selector_key *key) {
         abort();
     }
     if(stm->current != stm->states + next) {
+        TRACE(STM_JUMP, key->fd, 0, stm->current == NULL ? next : stm->current->state, next);
         if(stm->current != NULL && stm->current->on_departure != NULL) {
             stm->current->on_departure(stm->current->state, key);
         }
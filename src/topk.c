@@ -0,0 +1,274 @@
+/**
+ * topk.c - claves mas pesadas de un stream con memoria fija
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "include/topk.h"
+
+#define FNV64_OFFSET 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+
+typedef struct topk_entry {
+    uint64_t hash;
+    uint64_t count;
+    uint32_t heap_pos;
+    uint16_t len;
+    char key[TOPK_KEY_SIZE + 1];
+} topk_entry;
+
+struct topk {
+    size_t k;
+    size_t used;
+
+    uint64_t * sketch;          // TOPK_SKETCH_DEPTH filas de width contadores
+    size_t width_mask;
+
+    topk_entry * entries;       // k
+    uint32_t * heap;            // indices en entries, min-heap por count
+    uint32_t * index;           // hash abierto de indice + 1 en entries, 0 libre
+    size_t index_mask;
+};
+
+static size_t
+next_pow2(size_t n){
+    size_t p = 1;
+    while(p < n) p <<= 1;
+    return p;
+}
+
+topk *
+topk_new(size_t k, size_t width){
+    if(k == 0 || width == 0)
+        return NULL;
+    topk * t = calloc(1, sizeof(topk));
+    if(t == NULL)
+        return NULL;
+
+    t->k = k;
+    t->width_mask = next_pow2(width) - 1;
+    t->index_mask = next_pow2(k * 2) - 1;
+    t->sketch = calloc(TOPK_SKETCH_DEPTH * (t->width_mask + 1), sizeof(uint64_t));
+    t->entries = calloc(k, sizeof(topk_entry));
+    t->heap = calloc(k, sizeof(uint32_t));
+    t->index = calloc(t->index_mask + 1, sizeof(uint32_t));
+    if(t->sketch == NULL || t->entries == NULL || t->heap == NULL || t->index == NULL){
+        topk_free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void
+topk_free(topk * t){
+    if(t == NULL)
+        return;
+    free(t->sketch);
+    free(t->entries);
+    free(t->heap);
+    free(t->index);
+    free(t);
+}
+
+uint64_t
+topk_hash(const char * key, size_t len){
+    uint64_t h = FNV64_OFFSET;
+    for(size_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)key[i]) * FNV64_PRIME;
+    /* FNV mezcla mal los bits altos, que se usan como segundo hash */
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Fila `row' del sketch: h1 + row * h2 (Kirsch-Mitzenmacher) */
+static inline uint64_t *
+sketch_cell(const topk * t, uint64_t hash, unsigned row){
+    uint32_t h1 = (uint32_t)hash;
+    uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+    size_t col = (h1 + (size_t)row * h2) & t->width_mask;
+    return &t->sketch[row * (t->width_mask + 1) + col];
+}
+
+uint64_t
+topk_estimate(const topk * t, uint64_t hash){
+    uint64_t min = UINT64_MAX;
+    for(unsigned row = 0; row < TOPK_SKETCH_DEPTH; row++){
+        uint64_t v = *sketch_cell(t, hash, row);
+        if(v < min) min = v;
+    }
+    return min;
+}
+
+/* Actualizacion conservadora: solo crecen los contadores que quedarian por
+   debajo de la nueva estimacion */
+static uint64_t
+sketch_add(topk * t, uint64_t hash, uint64_t weight){
+    uint64_t estimate = topk_estimate(t, hash) + weight;
+    for(unsigned row = 0; row < TOPK_SKETCH_DEPTH; row++){
+        uint64_t * cell = sketch_cell(t, hash, row);
+        if(*cell < estimate) *cell = estimate;
+    }
+    return estimate;
+}
+
+/* --------------------------- heap --------------------------- */
+
+static inline uint64_t
+heap_count(const topk * t, size_t pos){
+    return t->entries[t->heap[pos]].count;
+}
+
+static inline void
+heap_set(topk * t, size_t pos, uint32_t entry){
+    t->heap[pos] = entry;
+    t->entries[entry].heap_pos = pos;
+}
+
+static void
+sift_down(topk * t, size_t pos){
+    uint32_t entry = t->heap[pos];
+    uint64_t count = t->entries[entry].count;
+    for(;;){
+        size_t child = pos * 2 + 1;
+        if(child >= t->used)
+            break;
+        if(child + 1 < t->used && heap_count(t, child + 1) < heap_count(t, child))
+            child++;
+        if(count <= heap_count(t, child))
+            break;
+        heap_set(t, pos, t->heap[child]);
+        pos = child;
+    }
+    heap_set(t, pos, entry);
+}
+
+static void
+sift_up(topk * t, size_t pos){
+    uint32_t entry = t->heap[pos];
+    uint64_t count = t->entries[entry].count;
+    while(pos > 0){
+        size_t parent = (pos - 1) / 2;
+        if(heap_count(t, parent) <= count)
+            break;
+        heap_set(t, pos, t->heap[parent]);
+        pos = parent;
+    }
+    heap_set(t, pos, entry);
+}
+
+/* --------------------------- indice --------------------------- */
+
+/* Posicion en el indice de la clave, o de la ranura libre donde iria */
+static size_t
+index_find(const topk * t, const char * key, size_t len, uint64_t hash){
+    size_t i = hash & t->index_mask;
+    while(t->index[i] != 0){
+        const topk_entry * e = &t->entries[t->index[i] - 1];
+        if(e->hash == hash && e->len == len && memcmp(e->key, key, len) == 0)
+            return i;
+        i = (i + 1) & t->index_mask;
+    }
+    return i;
+}
+
+/* Borrado con corrimiento hacia atras, sin marcas de borrado */
+static void
+index_remove(topk * t, uint32_t entry){
+    size_t i = t->entries[entry].hash & t->index_mask;
+    while(t->index[i] != entry + 1)
+        i = (i + 1) & t->index_mask;
+    t->index[i] = 0;
+
+    for(size_t j = (i + 1) & t->index_mask; t->index[j] != 0; j = (j + 1) & t->index_mask){
+        size_t home = t->entries[t->index[j] - 1].hash & t->index_mask;
+        /* Se mueve solo si su posicion ideal no esta en (i, j] */
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if(!stays){
+            t->index[i] = t->index[j];
+            t->index[j] = 0;
+            i = j;
+        }
+    }
+}
+
+void
+topk_add(topk * t, const char * key, size_t len, uint64_t hash, uint64_t weight){
+    if(weight == 0)
+        return;
+    if(len > TOPK_KEY_SIZE)
+        len = TOPK_KEY_SIZE;
+
+    uint64_t estimate = sketch_add(t, hash, weight);
+
+    size_t slot = index_find(t, key, len, hash);
+    uint32_t entry;
+    if(t->index[slot] != 0){
+        entry = t->index[slot] - 1;
+        t->entries[entry].count = estimate;
+        sift_down(t, t->entries[entry].heap_pos);
+        return;
+    }
+
+    bool replaced = t->used == t->k;
+    if(!replaced){
+        entry = t->used++;
+    } else {
+        /* Space-Saving: la clave nueva ocupa el lugar del minimo */
+        entry = t->heap[0];
+        if(estimate <= t->entries[entry].count)
+            return;
+        index_remove(t, entry);
+        slot = index_find(t, key, len, hash);
+    }
+
+    topk_entry * e = &t->entries[entry];
+    e->hash = hash;
+    e->count = estimate;
+    e->len = len;
+    memcpy(e->key, key, len);
+    e->key[len] = '\0';
+    t->index[slot] = entry + 1;
+    if(replaced){
+        sift_down(t, 0);
+    } else {
+        heap_set(t, entry, entry);
+        sift_up(t, entry);
+    }
+}
+
+static int
+compare_items(const void * a, const void * b){
+    uint64_t ca = ((const topk_item *)a)->count;
+    uint64_t cb = ((const topk_item *)b)->count;
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+size_t
+topk_list(const topk * t, topk_item * out, size_t n){
+    if(t->used == 0)
+        return 0;
+    topk_item * all = malloc(t->used * sizeof(topk_item));
+    if(all == NULL)
+        return 0;
+    for(size_t i = 0; i < t->used; i++){
+        all[i].key = t->entries[i].key;
+        all[i].hash = t->entries[i].hash;
+        all[i].count = t->entries[i].count;
+    }
+    qsort(all, t->used, sizeof(topk_item), compare_items);
+    if(n > t->used) n = t->used;
+    memcpy(out, all, n * sizeof(topk_item));
+    free(all);
+    return n;
+}
+
+size_t
+topk_memory(const topk * t){
+    return sizeof(topk)
+         + TOPK_SKETCH_DEPTH * (t->width_mask + 1) * sizeof(uint64_t)
+         + t->k * (sizeof(topk_entry) + sizeof(uint32_t))
+         + (t->index_mask + 1) * sizeof(uint32_t);
+}
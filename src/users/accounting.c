@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "accounting.h"
+#include "../include/clocks.h"
+#include "../logger/logger.h"
+
+static struct accounting_header * header = NULL;
+static struct accounting_record * records = NULL;
+static int fd = -1;                     /* -1 si la tabla esta en memoria */
+static size_t map_size = 0;
+static uint32_t * table = NULL;         /* handles, ACCOUNTING_NO_HANDLE si libre */
+static size_t table_mask = 0;
+static time_t last_flush = 0;
+
+static size_t
+table_size_for(size_t capacity){
+    size_t size = 1;
+    while(size < 2 * capacity)
+        size <<= 1;
+    return size;
+}
+
+static uint32_t
+name_hash(const char * name){
+    uint32_t h = 2166136261u;
+    for(; *name != '\0'; name++){
+        h ^= (uint8_t) *name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static size_t
+find_slot(const char * name){
+    size_t slot = name_hash(name) & table_mask;
+    while(table[slot] != ACCOUNTING_NO_HANDLE && strcmp(records[table[slot]].user, name) != 0)
+        slot = (slot + 1) & table_mask;
+    return slot;
+}
+
+/* La tabla hash se arma de nuevo cada vez que crece el arreglo */
+static bool
+rebuild_table(void){
+    size_t size = table_size_for(header->capacity);
+    uint32_t * new_table = malloc(size * sizeof(*new_table));
+    if(new_table == NULL)
+        return false;
+    free(table);
+    table = new_table;
+    table_mask = size - 1;
+    memset(table, 0xFF, size * sizeof(*table));
+    for(uint32_t i = 0; i < header->count; i++)
+        table[find_slot(records[i].user)] = i;
+    return true;
+}
+
+static void
+set_map(void * map, size_t size){
+    header = map;
+    records = (struct accounting_record *)(header + 1);
+    map_size = size;
+}
+
+static size_t
+size_for(size_t capacity){
+    return sizeof(struct accounting_header) + capacity * sizeof(struct accounting_record);
+}
+
+static void
+init_header(size_t capacity){
+    memcpy(header->magic, ACCOUNTING_MAGIC, sizeof(header->magic));
+    header->version = ACCOUNTING_VERSION;
+    header->record_size = sizeof(struct accounting_record);
+    header->capacity = capacity;
+    header->count = 0;
+}
+
+static bool
+valid_header(size_t file_size){
+    return file_size >= sizeof(struct accounting_header)
+        && memcmp(header->magic, ACCOUNTING_MAGIC, sizeof(header->magic)) == 0
+        && header->version == ACCOUNTING_VERSION
+        && header->record_size == sizeof(struct accounting_record)
+        && header->count <= header->capacity
+        && size_for(header->capacity) <= file_size;
+}
+
+/* Sin archivo la tabla arranca en memoria la primera vez que se usa */
+static bool
+ensure_table(void){
+    if(header != NULL)
+        return true;
+    size_t size = size_for(ACCOUNTING_INITIAL_RECORDS);
+    void * map = calloc(1, size);
+    if(map == NULL)
+        return false;
+    set_map(map, size);
+    init_header(ACCOUNTING_INITIAL_RECORDS);
+    if(!rebuild_table()){
+        free(map);
+        header = NULL;
+        records = NULL;
+        return false;
+    }
+    return true;
+}
+
+int
+accounting_open(const char * path){
+    int file = open(path, O_RDWR | O_CREAT, 0640);
+    struct stat st;
+    if(file == -1 || fstat(file, &st) == -1){
+        perror("accounting: open");
+        if(file != -1)
+            close(file);
+        return -1;
+    }
+
+    bool created = st.st_size == 0;
+    size_t size = created ? size_for(ACCOUNTING_INITIAL_RECORDS) : (size_t) st.st_size;
+    void * map = MAP_FAILED;
+    if((created && ftruncate(file, size) == -1) ||
+       (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0)) == MAP_FAILED){
+        perror("accounting: mmap");
+        close(file);
+        return -1;
+    }
+    set_map(map, size);
+    if(created){
+        init_header(ACCOUNTING_INITIAL_RECORDS);
+    } else if(!valid_header(size)){
+        fprintf(stderr, "accounting: %s is not an accounting file\n", path);
+        munmap(map, size);
+        close(file);
+        header = NULL;
+        records = NULL;
+        return -1;
+    }
+    fd = file;
+    if(!rebuild_table()){
+        accounting_close();
+        return -1;
+    }
+    last_flush = clocks_wall_sec();
+    return 0;
+}
+
+void
+accounting_close(void){
+    if(header == NULL)
+        return;
+    if(fd != -1){
+        msync(header, map_size, MS_SYNC);
+        munmap(header, map_size);
+        close(fd);
+        fd = -1;
+    } else {
+        free(header);
+    }
+    header = NULL;
+    records = NULL;
+    free(table);
+    table = NULL;
+}
+
+/* Duplica la capacidad. En el archivo se agranda y se mapea el tamanio
+   nuevo antes de soltar el mapeo actual: si algo falla la tabla sigue
+   entera y solo el usuario nuevo se queda sin handle */
+static bool
+grow(void){
+    size_t capacity = 2 * header->capacity;
+    size_t size = size_for(capacity);
+    void * map;
+    if(fd != -1){
+        if(ftruncate(fd, size) == -1 ||
+           (map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED){
+            LogError("Cannot grow the accounting file");
+            if(ftruncate(fd, map_size) == -1)
+                LogError("Cannot restore the accounting file size");
+            return false;
+        }
+        /* Los dos mapeos comparten las paginas del archivo */
+        munmap(header, map_size);
+    } else {
+        map = realloc(header, size);
+        if(map == NULL)
+            return false;
+        memset((char *) map + map_size, 0, size - map_size);
+    }
+    set_map(map, size);
+    header->capacity = capacity;
+    return rebuild_table();
+}
+
+uint32_t
+accounting_handle(const char * user){
+    if(!ensure_table())
+        return ACCOUNTING_NO_HANDLE;
+    size_t slot = find_slot(user);
+    if(table[slot] != ACCOUNTING_NO_HANDLE)
+        return table[slot];
+
+    if(header->count == header->capacity){
+        if(!grow())
+            return ACCOUNTING_NO_HANDLE;
+        slot = find_slot(user);
+    }
+    uint32_t handle = header->count;
+    struct accounting_record * r = &records[handle];
+    memset(r, 0, sizeof(*r));
+    snprintf(r->user, sizeof(r->user), "%s", user);
+    r->first_seen = r->last_seen = clocks_wall_sec();
+    table[slot] = handle;
+    header->count++;
+    return handle;
+}
+
+uint32_t
+accounting_find(const char * user){
+    if(header == NULL)
+        return ACCOUNTING_NO_HANDLE;
+    return table[find_slot(user)];
+}
+
+void
+accounting_session_start(uint32_t handle){
+    if(handle >= accounting_count())
+        return;
+    records[handle].connections++;
+    records[handle].last_seen = clocks_wall_sec();
+}
+
+void
+accounting_add(uint32_t handle, uint64_t bytes_up, uint64_t bytes_down){
+    if(handle >= accounting_count())
+        return;
+    records[handle].bytes_up += bytes_up;
+    records[handle].bytes_down += bytes_down;
+}
+
+void
+accounting_session_end(uint32_t handle, uint64_t duration_ms){
+    if(handle >= accounting_count())
+        return;
+    records[handle].duration_ms += duration_ms;
+    records[handle].last_seen = clocks_wall_sec();
+}
+
+size_t
+accounting_count(void){
+    return header == NULL ? 0 : header->count;
+}
+
+const struct accounting_record *
+accounting_get(uint32_t handle){
+    return handle < accounting_count() ? &records[handle] : NULL;
+}
+
+void
+accounting_tick(void){
+    if(fd == -1)
+        return;
+    time_t now = clocks_wall_sec();
+    if(now - last_flush < ACCOUNTING_FLUSH_SECONDS)
+        return;
+    last_flush = now;
+    if(msync(header, map_size, MS_ASYNC) == -1)
+        LogError("Cannot flush the accounting file");
+}
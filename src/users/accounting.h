@@ -0,0 +1,90 @@
+#ifndef ACCOUNTING_H
+#define ACCOUNTING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+Contabilidad de trafico por usuario.
+
+Un registro por usuario autenticado con los bytes enviados en cada
+direccion, las conexiones y la duracion acumulada de sus sesiones. La
+sesion toma el handle del usuario (la posicion de su registro) al
+autenticarse, asi que sumar bytes es indexar un arreglo: el nombre se busca
+una vez por sesion, en una tabla hash de sondeo lineal. Los registros no se
+borran: un usuario dado de baja conserva lo que uso.
+
+Con socks5d -A <archivo> la tabla es un archivo mapeado con MAP_SHARED: lo
+escrito queda en el page cache y sobrevive un reinicio del proceso, y cada
+ACCOUNTING_FLUSH_SECONDS se pide escribirlo a disco (msync asincronico)
+para que sobreviva tambien una caida del sistema. Al arrancar se retoman
+los registros del archivo. Sin -A la tabla esta solo en memoria.
+
+Solo se usa desde el hilo del selector.
+*/
+
+#define ACCOUNTING_MAGIC "S5ACCT\0"
+#define ACCOUNTING_VERSION 1
+#define ACCOUNTING_USER_SIZE 256
+#define ACCOUNTING_INITIAL_RECORDS 256
+#define ACCOUNTING_FLUSH_SECONDS 5
+#define ACCOUNTING_NO_HANDLE UINT32_MAX
+
+struct accounting_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t capacity;                  /* registros que entran en el archivo */
+    uint64_t count;                     /* registros usados */
+    uint8_t reserved[32];
+};
+
+struct accounting_record{
+    char user[ACCOUNTING_USER_SIZE];
+    uint64_t bytes_up;                  /* enviados al origen */
+    uint64_t bytes_down;                /* enviados al cliente */
+    uint64_t connections;
+    uint64_t duration_ms;               /* de las sesiones ya cerradas */
+    int64_t first_seen;                 /* segundos desde epoch */
+    int64_t last_seen;
+    uint8_t reserved[16];
+};
+
+_Static_assert(sizeof(struct accounting_header) == 64, "accounting header layout");
+_Static_assert(sizeof(struct accounting_record) == 320, "accounting record layout");
+
+/** Guarda la tabla en `path', retomando lo que tenga. -1 si no se puede
+    usar (o no es un archivo de contabilidad). Se llama antes de la primera
+    sesion */
+int accounting_open(const char * path);
+
+/** Escribe lo pendiente y libera la tabla */
+void accounting_close(void);
+
+/** Handle del usuario, creando su registro si no tiene.
+    ACCOUNTING_NO_HANDLE si no hay memoria */
+uint32_t accounting_handle(const char * user);
+
+/** Una sesion del usuario se autentico */
+void accounting_session_start(uint32_t handle);
+
+void accounting_add(uint32_t handle, uint64_t bytes_up, uint64_t bytes_down);
+
+/** Una sesion del usuario termino despues de `duration_ms' */
+void accounting_session_end(uint32_t handle, uint64_t duration_ms);
+
+size_t accounting_count(void);
+
+/** El registro del handle, NULL si no existe. Vale hasta la proxima
+    llamada a accounting_handle */
+const struct accounting_record * accounting_get(uint32_t handle);
+
+/** Handle del usuario sin crearlo, ACCOUNTING_NO_HANDLE si no tiene */
+uint32_t accounting_find(const char * user);
+
+/** Pide escribir la tabla a disco si pasaron ACCOUNTING_FLUSH_SECONDS
+    desde la ultima vez. Se llama en cada vuelta del selector */
+void accounting_tick(void);
+
+#endif
@@ -3,17 +3,87 @@
 #include <stdio.h>
 #include "../logger/logger.h"
 
-#define MAX_USERS 10
-
-static user_t * users[MAX_USERS];
-
-uint8_t total_users = 0;
+#define USERS_INITIAL_CAPACITY 16
+#define EMPTY -1
+
+/* Los usuarios estan densos en `users' (se recorren por posicion) y una
+   tabla hash de sondeo lineal lleva de un nombre a su posicion, asi que
+   buscar, agregar y borrar no dependen de la cantidad de usuarios */
+static user_t ** users = NULL;
+static size_t capacity = 0;
+static int32_t * table = NULL;          /* posiciones en `users' */
+static size_t table_mask = 0;           /* tamanio de la tabla - 1 */
+
+size_t total_users = 0;
 bool require_auth = false;
 char * curr_user = NULL;
 
-bool 
-valid_credentials(char * username, char * password, char * user2, char * pass2){
-    return strcmp(username, user2) == 0 && strcmp(password, pass2) == 0;
+static uint32_t
+name_hash(const char * name){
+    uint32_t h = 2166136261u;
+    for(; *name != '\0'; name++){
+        h ^= (uint8_t) *name;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Slot con el usuario `name', o el slot vacio donde iria */
+static size_t
+find_slot(const char * name){
+    size_t slot = name_hash(name) & table_mask;
+    while(table[slot] != EMPTY && strcmp(users[table[slot]]->name, name) != 0)
+        slot = (slot + 1) & table_mask;
+    return slot;
+}
+
+/* Slot que apunta a la posicion `pos' */
+static size_t
+slot_of(size_t pos){
+    size_t slot = name_hash(users[pos]->name) & table_mask;
+    while(table[slot] != (int32_t) pos)
+        slot = (slot + 1) & table_mask;
+    return slot;
+}
+
+/* Borrado con desplazamiento hacia atras, como en el store de credenciales */
+static void
+table_remove(size_t slot){
+    size_t next = slot;
+    while(true){
+        next = (next + 1) & table_mask;
+        if(table[next] == EMPTY)
+            break;
+        size_t home = name_hash(users[table[next]]->name) & table_mask;
+        bool movable = slot <= next ? (home <= slot || home > next)
+                                    : (home <= slot && home > next);
+        if(movable){
+            table[slot] = table[next];
+            slot = next;
+        }
+    }
+    table[slot] = EMPTY;
+}
+
+/* Duplica la capacidad y rearma la tabla (el doble de slots que usuarios) */
+static int
+grow(void){
+    size_t new_capacity = capacity == 0 ? USERS_INITIAL_CAPACITY : capacity * 2;
+    user_t ** new_users = realloc(users, new_capacity * sizeof(*new_users));
+    if(new_users == NULL)
+        return -1;
+    users = new_users;
+    int32_t * new_table = malloc(2 * new_capacity * sizeof(*new_table));
+    if(new_table == NULL)
+        return -1;
+    free(table);
+    table = new_table;
+    capacity = new_capacity;
+    table_mask = 2 * new_capacity - 1;
+    memset(table, 0xFF, 2 * new_capacity * sizeof(*table));    /* EMPTY */
+    for(size_t i = 0; i < total_users; i++)
+        table[find_slot(users[i]->name)] = i;
+    return 0;
 }
 
 bool
@@ -35,7 +105,7 @@ free_curr_user(){
     }
 }
 
-uint8_t
+size_t
 get_total_curr_users(){
     return total_users;
 }
@@ -43,43 +113,30 @@ get_total_curr_users(){
 int 
 process_authentication_request(char * username, char * password){
     if(!require_auth) return 0;
-    for(int i = 0; i < total_users; i++){
-        if(valid_credentials(username, password, users[i]->name, users[i]->pass)){
-            return 0;
-        }
-    }
-    return -1;
+    return user_exists(username, password) == -1 ? -1 : 0;
 }
 
 int
 user_exists(char * username, char * password){
     if(username == NULL || password == NULL){
         LogError("Username or password are invalid.");
-        goto finally;
-    }
-    for(int i = 0; i < total_users; i++){
-        if(valid_credentials(username, password, users[i]->name, users[i]->pass)){
-            return i;
-        }
+        return -1;
     }
-finally:
+    int pos = user_exists_by_username(username);
+    if(pos != -1 && strcmp(users[pos]->pass, password) == 0)
+        return pos;
     return -1;
 }
 
 int
 user_exists_by_username(char * username){
-    int ret = -1;
     if(username == NULL){
         LogError("Username is invalid.");
-        return ret;
-    }
-    for(int i = 0; i < total_users; i++){
-        if(strcmp(username, users[i]->name) == 0){
-            ret = i;
-            break;
-        }
+        return -1;
     }
-    return ret;
+    if(total_users == 0)
+        return -1;
+    return table[find_slot(username)];
 }
 
 int 
@@ -87,7 +144,13 @@ remove_user(char * username){
     int pos = user_exists_by_username(username);
     if(pos == -1){LogError("User does not exist."); return -1;}
     struct user_t * to_delete = users[pos];
-    users[pos] = users[total_users-1];
+    table_remove(slot_of(pos));
+    /* El ultimo ocupa el lugar del borrado */
+    size_t last = total_users - 1;
+    if((size_t) pos != last){
+        table[slot_of(last)] = pos;
+        users[pos] = users[last];
+    }
     free(to_delete->name);
     free(to_delete->pass);
     free(to_delete);
@@ -102,30 +165,36 @@ enum add_user_state
 add_user(user_t * user){
     if(total_users == MAX_USERS){
         LogError("Alcanzaste un máximo de usuarios.\n");
-        //free(user);
         return ADD_MAX_USERS;
     }
     if(user_exists_by_username(user->name) != -1){
         LogError("Usuario ya existe.\n");
-        //free(user);
         return ADD_USER_EXISTS;
     }
-    users[total_users] = malloc(sizeof(user_t));
-    if(users[total_users] == NULL){
+    if(total_users == capacity && grow() < 0){
+        LogError("Error with malloc\n");
+        return ADD_ERROR;
+    }
+    user_t * new = malloc(sizeof(user_t));
+    if(new == NULL){
         LogError("Error with malloc\n");
-        //free(user);
         return ADD_ERROR;
     }
-    users[total_users]->name = malloc(strlen(user->name) + 1);
-    users[total_users]->pass = malloc(strlen(user->pass) + 1);
+    new->name = malloc(strlen(user->name) + 1);
+    new->pass = malloc(strlen(user->pass) + 1);
 
-    if(users[total_users]->name == NULL || users[total_users]->pass == NULL){
+    if(new->name == NULL || new->pass == NULL){
         LogError("Error with malloc\n");
+        free(new->name);
+        free(new->pass);
+        free(new);
         return ADD_ERROR;
     }
-    strcpy(users[total_users]->name, user->name);
-    strcpy(users[total_users]->pass, user->pass);
+    strcpy(new->name, user->name);
+    strcpy(new->pass, user->pass);
 
+    users[total_users] = new;
+    table[find_slot(new->name)] = total_users;
     total_users++;
     require_auth = true;
     return ADD_OK;
@@ -138,9 +207,12 @@ change_password(char * username, char * new_password){
         LogError("User does not exist."); 
         return -1;
     }
+    char * pass = malloc(strlen(new_password) + 1);
+    if(pass == NULL)
+        return -1;
+    strcpy(pass, new_password);
     free(users[pos]->pass);
-    users[pos]->pass = malloc(strlen(new_password + 1));
-    strcpy(users[pos]->pass, new_password);
+    users[pos]->pass = pass;
     return 0;
 }
 
@@ -148,6 +220,3 @@ user_t **
 get_all_users(){
     return users;
 }
-
-uint8_t 
-get_total_users(){ return total_users; }
\ No newline at end of file
@@ -18,7 +18,7 @@ enum add_user_state{
 int process_authentication_request(char * username, char * password);
 char * get_curr_user();
 void set_curr_user(char * username);
-uint8_t get_total_curr_users();
+size_t get_total_curr_users();
 void free_curr_user();
 enum add_user_state add_user(user_t * user);
 bool needs_auth();
@@ -26,6 +26,8 @@ int remove_user(char * username);
 int change_password(char * username, char * new_password);
 int
 user_exists(char * username, char * password);
+int
+user_exists_by_username(char * username);
 user_t **
 get_all_users();
 